@@ -13,6 +13,7 @@
 /* STDLIB */
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Framework */
 #include <freertos/FreeRTOS.h>
@@ -35,7 +36,7 @@ static const int i2s_num = 0;		/*!< I2S port number */
 
 /* Private structures --------------------------------------------------------*/
 
-static const i2s_config_t i2s_iface_cfg = {
+static i2s_config_t i2s_iface_cfg = {
 		.mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_PDM,
 		.sample_rate = I2S_SAMPLE_RATE,
 		.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
@@ -52,6 +53,24 @@ static const i2s_pin_config_t i2s_pin_cfg = {
 		.data_in_num = PIN_NUM_MP45DT02_DOUT,
 };
 
+/* Private variables ---------------------------------------------------------*/
+
+static bool is_installed;	/*!< The I2S driver is installed, the reads may use it */
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Install the I2S driver with the current configuration and set its pins */
+static esp_err_t _install(void) {
+	if (i2s_driver_install(i2s_num, &i2s_iface_cfg, 0, NULL) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	if (i2s_set_pin(i2s_num, &i2s_pin_cfg) != ESP_OK) {
+		i2s_driver_uninstall(i2s_num);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
 /* Export functions ----------------------------------------------------------*/
 
 /* Initialize MP45DT02 digital MEMS microphone */
@@ -60,6 +79,7 @@ esp_err_t mp45dt02_init(void) {
 	float clk;
 	/* Install and start I2S driver */
 	ret |= !i2s_driver_install(i2s_num, &i2s_iface_cfg, 0, NULL) ? ESP_OK : ESP_FAIL;
+	is_installed = ret == ESP_OK;
 	/* Get clock set on particular port number */
 	clk = i2s_get_clk(i2s_num);
 	ESP_LOGI(tag, "'mp45dt02_start' finished. Bit clock rate = %.6f", clk);
@@ -88,5 +108,54 @@ esp_err_t mp45dt02_start(void) {
 
 /* Read audio samples from the I2S microphone module */
 esp_err_t mp45dt02_take_samples(void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait) {
+	if (!is_installed) {
+		*bytes_read = 0;
+		return ESP_ERR_INVALID_STATE;
+	}
 	return (esp_err_t)i2s_read(i2s_num, dest, size, bytes_read, ticks_to_wait);
 }
+
+/* Tell whether the I2S driver is installed */
+bool mp45dt02_is_installed(void) {
+	return is_installed;
+}
+
+/* Change the sample rate and the DMA buffering of the microphone */
+esp_err_t mp45dt02_reconfigure(uint32_t sample_rate, int dma_buf_count, int dma_buf_len) {
+	esp_err_t ret = ESP_OK;
+	if (	is_installed &&
+			dma_buf_count == i2s_iface_cfg.dma_buf_count &&
+			dma_buf_len == i2s_iface_cfg.dma_buf_len) {
+		if (sample_rate == i2s_iface_cfg.sample_rate) {
+			return ESP_OK;
+		}
+		/* Only the clock has to be changed */
+		ret = i2s_set_sample_rates(i2s_num, sample_rate);
+		if (ret == ESP_OK) {
+			i2s_iface_cfg.sample_rate = sample_rate;
+		}
+		return ret;
+	}
+	/* DMA buffers are allocated on the driver installation, so the driver is reinstalled */
+	const i2s_config_t prev_cfg = i2s_iface_cfg;
+	if (is_installed) {
+		i2s_driver_uninstall(i2s_num);
+		is_installed = false;
+	}
+	i2s_iface_cfg.sample_rate = sample_rate;
+	i2s_iface_cfg.dma_buf_count = dma_buf_count;
+	i2s_iface_cfg.dma_buf_len = dma_buf_len;
+	if (_install() != ESP_OK) {
+		/* The new DMA buffers did not fit, the previous ones are taken back */
+		ESP_LOGW(tag, "Failed to install %d x %d DMA buffers", dma_buf_count, dma_buf_len);
+		i2s_iface_cfg = prev_cfg;
+		is_installed = _install() == ESP_OK;
+		if (!is_installed) {
+			ESP_LOGE(tag, "Failed to install the previous configuration again");
+		}
+		return ESP_FAIL;
+	}
+	is_installed = true;
+	ESP_LOGI(tag, "Reconfigured: %u Hz, %d x %d DMA buffers", (unsigned int)sample_rate, dma_buf_count, dma_buf_len);
+	return ESP_OK;
+}
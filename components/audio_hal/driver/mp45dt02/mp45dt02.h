@@ -15,7 +15,9 @@
 /* Includes ------------------------------------------------------------------*/
 
 /* STBLIB */
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Framework */
 #include <esp_err.h>
@@ -50,9 +52,34 @@ esp_err_t mp45dt02_start(void);
  * 								read from the DMA buffer in pieces, the overall operation may still take longer than this
  * 								timeout). Pass portMAX_DELAY for no timeout
  * @return
+ * 				- ESP_ERR_INVALID_STATE: The I2S driver is not installed
  * 				- ESP_ERR_INVALID_ARG: Parameter error
  * 				- ESP_OK: Success
  */
 esp_err_t mp45dt02_take_samples(void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait);
 
+/**
+ * @brief		Change the sample rate and the DMA buffering of the microphone. If the DMA
+ * 				buffering changes, the I2S driver is reinstalled. Must not be called while
+ * 				another task is reading samples. If the new DMA buffers cannot be allocated,
+ * 				the previous configuration is installed again
+ * @param[in]	sample_rate		Sample rate in Hz
+ * @param[in]	dma_buf_count	Number of I2S DMA buffers
+ * @param[in]	dma_buf_len		Length of one I2S DMA buffer in samples
+ * @return
+ * 				- ESP_FAIL: Unexpected error
+ * 				- ESP_OK: Success
+ */
+esp_err_t mp45dt02_reconfigure(uint32_t sample_rate, int dma_buf_count, int dma_buf_len);
+
+/**
+ * @brief	Tell whether the I2S driver is installed. It is not if neither the requested nor
+ * 			the previous configuration could be installed by mp45dt02_reconfigure
+ * @param	None
+ * @return
+ * 			- false: The driver is not installed, no samples can be read
+ * 			- true: The driver is installed
+ */
+bool mp45dt02_is_installed(void);
+
 #endif	/* MP45DT02_H__ */
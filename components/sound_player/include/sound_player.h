@@ -29,7 +29,11 @@
 
 #define PLAYER_RECV_BUF_SIZE	DEFAULT_HTTP_BUF_SIZE
 #define PLAYER_QUEUE_SIZE		100U
-#define PLAYER_BUF_CAP_MSG		(PLAYER_QUEUE_SIZE / 2)
+#define PLAYER_BUF_CAP_MSG		(PLAYER_QUEUE_SIZE / 2)		/*!< Blocks buffered before playing, fair link */
+#define PLAYER_BUF_GOOD_MSG		(PLAYER_QUEUE_SIZE / 4)		/*!< Blocks buffered before playing, good link */
+#define PLAYER_BUF_POOR_MSG		(PLAYER_QUEUE_SIZE * 3 / 4)	/*!< Blocks buffered before playing, poor link */
+#define PLAYER_BUF_LOW_MSG		(PLAYER_QUEUE_SIZE / 10)	/*!< Blocks left when the playing pauses to buffer again,
+															 * below every link target */
 
 /* Export typedef ------------------------------------------------------------*/
 
@@ -50,6 +54,9 @@ typedef struct {
 	uuid_t pend_tr_id;								/*!< Unique identifier of the track being played */
 	double vol;										/*!< Current sound level value from 0 to 100 */
 	BaseType_t is_muted;							/*!< Audio output has been disabled flag */
+	uint32_t play_pos;								/*!< Bytes of the current track fed to the decoder */
+	uint32_t resume_pos;							/*!< Offset the next start of the track is requested from,
+													 * 0 for the beginning */
 	/* Buffers */
 	char http_buf[PLAYER_RECV_BUF_SIZE + 1];		/*!< Buffer used to store data received from server */
 	uint8_t codec_buf[PLAYER_RECV_BUF_SIZE];		/*!< Buffer used to store the next chunk of the
@@ -57,7 +64,6 @@ typedef struct {
 	/* Variable used to store current player state value */
 	http_sound_getter_state_e state;				/*<! Current HTTP sound getter related state machine state */
 	/* HTTP client handles */
-	esp_http_client_handle_t http_cleaner_client;	/*!< HTTP sound commands cleaner network connection instance */
 	esp_http_client_handle_t http_getter_client;	/*!< HTTP sound getter network connection instance */
 	/* FreeRTOS mechanics */
 	QueueHandle_t queue;							/*!< Queue for storing chunks of the audio file being played */
@@ -14,6 +14,9 @@
 
 /* Includes ------------------------------------------------------------------*/
 
+/* STDLIB */
+#include <stdint.h>
+
 /* Framework */
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
@@ -27,6 +30,9 @@
 
 #define RECORDER_TRANS_BUF_SIZE		1024
 #define RECORDER_QUEUE_SIZE			200U
+#define RECORDER_SAMPLE_RATE		16000	/*!< Default sample rate of the microphone in Hz */
+#define RECORDER_BYTES_PER_SEC		(RECORDER_SAMPLE_RATE * sizeof(int16_t))
+#define RECORDER_DMA_MAX_SIZE		(32 * 1024)	/*!< Internal RAM the I2S DMA buffers of a profile may take */
 
 /* Export typedef ------------------------------------------------------------*/
 
@@ -47,6 +53,23 @@ typedef struct {
 	int Subchunk2Size;
 } wav_header_t;
 
+/** @brief	Settings of the capture pipeline */
+typedef struct {
+	uint32_t sample_rate;					/*!< Sample rate of the microphone in Hz */
+	uint32_t dma_buf_count;					/*!< Number of I2S DMA buffers */
+	uint32_t dma_buf_len;					/*!< Length of one I2S DMA buffer in samples */
+	uint32_t block_size;					/*!< Size of a recorder block in bytes, up to RECORDER_TRANS_BUF_SIZE */
+} sound_recorder_profile_t;
+
+/** @brief	A block of the audio record passed from the sampler to the sender */
+typedef struct {
+	uint32_t seq;							/*!< Sequence number of the block */
+	uint32_t sample_rate;					/*!< Sample rate the block was captured with */
+	int64_t capture_us;						/*!< esp_timer time at which the block was sampled */
+	uint32_t len;							/*!< Number of valid bytes in the data buffer */
+	char data[RECORDER_TRANS_BUF_SIZE];		/*!< Audio samples */
+} sound_recorder_block_t;
+
 /** @brief	I2S sampler state space enumeration */
 typedef enum {
 	SAMPLER_IDLE = 0,
@@ -57,11 +80,17 @@ typedef enum {
 
 /** @brief	A sound recorder related structure */
 typedef struct {
-	int16_t rec_buf[RECORDER_TRANS_BUF_SIZE / 2];	/*!< Buffer used to store data sampled from microphone */
-	char http_buf[RECORDER_TRANS_BUF_SIZE];			/*!< Buffer used to store the next chunk of the
+	sound_recorder_block_t rec_blk;					/*!< Buffer used to store data sampled from microphone */
+	sound_recorder_block_t http_blk;				/*!< Buffer used to store the next chunk of the
 													 * audio record to be sent */
 	wav_header_t wav_hdr;							/*!< The header of a WAV (RIFF) file to be sent */
 	i2s_sampler_state_e state;						/*<! Current sound recorder related state machine state */
+	sound_recorder_profile_t profile;				/*!< Capture profile currently applied to the microphone */
+	sound_recorder_profile_t pending;				/*!< Capture profile to be applied before the next block */
+	BaseType_t is_pending;							/*!< A new capture profile has been requested */
+	portMUX_TYPE lock;								/*!< Spinlock protecting the requested capture profile */
+	BaseType_t is_armed;							/*!< The microphone is sampled while the sampler is idle
+													 * to keep the pre-trigger history */
 	esp_http_client_handle_t http_client;			/*!< HTTP sound sender network connection instance */
 	QueueHandle_t queue;							/*!< Queue for storing chunks of the audio file being sent */
 	SemaphoreHandle_t semphr;						/*!< Binary semaphore used to lock resources associated with
@@ -70,6 +99,12 @@ typedef struct {
 	TaskHandle_t sender_hdl;						/*!< Reference of the audio data sender task */
 } sound_recorder_t;
 
+/* Export constants ----------------------------------------------------------*/
+
+extern const sound_recorder_profile_t recorder_profile_default;		/*!< 16 kHz, 64 ms blocks */
+extern const sound_recorder_profile_t recorder_profile_talkback;	/*!< 16 kHz, 16 ms blocks, shallow DMA for low latency */
+extern const sound_recorder_profile_t recorder_profile_monitor;		/*!< 8 kHz, 128 ms blocks, half the bandwidth */
+
 /* Export functions ----------------------------------------------------------*/
 
 /**
@@ -81,4 +116,52 @@ typedef struct {
  */
 esp_err_t sound_recorder_init(sound_recorder_t *recorder);
 
+/**
+ * @brief		Find a predefined capture profile by its name
+ * @param[in]	name	"default", "talkback" or "monitor"
+ * @return
+ * 				- NULL: There is no profile with such a name
+ * 				- A pointer to the profile
+ */
+const sound_recorder_profile_t *sound_recorder_find_profile(const char *name);
+
+/**
+ * @brief		Request the capture pipeline to be reconfigured. The new profile is applied
+ * 				by the sampling task before it takes the next block
+ * @param[in]	recorder	A pointer to voice recorder instance
+ * @param[in]	profile		A pointer to the requested profile
+ * @return
+ * 				- ESP_ERR_INVALID_ARG: The profile is out of the supported range
+ * 				- ESP_OK: Success, or the profile is already in use
+ */
+esp_err_t sound_recorder_request_profile(sound_recorder_t *recorder, const sound_recorder_profile_t *profile);
+
+/**
+ * @brief		Take the capture profile requested since the last call
+ * @param[in]	recorder	A pointer to voice recorder instance
+ * @param[out]	profile		A pointer to the profile to fill
+ * @return
+ * 				- pdFALSE: No new profile has been requested
+ * 				- pdTRUE: The profile has been filled
+ */
+BaseType_t sound_recorder_take_profile(sound_recorder_t *recorder, sound_recorder_profile_t *profile);
+
+/**
+ * @brief		Update the WAV file header for a new sample rate
+ * @param[in]	recorder	A pointer to voice recorder instance
+ * @param[in]	sample_rate	Sample rate in Hz
+ * @return
+ * 				- None
+ */
+void sound_recorder_set_wav_rate(sound_recorder_t *recorder, uint32_t sample_rate);
+
+/**
+ * @brief		Update the WAV file header for a new length of the samples
+ * @param[in]	recorder	A pointer to voice recorder instance
+ * @param[in]	data_size	Size of the samples in bytes
+ * @return
+ * 				- None
+ */
+void sound_recorder_set_wav_size(sound_recorder_t *recorder, uint32_t data_size);
+
 #endif	/* SOUND_RECORDER_H__ */
@@ -11,6 +11,7 @@
 /* Includes ------------------------------------------------------------------*/
 
 /* STDLIB */
+#include <stdbool.h>
 #include <string.h>
 
 /* Framework */
@@ -27,6 +28,49 @@
 
 static const char *tag = "recorder";
 
+const sound_recorder_profile_t recorder_profile_default = {
+		.sample_rate = RECORDER_SAMPLE_RATE,
+		.dma_buf_count = 4,
+		.dma_buf_len = 1024,
+		.block_size = RECORDER_TRANS_BUF_SIZE,
+};
+
+const sound_recorder_profile_t recorder_profile_talkback = {
+		.sample_rate = 16000,
+		.dma_buf_count = 3,
+		.dma_buf_len = 256,
+		.block_size = 512,
+};
+
+const sound_recorder_profile_t recorder_profile_monitor = {
+		.sample_rate = 8000,
+		.dma_buf_count = 4,
+		.dma_buf_len = 1024,
+		.block_size = RECORDER_TRANS_BUF_SIZE,
+};
+
+static const struct {
+	const char *name;
+	const sound_recorder_profile_t *profile;
+} profile_table[] = {
+		{ "default", &recorder_profile_default },
+		{ "talkback", &recorder_profile_talkback },
+		{ "monitor", &recorder_profile_monitor },
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Check the profile against the limits of the I2S driver and of the recorder blocks. The
+ * DMA buffers come from the internal RAM the network stack needs too */
+static bool _profile_is_valid(const sound_recorder_profile_t *profile) {
+	return	profile->sample_rate >= 8000 && profile->sample_rate <= 48000 &&
+			profile->dma_buf_count >= 2 && profile->dma_buf_count <= 128 &&
+			profile->dma_buf_len >= 8 && profile->dma_buf_len <= 1024 &&
+			profile->dma_buf_count * profile->dma_buf_len * sizeof(int16_t) <= RECORDER_DMA_MAX_SIZE &&
+			profile->block_size >= sizeof(int16_t) && profile->block_size <= RECORDER_TRANS_BUF_SIZE &&
+			profile->block_size % sizeof(int16_t) == 0;
+}
+
 /* Export functions ----------------------------------------------------------*/
 
 /* Initialize a voice recorder instance */
@@ -49,15 +93,18 @@ esp_err_t sound_recorder_init(sound_recorder_t *recorder) {
 		}
 	}
 	xSemaphoreGive(recorder->semphr);
-	/* Create a queue capable of containing RECORDER_QUEUE_SIZE blocks of RECORDER_TRANS_BUF_SIZE bytes */
+	recorder->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+	recorder->profile = recorder_profile_default;
+	recorder->is_pending = pdFALSE;
+	/* Create a queue capable of containing RECORDER_QUEUE_SIZE timestamped blocks of RECORDER_TRANS_BUF_SIZE bytes */
 	if (!recorder->queue) {
-		if ((recorder->queue = xQueueCreate(RECORDER_QUEUE_SIZE, RECORDER_TRANS_BUF_SIZE)) != NULL) {
+		if ((recorder->queue = xQueueCreate(RECORDER_QUEUE_SIZE, sizeof(sound_recorder_block_t))) != NULL) {
 			ESP_LOGI(tag, "The queue was created successfully");
 		} else {
 			ESP_LOGI(tag, "The memory required to hold the queue could not be allocated");
 			while (!recorder->queue) {
 				vTaskDelay(1);
-				if ((recorder->queue = xQueueCreate(RECORDER_QUEUE_SIZE, RECORDER_TRANS_BUF_SIZE)) != NULL) {
+				if ((recorder->queue = xQueueCreate(RECORDER_QUEUE_SIZE, sizeof(sound_recorder_block_t))) != NULL) {
 					ESP_LOGI(tag, "The queue was created successfully");
 				}
 			}
@@ -70,15 +117,67 @@ esp_err_t sound_recorder_init(sound_recorder_t *recorder) {
 	recorder->wav_hdr.Subchunk1Size = 16;
 	recorder->wav_hdr.AudioFormat = 1;
 	recorder->wav_hdr.NumChannels = 1;
-	recorder->wav_hdr.SampleRate = 16000;
 	recorder->wav_hdr.BitsPerSample = 16;
-	recorder->wav_hdr.ByteRate =	recorder->wav_hdr.NumChannels *
-									recorder->wav_hdr.SampleRate *
-									recorder->wav_hdr.BitsPerSample /
-									8;
+	sound_recorder_set_wav_rate(recorder, recorder->profile.sample_rate);
 	recorder->wav_hdr.BlockAlign =	recorder->wav_hdr.NumChannels *
 									recorder->wav_hdr.BitsPerSample /
 									8;
 	strncpy(recorder->wav_hdr.Subchunk2ID, "data", strlen("data"));
 	return ESP_OK;
 }
+
+/* Find a predefined capture profile by its name */
+const sound_recorder_profile_t *sound_recorder_find_profile(const char *name) {
+	if (!name) {
+		return NULL;
+	}
+	for (size_t i = 0; i < sizeof profile_table / sizeof profile_table[0]; ++i) {
+		if (!strcmp(profile_table[i].name, name)) {
+			return profile_table[i].profile;
+		}
+	}
+	return NULL;
+}
+
+/* Request the capture pipeline to be reconfigured */
+esp_err_t sound_recorder_request_profile(sound_recorder_t *recorder, const sound_recorder_profile_t *profile) {
+	if (!_profile_is_valid(profile)) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	portENTER_CRITICAL(&recorder->lock);
+	const sound_recorder_profile_t *last = recorder->is_pending ? &recorder->pending : &recorder->profile;
+	if (memcmp(last, profile, sizeof *profile)) {
+		recorder->pending = *profile;
+		recorder->is_pending = pdTRUE;
+	}
+	portEXIT_CRITICAL(&recorder->lock);
+	return ESP_OK;
+}
+
+/* Take the capture profile requested since the last call */
+BaseType_t sound_recorder_take_profile(sound_recorder_t *recorder, sound_recorder_profile_t *profile) {
+	BaseType_t ret = pdFALSE;
+	portENTER_CRITICAL(&recorder->lock);
+	if (recorder->is_pending) {
+		*profile = recorder->pending;
+		recorder->is_pending = pdFALSE;
+		ret = pdTRUE;
+	}
+	portEXIT_CRITICAL(&recorder->lock);
+	return ret;
+}
+
+/* Update the WAV file header for a new sample rate */
+void sound_recorder_set_wav_rate(sound_recorder_t *recorder, uint32_t sample_rate) {
+	recorder->wav_hdr.SampleRate = sample_rate;
+	recorder->wav_hdr.ByteRate =	recorder->wav_hdr.NumChannels *
+									recorder->wav_hdr.SampleRate *
+									recorder->wav_hdr.BitsPerSample /
+									8;
+}
+
+/* Update the WAV file header for a new length of the samples */
+void sound_recorder_set_wav_size(sound_recorder_t *recorder, uint32_t data_size) {
+	recorder->wav_hdr.ChunkSize = 36 + data_size;
+	recorder->wav_hdr.Subchunk2Size = data_size;
+}
@@ -20,6 +20,10 @@
 
 /* User files */
 #include "app.h"
+#include "app_boot.h"
+#include "app_dns.h"
+#include "app_link.h"
+#include "app_outbox.h"
 
 /* Private constants ---------------------------------------------------------*/
 
@@ -40,10 +44,14 @@ static const char *http_device_radio_req_url =
 static const char *http_device_sound_req_url =
 		"device/sound?id=";
 //		"http://enot.tripfinance.ru/teddyserver-rest/webapis/0.1/device/sound?id=";
+static const char *ws_device_session_req_url =
+		"device/ws";
+//		"wss://enot.tripfinance.ru/teddyserver-rest/webapis/0.1/device/ws";
 
 /* Private variables ---------------------------------------------------------*/
 
 static app_wifi_initializer_t app_init_conditions;
+static BaseType_t is_clearing;	/*!< The connection settings are being deleted */
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -91,6 +99,12 @@ void app_uri_init(app_network_conn_t *arg)
 	
 	strlcpy(arg->uri.sampler, arg->device.server_url, sizeof arg->uri.sampler);
 	strlcat(arg->uri.sampler, (const char *)http_device_radio_req_url, sizeof arg->uri.sampler);
+
+	// Та же адресация, но по схеме ws:// (wss:// для https://)
+	const char *host = strstr(arg->device.server_url, "://");
+	strlcpy(arg->uri.ws, strncmp(arg->device.server_url, "https", 5) ? "ws" : "wss", sizeof arg->uri.ws);
+	strlcat(arg->uri.ws, host ? host : "://", sizeof arg->uri.ws);
+	strlcat(arg->uri.ws, (const char *)ws_device_session_req_url, sizeof arg->uri.ws);
 }
 
 /* Application initialization phase */
@@ -100,16 +114,28 @@ esp_err_t app_init(app_network_conn_t *arg) {
 	/* Attempt to create the MUTEX */
 	arg->spi_flash_mtx = xSemaphoreCreateMutex();
 	xSemaphoreGive(arg->spi_flash_mtx);
+	/* The WiFi driver is started while the file system is mounted */
+	app_init_conditions.app_ptr = arg;
+	xTaskCreatePinnedToCore(&app_wifi_init_task,
+							"wifi_init",
+							12228,
+							&app_init_conditions,
+							4,
+							NULL,
+							0);
+	app_boot_begin(BOOT_STAGE_STORAGE);
 	app_spiffs_init();
 	esp_err_t ret = app_devdesc_init(&arg->device);
+	app_init_conditions.init_state = ret;
+	app_boot_done(BOOT_STAGE_STORAGE);
 	if (ret != ESP_OK) {
 		if (ret != ESP_ERR_NOT_FOUND) {
 			ESP_LOGD(tag, "Failed to initialize device descriptor");
+			app_boot_done(BOOT_STAGE_APP);
 			return ESP_FAIL;
 		}
 	}
-	app_init_conditions.init_state = ret;
-	app_init_conditions.app_ptr = arg;
+	app_boot_begin(BOOT_STAGE_APP);
 	/* Attempt to create the binary semaphore */
 	arg->client.semphr = xSemaphoreCreateBinary();
 	xSemaphoreGive(arg->client.semphr);
@@ -118,6 +144,9 @@ esp_err_t app_init(app_network_conn_t *arg) {
 	/* Media functionalities initialization */
 	sound_player_init(&arg->client.player);
 	sound_recorder_init(&arg->client.sampler);
+	app_arbiter_init(&arg->client.arbiter);
+	app_dns_init();
+	app_link_init();
 	arg->client.led_tracker = pdFALSE;
 
 	/* Set of URIs */
@@ -130,13 +159,16 @@ esp_err_t app_init(app_network_conn_t *arg) {
 			.name = "one-shot",
 	};
 	esp_timer_create(&oneshot_timer_args, &arg->tim);
-	xTaskCreatePinnedToCore(&app_wifi_init_task,
-							"wifi_init",
-							12228,
-							&app_init_conditions,
-							4,
-							NULL,
-							0);
+	app_boot_done(BOOT_STAGE_APP);
+	/* The saved volume and mute take effect before the station is online */
+	app_boot_wait(BOOT_STAGE_BOARD);
+	app_boot_begin(BOOT_STAGE_RESUME);
+	/* The acknowledgements kept before the restart keep their tracks from being resumed */
+	if (app_outbox_init() != ESP_OK) {
+		ESP_LOGE(tag, "Failed to create the outbox");
+	}
+	arg->client.is_resumed = app_client_resume(&arg->client.player, &arg->client.resume_prof) == ESP_OK;
+	app_boot_done(BOOT_STAGE_RESUME);
 	return ESP_OK;
 }
 
@@ -163,9 +195,22 @@ void app_restart_device(void) {
 
 /* Delete connection settings from device memory */
 void app_clear_device_connection_data(void) {
+	/* The login and the profile task may both be refused at once, only the first caller
+	 * deletes the settings, the other one waits for the restart */
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	BaseType_t is_first = !is_clearing;
+	is_clearing = pdTRUE;
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	if (!is_first) {
+		for (;;) {
+			vTaskDelay(portMAX_DELAY);
+		}
+	}
 	app_wifi_sta_detach(&app_instance);
 	esp_wifi_stop();
 	esp_wifi_deinit();
+	/* The mutex is kept until the restart, no other file access comes in between */
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
 	while (app_spiffs_erase_file(wifi_ap_recs_path) != ESP_OK);
 	while (app_devdesc_clear_device_descriptor_data() != ESP_OK);
 	esp_restart();
@@ -0,0 +1,146 @@
+/**
+ * *****************************************************************************
+ * @file		app_arbiter.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Bandwidth arbiter between the track download and the radio upload
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <string.h>
+#include <sys/param.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* User files */
+#include "app_arbiter.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_arbiter";
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Split the capacity between the active flows, called with the lock held */
+static void _update_rates(app_arbiter_t *arbiter) {
+	app_arbiter_bucket_t *down = &arbiter->bucket[ARBITER_DOWNLINK];
+	app_arbiter_bucket_t *up = &arbiter->bucket[ARBITER_UPLINK];
+	if (!down->is_active || !up->is_active) {
+		down->rate = 0;
+		up->rate = 0;
+		return;
+	}
+	uint32_t down_w = 1 + down->need, up_w = 1 + up->need;
+	down->rate = (uint64_t)arbiter->capacity * down_w / (down_w + up_w);
+	/* The real-time rate of a flow comes first, as far as the link has it */
+	if (arbiter->capacity - down->rate < up->min_rate) {
+		down->rate = arbiter->capacity - MIN(up->min_rate, arbiter->capacity);
+	} else if (down->rate < down->min_rate) {
+		down->rate = MIN(down->min_rate, arbiter->capacity - up->min_rate);
+	}
+	up->rate = arbiter->capacity - down->rate;
+}
+
+/* Close the measurement window, called with the lock held. Returns pdTRUE if the window
+ * has been closed while both flows are active */
+static BaseType_t _update_capacity(app_arbiter_t *arbiter, int64_t now) {
+	int64_t elapsed = now - arbiter->window_start;
+	if (elapsed < ARBITER_WINDOW_MS * 1000LL) {
+		return pdFALSE;
+	}
+	BaseType_t is_starved = pdFALSE;
+	for (int i = 0; i < ARBITER_FLOW_COUNT; ++i) {
+		is_starved |= arbiter->bucket[i].is_starved;
+		arbiter->bucket[i].is_starved = pdFALSE;
+	}
+	/* The estimate follows the peaks, as a flow alone on the link may be limited by its
+	 * source rather than by the link. It only decays while no flow is held back, otherwise
+	 * the shares themselves would pull it down */
+	uint32_t rate = arbiter->window_bytes * 1000000LL / elapsed;
+	if (is_starved) {
+		arbiter->capacity = MAX(arbiter->capacity, rate);
+	} else {
+		arbiter->capacity = MAX(rate, arbiter->capacity - arbiter->capacity / 8);
+	}
+	arbiter->capacity = MAX(arbiter->capacity, ARBITER_MIN_CAPACITY);
+	arbiter->window_start = now;
+	arbiter->window_bytes = 0;
+	_update_rates(arbiter);
+	return arbiter->bucket[ARBITER_DOWNLINK].rate ? pdTRUE : pdFALSE;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Initialize the arbiter */
+void app_arbiter_init(app_arbiter_t *arbiter) {
+	memset(arbiter, 0, sizeof *arbiter);
+	arbiter->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+	arbiter->capacity = ARBITER_INIT_CAPACITY;
+	arbiter->window_start = esp_timer_get_time();
+}
+
+/* Report the urgency of a flow */
+void app_arbiter_set_need(app_arbiter_t *arbiter, app_arbiter_flow_e flow, uint32_t need, uint32_t min_rate) {
+	portENTER_CRITICAL(&arbiter->lock);
+	app_arbiter_bucket_t *bucket = &arbiter->bucket[flow];
+	if (!bucket->is_active) {
+		bucket->is_active = pdTRUE;
+		bucket->tokens = 0;
+		bucket->refill_us = esp_timer_get_time();
+	}
+	bucket->need = MIN(need, ARBITER_MAX_NEED);
+	bucket->min_rate = min_rate;
+	_update_rates(arbiter);
+	portEXIT_CRITICAL(&arbiter->lock);
+}
+
+/* Mark a flow inactive */
+void app_arbiter_release(app_arbiter_t *arbiter, app_arbiter_flow_e flow) {
+	portENTER_CRITICAL(&arbiter->lock);
+	arbiter->bucket[flow].is_active = pdFALSE;
+	_update_rates(arbiter);
+	portEXIT_CRITICAL(&arbiter->lock);
+}
+
+/* Take the tokens for a transfer */
+void app_arbiter_acquire(app_arbiter_t *arbiter, app_arbiter_flow_e flow, size_t bytes) {
+	int64_t now = esp_timer_get_time();
+	int64_t wait_us = 0;
+	portENTER_CRITICAL(&arbiter->lock);
+	app_arbiter_bucket_t *bucket = &arbiter->bucket[flow];
+	arbiter->window_bytes += bytes;
+	BaseType_t is_shared = _update_capacity(arbiter, now);
+	uint32_t capacity = arbiter->capacity;
+	uint32_t down_rate = arbiter->bucket[ARBITER_DOWNLINK].rate;
+	if (bucket->rate) {
+		int32_t depth = (uint64_t)bucket->rate * ARBITER_BURST_MS / 1000;
+		bucket->tokens = MIN(bucket->tokens + (now - bucket->refill_us) * bucket->rate / 1000000LL, depth);
+		bucket->refill_us = now;
+		/* The debt is bounded, so a long transfer is not punished for long */
+		bucket->tokens = MAX(bucket->tokens - (int32_t)bytes, -depth);
+		if (bucket->tokens < 0) {
+			/* The transfer is paid in advance, the pause evens the debt out */
+			wait_us = MIN(-bucket->tokens * 1000000LL / bucket->rate, ARBITER_MAX_WAIT_MS * 1000LL);
+			bucket->is_starved = pdTRUE;
+		}
+	} else {
+		bucket->tokens = 0;
+		bucket->refill_us = now;
+	}
+	portEXIT_CRITICAL(&arbiter->lock);
+	if (is_shared) {
+		ESP_LOGD(tag, "Link %u B/s, download %u B/s, upload %u B/s", capacity, down_rate, capacity - down_rate);
+	}
+	if (wait_us) {
+		ESP_LOGV(tag, "Flow %d paused for %lld us", flow, (long long)wait_us);
+		vTaskDelay(MAX(pdMS_TO_TICKS(wait_us / 1000), 1));
+	}
+}
@@ -0,0 +1,256 @@
+/**
+ * *****************************************************************************
+ * @file		app_backlog.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Store-and-forward buffer for the audio record captured while the
+ * 				uplink is not available
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Framework */
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+
+/* User files */
+#include "app.h"
+#include "app_backlog.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+const char *backlog_spill_path = "/spiffs/rec_backlog.bin";
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_backlog";
+
+#define BACKLOG_HDR_SIZE	offsetof(sound_recorder_block_t, data)	/* Block header kept in the ring */
+#define BACKLOG_ALIGN		4
+#define BACKLOG_WRAP		UINT32_MAX	/* Length that marks the end of the ring as skipped */
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Forget the contents of the spill file */
+static void _spill_reset(app_backlog_t *backlog) {
+	if (backlog->flash_wr) {
+		app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+		remove(backlog_spill_path);
+		app_semaphore_give(app_instance.spi_flash_mtx);
+	}
+	backlog->flash_rd = 0;
+	backlog->flash_wr = 0;
+}
+
+/* Append a block to the spill file */
+static esp_err_t _spill_write(app_backlog_t *backlog, const sound_recorder_block_t *blk) {
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *f = fopen(backlog_spill_path, "ab");
+	if (f == NULL) {
+		app_semaphore_give(app_instance.spi_flash_mtx);
+		return ESP_FAIL;
+	}
+	size_t n = fwrite(blk, sizeof *blk, 1, f);
+	fclose(f);
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	if (n != 1) {
+		return ESP_FAIL;
+	}
+	++backlog->flash_wr;
+	return ESP_OK;
+}
+
+/* Read a block of the spill file */
+static esp_err_t _spill_read(uint32_t idx, sound_recorder_block_t *blk) {
+	esp_err_t ret = ESP_FAIL;
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *f = fopen(backlog_spill_path, "rb");
+	if (f != NULL) {
+		if (	fseek(f, (long)idx * sizeof *blk, SEEK_SET) == 0 &&
+				fread(blk, sizeof *blk, 1, f) == 1) {
+			ret = ESP_OK;
+		}
+		fclose(f);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return ret;
+}
+
+/* Bytes a block takes in the RAM ring */
+static size_t _ram_rec_size(uint32_t len) {
+	return (BACKLOG_HDR_SIZE + len + BACKLOG_ALIGN - 1) & ~(size_t)(BACKLOG_ALIGN - 1);
+}
+
+/* Length of the samples of the block at an offset of the RAM ring */
+static uint32_t _ram_rec_len(const app_backlog_t *backlog, size_t offset) {
+	uint32_t len;
+	if (backlog->ram_cap - offset < BACKLOG_HDR_SIZE) {
+		return BACKLOG_WRAP;
+	}
+	memcpy(&len, backlog->ring + offset + offsetof(sound_recorder_block_t, len), sizeof len);
+	return len;
+}
+
+/* Copy the oldest block of the RAM ring */
+static void _ram_peek(const app_backlog_t *backlog, sound_recorder_block_t *blk) {
+	memcpy(blk, backlog->ring + backlog->head, BACKLOG_HDR_SIZE);
+	memcpy(blk->data, backlog->ring + backlog->head + BACKLOG_HDR_SIZE, blk->len);
+}
+
+/* Remove the oldest block of the RAM ring */
+static void _ram_pop(app_backlog_t *backlog) {
+	size_t rec_size = _ram_rec_size(_ram_rec_len(backlog, backlog->head));
+	backlog->head += rec_size;
+	backlog->used -= rec_size;
+	if (!--backlog->ram_cnt) {
+		backlog->head = 0;
+		backlog->tail = 0;
+		backlog->used = 0;
+		return;
+	}
+	if (_ram_rec_len(backlog, backlog->head) == BACKLOG_WRAP) {
+		/* The next block has been written from the start of the ring */
+		backlog->used -= backlog->ram_cap - backlog->head;
+		backlog->head = 0;
+	}
+}
+
+/* Bytes the next block takes in the RAM ring, the end of the ring skipped included */
+static size_t _ram_need(const app_backlog_t *backlog, size_t rec_size) {
+	if (backlog->ram_cap - backlog->tail >= rec_size) {
+		return rec_size;
+	}
+	return backlog->ram_cap - backlog->tail + rec_size;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Allocate the backlog */
+esp_err_t app_backlog_init(app_backlog_t *backlog, size_t ram_bytes, size_t flash_blocks) {
+	memset(backlog, 0, sizeof *backlog);
+	backlog->flash_cap = flash_blocks;
+	/* PSRAM first, the internal memory is too valuable for this */
+	backlog->ring = heap_caps_malloc(ram_bytes, MALLOC_CAP_SPIRAM);
+	if (flash_blocks) {
+		backlog->spill = heap_caps_malloc(sizeof *backlog->spill, MALLOC_CAP_SPIRAM);
+	}
+	if (!backlog->ring || (flash_blocks && !backlog->spill)) {
+		free(backlog->ring);
+		free(backlog->spill);
+		memset(backlog, 0, sizeof *backlog);
+		ESP_LOGW(tag, "Failed to allocate %u bytes in PSRAM", ram_bytes);
+		return ESP_ERR_NO_MEM;
+	}
+	backlog->ram_cap = ram_bytes;
+	backlog->ram_limit = ram_bytes;
+	/* Blocks left from the previous session have no valid timestamps */
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	remove(backlog_spill_path);
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	ESP_LOGI(tag, "Backlog capacity: %u bytes in PSRAM, %u blocks in flash", ram_bytes, flash_blocks);
+	return ESP_OK;
+}
+
+/* Get the RAM the blocks of a given size take in the backlog */
+size_t app_backlog_ram_size(size_t blocks, size_t block_size) {
+	return blocks * _ram_rec_size(block_size);
+}
+
+/* Limit the RAM part of the backlog */
+void app_backlog_set_limit(app_backlog_t *backlog, size_t ram_bytes) {
+	backlog->ram_limit = ram_bytes < backlog->ram_cap ? ram_bytes : backlog->ram_cap;
+}
+
+/* Append a block to the backlog */
+esp_err_t app_backlog_push(app_backlog_t *backlog, const sound_recorder_block_t *blk) {
+	size_t rec_size = _ram_rec_size(blk->len);
+	if (rec_size > backlog->ram_limit) {
+		++backlog->dropped;
+		return ESP_ERR_NO_MEM;
+	}
+	while (backlog->used + _ram_need(backlog, rec_size) > backlog->ram_limit) {
+		/* The spill file is only appended to, so once its quota is used up it is
+		 * dropped as a whole. What remains stays contiguous in time */
+		if (backlog->flash_cap && backlog->flash_wr >= backlog->flash_cap) {
+			backlog->dropped += backlog->flash_wr - backlog->flash_rd;
+			_spill_reset(backlog);
+		}
+		if (backlog->flash_cap) {
+			_ram_peek(backlog, backlog->spill);
+		}
+		if (	backlog->flash_cap == 0 ||
+				_spill_write(backlog, backlog->spill) != ESP_OK) {
+			++backlog->dropped;
+		}
+		_ram_pop(backlog);
+	}
+	if (backlog->ram_cap - backlog->tail < rec_size) {
+		/* Blocks are kept contiguous, the end of the ring is skipped */
+		if (backlog->ram_cap - backlog->tail >= BACKLOG_HDR_SIZE) {
+			uint32_t wrap = BACKLOG_WRAP;
+			memcpy(	backlog->ring + backlog->tail + offsetof(sound_recorder_block_t, len),
+					&wrap,
+					sizeof wrap);
+		}
+		backlog->used += backlog->ram_cap - backlog->tail;
+		backlog->tail = 0;
+	}
+	memcpy(backlog->ring + backlog->tail, blk, BACKLOG_HDR_SIZE + blk->len);
+	backlog->tail += rec_size;
+	backlog->used += rec_size;
+	++backlog->ram_cnt;
+	return ESP_OK;
+}
+
+/* Copy the oldest block of the backlog without removing it */
+esp_err_t app_backlog_peek(app_backlog_t *backlog, sound_recorder_block_t *blk) {
+	if (backlog->flash_rd < backlog->flash_wr) {
+		return _spill_read(backlog->flash_rd, blk);
+	}
+	if (!backlog->ram_cnt) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	_ram_peek(backlog, blk);
+	return ESP_OK;
+}
+
+/* Remove the oldest block of the backlog */
+void app_backlog_pop(app_backlog_t *backlog) {
+	if (backlog->flash_rd < backlog->flash_wr) {
+		if (++backlog->flash_rd == backlog->flash_wr) {
+			_spill_reset(backlog);
+		}
+	} else if (backlog->ram_cnt) {
+		_ram_pop(backlog);
+	}
+}
+
+/* Get the number of blocks kept in the backlog */
+size_t app_backlog_count(const app_backlog_t *backlog) {
+	return backlog->ram_cnt + (backlog->flash_wr - backlog->flash_rd);
+}
+
+/* Drop the oldest blocks so that no more than max_blocks are kept */
+void app_backlog_trim(app_backlog_t *backlog, size_t max_blocks) {
+	while (app_backlog_count(backlog) > max_blocks) {
+		app_backlog_pop(backlog);
+	}
+}
+
+/* Drop all blocks of the backlog */
+void app_backlog_clear(app_backlog_t *backlog) {
+	_spill_reset(backlog);
+	backlog->head = 0;
+	backlog->tail = 0;
+	backlog->used = 0;
+	backlog->ram_cnt = 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * *****************************************************************************
+ * @file		app_boot.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Boot stages, their dependencies and timing
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* User files */
+#include "app_boot.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_boot";
+
+static const char *stage_names[BOOT_STAGE_COUNT] = {
+		"nvs",
+		"board",
+		"radio",
+		"storage",
+		"app",
+		"resume",
+		"join",
+		"login",
+		"profile",
+};
+
+#define BOOT_STAGE_BIT(stage)	(1UL << (stage))
+
+/* Private variables ---------------------------------------------------------*/
+
+static EventGroupHandle_t boot_events;
+static int64_t begin_time[BOOT_STAGE_COUNT];
+static int64_t done_time[BOOT_STAGE_COUNT];
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Log the timing of the stages. The times are counted from the start of the application */
+static void _report(void) {
+	int64_t serial_ms = 0;
+	for (int i = 0; i < BOOT_STAGE_COUNT; ++i) {
+		if (!done_time[i]) {
+			continue;
+		}
+		ESP_LOGI(	tag,
+					"%-8s %6lld .. %6lld ms",
+					stage_names[i],
+					begin_time[i] / 1000,
+					done_time[i] / 1000);
+		serial_ms += (done_time[i] - begin_time[i]) / 1000;
+	}
+	ESP_LOGI(	tag,
+				"First profile at %lld ms, the stages take %lld ms one after another",
+				done_time[BOOT_STAGE_PROFILE] / 1000,
+				serial_ms);
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Create the stage signals */
+void app_boot_init(void) {
+	boot_events = xEventGroupCreate();
+}
+
+/* Note the start of a stage */
+void app_boot_begin(app_boot_stage_e stage) {
+	if (!begin_time[stage]) {
+		begin_time[stage] = esp_timer_get_time();
+	}
+}
+
+/* Note the end of a stage */
+void app_boot_done(app_boot_stage_e stage) {
+	if (xEventGroupGetBits(boot_events) & BOOT_STAGE_BIT(stage)) {
+		return;
+	}
+	done_time[stage] = esp_timer_get_time();
+	if (!begin_time[stage]) {
+		begin_time[stage] = done_time[stage];
+	}
+	xEventGroupSetBits(boot_events, BOOT_STAGE_BIT(stage));
+	ESP_LOGD(	tag,
+				"Stage %s done at %lld ms in %lld ms",
+				stage_names[stage],
+				done_time[stage] / 1000,
+				(done_time[stage] - begin_time[stage]) / 1000);
+	if (stage == BOOT_STAGE_PROFILE) {
+		_report();
+	}
+}
+
+/* Wait for the end of a stage */
+void app_boot_wait(app_boot_stage_e stage) {
+	xEventGroupWaitBits(boot_events, BOOT_STAGE_BIT(stage), pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+/* Wait for the end of a stage for a limited time */
+esp_err_t app_boot_wait_ms(app_boot_stage_e stage, uint32_t timeout_ms) {
+	EventBits_t bits = xEventGroupWaitBits(	boot_events,
+											BOOT_STAGE_BIT(stage),
+											pdFALSE,
+											pdTRUE,
+											pdMS_TO_TICKS(timeout_ms));
+	return bits & BOOT_STAGE_BIT(stage) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
@@ -0,0 +1,151 @@
+/**
+ * *****************************************************************************
+ * @file		app_cbor.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Minimal CBOR (RFC 8949) reader for the work server responses
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <math.h>
+#include <string.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "app_cbor.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Skip an item, nested items are limited by the depth */
+static esp_err_t _skip(app_cbor_reader_t *reader, const app_cbor_item_t *item, int depth) {
+	uint64_t cnt = 0;
+	switch (item->major) {
+	case APP_CBOR_BYTES:
+	case APP_CBOR_TEXT:
+		if (item->arg > (uint64_t)(reader->end - reader->pos)) {
+			return ESP_FAIL;
+		}
+		reader->pos += item->arg;
+		return ESP_OK;
+	case APP_CBOR_ARRAY:
+		cnt = item->arg;
+		break;
+	case APP_CBOR_MAP:
+		cnt = item->arg * 2;
+		break;
+	case APP_CBOR_TAG:
+		cnt = 1;
+		break;
+	default:
+		return ESP_OK;
+	}
+	/* Every item takes at least a byte, a larger count cannot be valid */
+	if (cnt > (uint64_t)(reader->end - reader->pos)) {
+		return ESP_FAIL;
+	}
+	if (depth >= APP_CBOR_MAX_DEPTH) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	while (cnt--) {
+		app_cbor_item_t sub;
+		esp_err_t ret = app_cbor_read_head(reader, &sub);
+		if (ret == ESP_OK) {
+			ret = _skip(reader, &sub, depth + 1);
+		}
+		if (ret != ESP_OK) {
+			return ret;
+		}
+	}
+	return ESP_OK;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Start reading a document */
+void app_cbor_init(app_cbor_reader_t *reader, const void *data, size_t len) {
+	reader->pos = (const uint8_t *)data;
+	reader->end = reader->pos + len;
+}
+
+/* Read the head of the next data item */
+esp_err_t app_cbor_read_head(app_cbor_reader_t *reader, app_cbor_item_t *item) {
+	if (reader->pos >= reader->end) {
+		return ESP_FAIL;
+	}
+	uint8_t ib = *reader->pos++;
+	item->major = (app_cbor_major_e)(ib >> 5);
+	item->info = ib & 0x1F;
+	if (item->info < 24) {
+		item->arg = item->info;
+		return ESP_OK;
+	}
+	if (item->info > 27) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	size_t len = 1U << (item->info - 24);
+	if (len > (size_t)(reader->end - reader->pos)) {
+		return ESP_FAIL;
+	}
+	item->arg = 0;
+	while (len--) {
+		item->arg = (item->arg << 8) | *reader->pos++;
+	}
+	return ESP_OK;
+}
+
+/* Take the content of a string whose head has just been read */
+esp_err_t app_cbor_read_string(app_cbor_reader_t *reader, const app_cbor_item_t *item, const char **str) {
+	if (item->major != APP_CBOR_BYTES && item->major != APP_CBOR_TEXT) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	*str = (const char *)reader->pos;
+	return _skip(reader, item, 0);
+}
+
+/* Skip the content of an item whose head has just been read */
+esp_err_t app_cbor_skip(app_cbor_reader_t *reader, const app_cbor_item_t *item) {
+	return _skip(reader, item, 0);
+}
+
+/* Get the numeric value of an integer or a float item */
+bool app_cbor_get_number(const app_cbor_item_t *item, double *value) {
+	if (item->major == APP_CBOR_UINT) {
+		*value = (double)item->arg;
+		return true;
+	}
+	if (item->major == APP_CBOR_NEGINT) {
+		*value = -1.0 - (double)item->arg;
+		return true;
+	}
+	if (item->major != APP_CBOR_SIMPLE) {
+		return false;
+	}
+	if (item->info == 25) {
+		/* Half precision has no C type, the exponent is applied by hand */
+		int exp = (item->arg >> 10) & 0x1F;
+		double mant = item->arg & 0x3FF;
+		if (exp == 0x1F) {
+			return false;
+		}
+		*value = exp ? ldexp(mant + 1024, exp - 25) : ldexp(mant, -24);
+		if (item->arg & 0x8000) {
+			*value = -*value;
+		}
+	} else if (item->info == 26) {
+		uint32_t bits = (uint32_t)item->arg;
+		float f;
+		memcpy(&f, &bits, sizeof f);
+		*value = f;
+	} else if (item->info == 27) {
+		memcpy(value, &item->arg, sizeof *value);
+	} else {
+		return false;
+	}
+	return isfinite(*value);
+}
@@ -0,0 +1,158 @@
+/**
+ * *****************************************************************************
+ * @file		app_chunked.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		HTTP/1.1 chunked transfer encoding writer used by streaming uploads
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_http_client.h>
+#include <esp_timer.h>
+
+/* User files */
+#include "app_chunked.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Write the whole buffer, the transport may accept only a part of it at once */
+static esp_err_t _write_all(esp_http_client_handle_t http, const char *data, int len) {
+	while (len > 0) {
+		int ret = esp_http_client_write(http, data, len);
+		if (ret <= 0) {
+			return ESP_FAIL;
+		}
+		data += ret;
+		len -= ret;
+	}
+	return ESP_OK;
+}
+
+/* Frame the aggregated payload and send it, optionally followed by the last-chunk */
+static esp_err_t _send(app_chunked_writer_t *writer, bool is_last) {
+	char *payload = writer->buf + CHUNKED_HEAD_ROOM;
+	char *start = payload;
+	size_t tail = 0;
+	if (writer->len) {
+		char size_line[CHUNKED_HEAD_ROOM + 1];
+		int n = snprintf(size_line, sizeof size_line, "%x\r\n", (unsigned int)writer->len);
+		start = payload - n;
+		memcpy(start, size_line, n);
+		memcpy(payload + writer->len, "\r\n", 2);
+		tail = 2;
+	}
+	if (is_last) {
+		memcpy(payload + writer->len + tail, "0\r\n\r\n", 5);
+		tail += 5;
+	}
+	int total = (payload - start) + writer->len + tail;
+	writer->len = 0;
+	if (total == 0) {
+		return ESP_OK;
+	}
+	return _write_all(writer->http, start, total);
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Allocate the chunk buffer of the writer */
+esp_err_t app_chunked_init(app_chunked_writer_t *writer, size_t cap, uint32_t latency_ms) {
+	if (!writer || !cap) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(writer, 0, sizeof *writer);
+	writer->buf = heap_caps_malloc(CHUNKED_HEAD_ROOM + cap + CHUNKED_TAIL_ROOM, MALLOC_CAP_8BIT);
+	if (!writer->buf) {
+		return ESP_ERR_NO_MEM;
+	}
+	writer->cap = cap;
+	writer->latency = (int64_t)latency_ms * 1000;
+	return ESP_OK;
+}
+
+/* Release the chunk buffer of the writer */
+void app_chunked_deinit(app_chunked_writer_t *writer) {
+	heap_caps_free(writer->buf);
+	writer->buf = NULL;
+	writer->cap = 0;
+	writer->len = 0;
+}
+
+/* Bind the writer to an opened HTTP connection and drop any aggregated data */
+void app_chunked_attach(app_chunked_writer_t *writer, esp_http_client_handle_t http) {
+	writer->http = http;
+	writer->len = 0;
+}
+
+/* Append data to the current chunk */
+int app_chunked_write(app_chunked_writer_t *writer, const void *data, size_t len) {
+	const char *src = (const char *)data;
+	size_t left = len;
+	while (left > 0) {
+		if (writer->len == 0) {
+			writer->deadline = esp_timer_get_time() + writer->latency;
+		}
+		size_t n = writer->cap - writer->len;
+		if (n > left) {
+			n = left;
+		}
+		memcpy(writer->buf + CHUNKED_HEAD_ROOM + writer->len, src, n);
+		writer->len += n;
+		src += n;
+		left -= n;
+		if (writer->len == writer->cap || writer->latency == 0) {
+			if (_send(writer, false) != ESP_OK) {
+				return ESP_FAIL;
+			}
+		}
+	}
+	if (app_chunked_poll(writer) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	return (int)len;
+}
+
+/* Send the aggregated data if the aggregation latency has expired */
+esp_err_t app_chunked_poll(app_chunked_writer_t *writer) {
+	if (writer->len && esp_timer_get_time() >= writer->deadline) {
+		return _send(writer, false);
+	}
+	return ESP_OK;
+}
+
+/* Send the aggregated data as a chunk right away */
+esp_err_t app_chunked_flush(app_chunked_writer_t *writer) {
+	return _send(writer, false);
+}
+
+/* Send the aggregated data together with the last-chunk */
+esp_err_t app_chunked_finish(app_chunked_writer_t *writer) {
+	return _send(writer, true);
+}
+
+/* Get the time it is possible to wait for new data */
+TickType_t app_chunked_wait_ticks(app_chunked_writer_t *writer, TickType_t max_ticks) {
+	if (!writer->len) {
+		return max_ticks;
+	}
+	int64_t left = writer->deadline - esp_timer_get_time();
+	if (left <= 0) {
+		return 0;
+	}
+	/* Rounded up, a wait of 0 in the last tick would spin until the deadline */
+	TickType_t ticks = pdMS_TO_TICKS((left + 999) / 1000);
+	ticks = ticks ? ticks : 1;
+	return ticks < max_ticks ? ticks : max_ticks;
+}
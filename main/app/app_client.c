@@ -14,6 +14,7 @@
 
 /* STDLIB */
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/param.h>
 
@@ -26,11 +27,23 @@
 #include <esp_heap_caps.h>
 #include <esp_http_client.h>
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
 #include <cJSON.h>
 
 /* User files */
 #include "app.h"
+#include "app_arbiter.h"
+#include "app_backlog.h"
+#include "app_boot.h"
+#include "app_chunked.h"
 #include "app_client.h"
+#include "app_dns.h"
+#include "app_link.h"
+#include "app_outbox.h"
+#include "app_resume.h"
+#include "app_retry.h"
 #include "app_update.h"
 #include "board_def.h"
 #include "mp45dt02.h"
@@ -40,6 +53,28 @@
 
 static const char *tag = "app_client";
 
+/* Retries of the end-of-reproduction request, given up on a disconnect */
+static const app_retry_policy_t delete_retry_policy = {
+		.base_ms = CLIENT_DELETE_RETRY_BASE_MS,
+		.max_ms = CLIENT_DELETE_RETRY_MAX_MS,
+		.deadline_ms = CLIENT_DELETE_RETRY_DEADLINE_MS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
+
+/* Retries of the failed profile requests, a disconnect hands over to the reconnect */
+static const app_retry_policy_t profile_retry_policy = {
+		.base_ms = CLIENT_PROFILE_RETRY_BASE_MS,
+		.max_ms = CLIENT_PROFILE_RETRY_MAX_MS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
+
+/* Retries of the recorder upload */
+static const app_retry_policy_t sampler_retry_policy = {
+		.base_ms = SAMPLER_RETRY_PERIOD_MS,
+		.max_ms = SAMPLER_RETRY_MAX_MS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
+
 /* Private functions ---------------------------------------------------------*/
 
 /* Dummy HTTP client event handler */
@@ -47,13 +82,334 @@ static esp_err_t _http_client_event_handler(esp_http_client_event_t *evt) {
 	return ESP_OK;
 }
 
-/* Export functions ----------------------------------------------------------*/
+#if CLIENT_PROFILE_LONG_POLL
+/* Switch the profile requests between the long-poll and the periodic modes */
+static void _profile_set_long_poll(app_client_poll_t *poll, BaseType_t is_long) {
+	poll->is_long = is_long;
+	if (!is_long) {
+		poll->probe_time = esp_timer_get_time() + CLIENT_LONG_POLL_PROBE_PERIOD_MS * 1000LL;
+	}
+}
+#endif	/* CLIENT_PROFILE_LONG_POLL */
 
-/* Execute the end-of-reproduction request */
-void app_client_delete_track(sound_player_t *player) {
+#if CLIENT_POLL_ADAPTIVE
+/* Keep the modem sleep on only while no audio is streamed */
+static void _poll_set_power_save(app_client_poll_t *poll, BaseType_t is_on) {
+	if (poll->is_ps_set && poll->is_ps_on == is_on) {
+		return;
+	}
+	if (esp_wifi_set_ps(is_on ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE) == ESP_OK) {
+		ESP_LOGD(tag, "Modem sleep %s", is_on ? "enabled" : "disabled");
+		poll->is_ps_set = pdTRUE;
+		poll->is_ps_on = is_on;
+	}
+}
+
+/* Get the delay before the next periodic profile request */
+static TickType_t _poll_next_delay(app_client_func_t *client, BaseType_t is_changed) {
+	app_client_poll_t *poll = &client->poll;
+	int64_t now = esp_timer_get_time();
+	BaseType_t is_active = client->player.state != GETTER_IDLE || client->sampler.state != SAMPLER_IDLE;
+	if (is_active || is_changed) {
+		poll->fast_until = now + CLIENT_POLL_HOLD_MS * 1000LL;
+	}
+	if (now < poll->fast_until || !poll->period_ms) {
+		poll->period_ms = CLIENT_POLL_FAST_MS;
+	} else {
+		poll->period_ms = MIN(poll->period_ms * 2, CLIENT_POLL_IDLE_MAX_MS);
+	}
+	if (is_active && client->link_level == LINK_POOR) {
+		/* A poor link leaves its air time to the audio */
+		poll->period_ms = MAX(poll->period_ms, CLIENT_POLL_POOR_MS);
+	}
+	_poll_set_power_save(poll, !is_active);
+	/* The jitter keeps the devices restarted at once from polling in step */
+	int32_t jitter = poll->period_ms * CLIENT_POLL_JITTER_PCT / 100;
+	return pdMS_TO_TICKS(poll->period_ms - jitter + esp_random() % (2 * jitter + 1));
+}
+#endif	/* CLIENT_POLL_ADAPTIVE */
+
+/* Account a profile request in the statistics of the profile loop */
+static void _profile_stats(app_client_poll_t *poll, BaseType_t is_unchanged, int64_t busy_us) {
+	++poll->req_cnt;
+	poll->unchanged_cnt += is_unchanged ? 1 : 0;
+	poll->busy_us += busy_us;
+	if (poll->req_cnt >= CLIENT_PROFILE_STATS_PERIOD) {
+		ESP_LOGI(	tag,
+					"Profile loop: %u requests, %u unchanged, %lld us per iteration",
+					poll->req_cnt,
+					poll->unchanged_cnt,
+					(long long)(poll->busy_us / poll->req_cnt));
+		if (poll->parsed_cnt) {
+			ESP_LOGI(	tag,
+						"Profile decoding: %u parsed (%u CBOR), %u bytes and %lld us per profile",
+						poll->parsed_cnt,
+						poll->cbor_cnt,
+						poll->rx_bytes / poll->parsed_cnt,
+						(long long)(poll->decode_us / poll->parsed_cnt));
+		}
+		app_http_conn_stats_t conn;
+		app_http_conn_take_stats(&conn);
+		if (conn.new_cnt) {
+			ESP_LOGI(	tag,
+						"Connections: %u reused, %u new (%u dropped by the server), %lld us per connect and handshake",
+						conn.reused_cnt,
+						conn.new_cnt,
+						conn.stale_cnt,
+						(long long)(conn.connect_us / conn.new_cnt));
+		} else {
+			ESP_LOGI(tag, "Connections: %u reused, none new", conn.reused_cnt);
+		}
+		poll->req_cnt = 0;
+		poll->unchanged_cnt = 0;
+		poll->busy_us = 0;
+		poll->parsed_cnt = 0;
+		poll->cbor_cnt = 0;
+		poll->rx_bytes = 0;
+		poll->decode_us = 0;
+	}
+}
+
+/* Apply the device profile to the media tasks */
+static void _apply_profile(app_client_func_t *client, app_client_profile_t *profile) {
+	xSemaphoreTake(client->player.semphr, portMAX_DELAY);
+	app_client_set_player_state(&client->player, profile);
+	xSemaphoreGive(client->player.semphr);
+	xSemaphoreTake(client->sampler.semphr, portMAX_DELAY);
+	app_client_set_sampler_state(&client->sampler, profile);
+	xSemaphoreGive(client->sampler.semphr);
+#if BOARD_USER_LED_FEATURE
+	if ((	(client->player.state == GETTER_ACTIVE || client->player.state == GETTER_STOP_AT_THE_END) ||
+			(client->sampler.state == SAMPLER_ACTIVE)) &&
+			!client->led_tracker) {
+		gpio_set_level(PIN_NUM_USER_LED, 1);
+		client->led_tracker = pdTRUE;
+	} else if (((client->player.state != GETTER_ACTIVE) &&
+				(client->sampler.state != SAMPLER_ACTIVE)) &&
+				client->led_tracker) {
+		gpio_set_level(PIN_NUM_USER_LED, 0);
+		client->led_tracker = pdFALSE;
+	}
+#endif	/* BOARD_USER_LED_FEATURE */
+}
+
+#if CLIENT_WS_TRANSPORT
+/* Handle a profile pushed by the server over the WebSocket session */
+static void _ws_on_text(void *arg, const char *text, size_t len) {
+	app_client_func_t *client = (app_client_func_t *)arg;
+	app_client_profile_t profile = { 0 };
+	if (app_client_parse_profile(&profile, text) != ESP_OK) {
+		ESP_LOGW(tag, "Unexpected WebSocket message: %.*s", (int)len, text);
+		return;
+	}
+	xSemaphoreTake(client->semphr, portMAX_DELAY);
+	_apply_profile(client, &profile);
+	xSemaphoreGive(client->semphr);
+}
+
+/* Acknowledge the end of reproduction over the WebSocket session */
+static esp_err_t _ws_ack_track(const uuid_t *track_id) {
+	char id[UUID_NULL_TERM_STRING_LEN];
+	char msg[UUID_NULL_TERM_STRING_LEN + 32];
+	if (uuid_to_string(track_id, id, sizeof id) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	snprintf(msg, sizeof msg, "{\"type\":\"trackDone\",\"id\":\"%s\"}", id);
+	return app_ws_send_text(&app_instance.client.ws, msg);
+}
+#endif	/* CLIENT_WS_TRANSPORT */
+
+/* Position of the player in its track, 0 if nothing is being played */
+static uint32_t _player_position(const sound_player_t *player) {
+	switch (player->state) {
+	case GETTER_BUFFERING:
+	case GETTER_ACTIVE:
+	case GETTER_PAUSE:
+	case GETTER_STOP_AT_THE_END:
+		return player->play_pos;
+	default:
+		return 0;
+	}
+}
+
+/* Keep the level of the link for the media tasks and the profile requests */
+static void _on_link_health(const app_link_health_t *health, void *arg) {
+	app_client_func_t *client = (app_client_func_t *)arg;
+	client->link_level = health->level;
+}
+
+/* Queue level the player buffers up to before it plays, the poorer the link the longer
+ * the cushion against its stalls. The underrun is the fixed PLAYER_BUF_LOW_MSG */
+static UBaseType_t _player_buf_target(void) {
+	switch (app_instance.client.link_level) {
+	case LINK_GOOD:
+		return PLAYER_BUF_GOOD_MSG;
+	case LINK_POOR:
+		return PLAYER_BUF_POOR_MSG;
+	default:
+		return PLAYER_BUF_CAP_MSG;
+	}
+}
+
+/* Account a read of the player in the link statistics. The getter waits for the network
+ * unless the queue is full or the player is paused */
+static void _player_account(sound_player_t *player, int ret) {
+	if (ret == ESP_FAIL) {
+		app_link_note_failure();
+	} else if (ret > 0) {
+		app_link_note_bytes(ret, player->state != GETTER_PAUSE && uxQueueSpacesAvailable(player->queue) > 0);
+	}
+}
+
+/* Time of the next upload attempt, a poor link is given more time to recover */
+static int64_t _sampler_retry_time(app_retry_t *retry) {
+	int64_t retry_time = app_retry_schedule(retry);
+	if (app_instance.client.link_level == LINK_POOR) {
+		retry_time = MAX(retry_time, esp_timer_get_time() + SAMPLER_RETRY_POOR_MS * 1000LL);
+	}
+	return retry_time;
+}
+
+/* Number of the blocks of a capture profile that hold the audio of the given duration */
+static size_t _sampler_blocks(const sound_recorder_profile_t *profile, uint32_t seconds) {
+	return seconds * profile->sample_rate * sizeof(int16_t) / profile->block_size;
+}
+
+/* Append a block to the backlog, limited to SAMPLER_BACKLOG_SECONDS of the block format */
+static void _sampler_backlog_push(app_backlog_t *backlog, const sound_recorder_block_t *blk) {
+	if (blk->len) {
+		size_t blocks = SAMPLER_BACKLOG_SECONDS * blk->sample_rate * sizeof(int16_t) / blk->len;
+		app_backlog_set_limit(backlog, app_backlog_ram_size(blocks, blk->len));
+	}
+	app_backlog_push(backlog, blk);
+}
+
+/* Move the blocks captured so far from the recorder queue to the backlog */
+static void _sampler_stash_queue(sound_recorder_t *sampler, app_backlog_t *backlog) {
+	while (xQueueReceive(sampler->queue, &sampler->http_blk, 0) == pdTRUE) {
+		_sampler_backlog_push(backlog, &sampler->http_blk);
+	}
+}
+
+#if CLIENT_BANDWIDTH_ARBITER
+/* Report the player queue level to the arbiter and take the tokens of the next read.
+ * Called without the player lock, the wait must not hold up the state changes */
+static void _player_acquire(sound_player_t *player, http_sound_getter_state_e state, BaseType_t is_data_read) {
+	if (	is_data_read ||
+			(state != GETTER_BUFFERING && state != GETTER_ACTIVE && state != GETTER_PAUSE) ||
+			(state == GETTER_PAUSE && !uxQueueSpacesAvailable(player->queue))) {
+		/* No read is coming */
+		return;
+	}
+	uint32_t need = ARBITER_MAX_NEED;
+	if (state != GETTER_BUFFERING) {
+		/* The emptier the queue, the closer the decoder is to an underrun */
+		need = ARBITER_MAX_NEED * uxQueueSpacesAvailable(player->queue) / PLAYER_QUEUE_SIZE;
+	}
+	app_arbiter_set_need(&app_instance.client.arbiter, ARBITER_DOWNLINK, need, 0);
+	app_arbiter_acquire(&app_instance.client.arbiter, ARBITER_DOWNLINK, PLAYER_RECV_BUF_SIZE);
+}
+
+/* Report the recorder backlog to the arbiter and take the tokens of the next block */
+static void _sampler_acquire(sound_recorder_t *sampler, app_backlog_t *backlog, size_t len) {
+	/* A live stream needs its real-time rate, a growing backlog needs more on top of it */
+	size_t full = MAX(_sampler_blocks(&sampler->profile, SAMPLER_ARBITER_BACKLOG_SECONDS), 1);
+	uint32_t need = ARBITER_MAX_NEED * MIN(app_backlog_count(backlog), full) / full;
+	app_arbiter_set_need(	&app_instance.client.arbiter,
+							ARBITER_UPLINK,
+							need,
+							sampler->profile.sample_rate * sizeof(int16_t));
+	app_arbiter_acquire(&app_instance.client.arbiter, ARBITER_UPLINK, len);
+}
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
+
+/* Send a recorder block in the configured upload format */
+static int _sampler_send_block(app_chunked_writer_t *writer, const sound_recorder_block_t *blk) {
+#if SAMPLER_FRAMED_UPLOAD
+	sampler_frame_hdr_t hdr = {
+			.seq = blk->seq,
+			.capture_us = blk->capture_us,
+			.samples = blk->len / sizeof(int16_t),
+	};
+	if (app_chunked_write(writer, &hdr, sizeof hdr) == ESP_FAIL) {
+		return ESP_FAIL;
+	}
+#endif	/* SAMPLER_FRAMED_UPLOAD */
+	return app_chunked_write(writer, blk->data, blk->len);
+}
+
+#if CLIENT_WS_TRANSPORT
+/* Stream the audio over the WebSocket session until the radio is switched off */
+static esp_err_t _sampler_ws_stream(sound_recorder_t *sampler, app_backlog_t *backlog, char *frame) {
+	app_ws_session_t *ws = &app_instance.client.ws;
+	sampler_frame_hdr_t hdr;
+	uint32_t rate = 0;
+	char msg[80];
+	esp_err_t ret = ESP_OK;
+	ESP_LOGI("REC", "Streaming over the WebSocket session");
+	while (sampler->state == SAMPLER_ACTIVE) {
+		/* Everything goes through the backlog, so a failed send loses nothing */
+		_sampler_stash_queue(sampler, backlog);
+		if (!app_backlog_count(backlog)) {
+			xSemaphoreGive(sampler->semphr);
+			xQueuePeek(sampler->queue, &sampler->http_blk, pdMS_TO_TICKS(500));
+			xSemaphoreTake(sampler->semphr, portMAX_DELAY);
+			continue;
+		}
+		if (app_backlog_peek(backlog, &sampler->http_blk) != ESP_OK) {
+			app_backlog_pop(backlog);
+			continue;
+		}
+		if (sampler->http_blk.sample_rate != rate) {
+			rate = sampler->http_blk.sample_rate;
+			snprintf(	msg,
+						sizeof msg,
+						"{\"type\":\"radio\",\"rate\":%u,\"deviceTimeUs\":%lld}",
+						(unsigned int)rate,
+						(long long)esp_timer_get_time());
+			if ((ret = app_ws_send_text(ws, msg)) != ESP_OK) {
+				return ESP_FAIL;
+			}
+		}
+		hdr.seq = sampler->http_blk.seq;
+		hdr.capture_us = sampler->http_blk.capture_us;
+		hdr.samples = sampler->http_blk.len / sizeof(int16_t);
+		memcpy(frame, &hdr, sizeof hdr);
+		memcpy(frame + sizeof hdr, sampler->http_blk.data, sampler->http_blk.len);
+		xSemaphoreGive(sampler->semphr);
+#if CLIENT_BANDWIDTH_ARBITER
+		_sampler_acquire(sampler, backlog, sizeof hdr + sampler->http_blk.len);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
+		ret = app_ws_send_bin(ws, frame, sizeof hdr + sampler->http_blk.len);
+		xSemaphoreTake(sampler->semphr, portMAX_DELAY);
+		if (ret != ESP_OK) {
+			return ESP_FAIL;
+		}
+		app_backlog_pop(backlog);
+	}
+	app_ws_send_text(ws, "{\"type\":\"radioEnd\"}");
+	return ESP_OK;
+}
+#endif	/* CLIENT_WS_TRANSPORT */
+
+/* Copy the oldest block waiting to be sent to the HTTP buffer */
+static BaseType_t _sampler_peek_oldest(sound_recorder_t *sampler, app_backlog_t *backlog) {
+	if (app_backlog_peek(backlog, &sampler->http_blk) == ESP_OK) {
+		return pdTRUE;
+	}
+	return xQueuePeek(sampler->queue, &sampler->http_blk, 0);
+}
+
+/* Acknowledge the end of reproduction of a track */
+static esp_err_t _ack_track(const uuid_t *track_id) {
+#if CLIENT_WS_TRANSPORT
+	if (_ws_ack_track(track_id) == ESP_OK) {
+		return ESP_OK;
+	}
+#endif	/* CLIENT_WS_TRANSPORT */
 	ESP_LOGW(tag, "Performing DELETE for the URL %s", (const char *)app_instance.uri.player);
-	int32_t ret = -1, data_len = -1, read_len = -1, err_cnt = 0;
-	EventBits_t event_bits = 0;
+	int32_t ret = -1, data_len = -1, read_len = -1;
+	app_retry_t retry;
 	esp_http_client_config_t client_cfg = {
 			.url = app_instance.uri.player,
 			.username = app_instance.device.login,
@@ -62,35 +418,78 @@ void app_client_delete_track(sound_player_t *player) {
 			.method = HTTP_METHOD_DELETE,
 			.event_handler = _http_client_event_handler,
 	};
-	player->http_cleaner_client = esp_http_client_init(&client_cfg);
-	ret = esp_http_client_open(player->http_cleaner_client, 0);
-	if (ret != ESP_OK) {
-		while (ret != ESP_OK) {
-			vTaskDelay(pdMS_TO_TICKS(100));
-			++err_cnt;
-			event_bits = xEventGroupGetBits(app_instance.event_group);
-			if (err_cnt > 99 || (event_bits & BIT_STA_DISCONNECTED)) {
-				break;
-			}
-			ret = esp_http_client_open(player->http_cleaner_client, 0);
+	/* The profile task flushes the outbox while the getter may acknowledge a track */
+	esp_http_client_handle_t cleaner = app_dns_client_init(&client_cfg);
+	app_retry_init(&retry, &delete_retry_policy);
+	while ((ret = esp_http_client_open(cleaner, 0)) != ESP_OK) {
+		if (app_retry_wait(&retry) != ESP_OK) {
+			break;
 		}
 	}
-	if (err_cnt <= 99 && !(event_bits & BIT_STA_DISCONNECTED)) {
-		data_len = esp_http_client_fetch_headers(player->http_cleaner_client);
-		esp_http_client_get_status_code(player->http_cleaner_client);
+	if (ret == ESP_OK) {
+		data_len = esp_http_client_fetch_headers(cleaner);
+		int status = esp_http_client_get_status_code(cleaner);
+		/* A track the server no longer has is acknowledged already, any other refusal
+		 * keeps the acknowledgement for the next attempt */
+		if (data_len < 0 || (status / 100 != 2 && status != HTTP_404)) {
+			ESP_LOGW(tag, "DELETE failed, status %d", status);
+			ret = ESP_FAIL;
+		} else {
+			ret = ESP_OK;
+		}
 		char *buf = malloc(MAX_HTTP_RECV_BUF + 1);
-		while (data_len > 0) {
-			if ((read_len = esp_http_client_read(	player->http_cleaner_client,
+		while (buf && data_len > 0) {
+			if ((read_len = esp_http_client_read(	cleaner,
 													buf,
 													MIN(data_len, MAX_HTTP_RECV_BUF))) <= 0) {
 				break;
 			}
 			data_len -= read_len;
 		}
-		esp_http_client_close(player->http_cleaner_client);
+		esp_http_client_close(cleaner);
 		free(buf);
 	}
-	esp_http_client_cleanup(player->http_cleaner_client);
+	esp_http_client_cleanup(cleaner);
+	return ret;
+}
+
+/* Send the reports kept while the station was offline, in one pass and with one write
+ * of the outbox */
+static void _outbox_flush(const app_client_profile_t *profile) {
+	app_outbox_entry_t entries[OUTBOX_SIZE];
+	size_t count = app_outbox_peek(entries, OUTBOX_SIZE), done = 0;
+	for (; done < count; ++done) {
+		esp_err_t ret = ESP_OK;
+		switch (entries[done].type) {
+		case OUTBOX_TRACK_DONE:
+			/* Only the track the server still offers waits for its acknowledgement, the
+			 * others are behind it already */
+			if (!memcmp(entries[done].key.b, profile->track_id.b, UUID_SIZE)) {
+				ret = _ack_track(&entries[done].key);
+			}
+			break;
+		default:
+			break;
+		}
+		if (ret != ESP_OK) {
+			break;
+		}
+	}
+	if (done) {
+		ESP_LOGI(tag, "%u of %u kept reports sent", (unsigned int)done, (unsigned int)count);
+		app_outbox_remove(entries, done);
+	}
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Execute the end-of-reproduction request */
+void app_client_delete_track(sound_player_t *player) {
+	if (_ack_track(&player->pend_tr_id) != ESP_OK) {
+		/* Otherwise the server offers the track again once the station is back */
+		ESP_LOGW(tag, "The end of the track is kept until the station is back online");
+		app_outbox_put(OUTBOX_TRACK_DONE, &player->pend_tr_id);
+	}
 }
 
 /**
@@ -110,10 +509,53 @@ void http_profile_getter_task(void *arg) {
 			.password = app_instance.device.passwd,
 			.auth_type = HTTP_AUTH_TYPE_BASIC,
 			.method = HTTP_METHOD_GET,
-			.event_handler = _http_client_event_handler,
+			.event_handler = app_client_profile_event_handler,
+			.user_data = &client->poll,
 	};
-	client->http_client = esp_http_client_init(&client_cfg);
-	esp_http_client_set_header(client->http_client, "Accept", "application/json");
+	int64_t req_time = 0;
+	app_retry_t retry;
+	app_retry_init(&retry, &profile_retry_policy);
+	app_http_conn_init(&client->conn, &client_cfg);
+	app_http_conn_set_header(&client->conn, "Accept", APP_API_ACCEPT);
+	app_http_conn_t *profile_conn = &client->conn;
+#if CLIENT_PROFILE_LONG_POLL
+	/* A separate handle keeps the credentials and the longer timeout of the held requests */
+	static char prefer[16];
+	snprintf(client->poll.url, sizeof client->poll.url, "%s?wait=%d", app_instance.uri.profile, CLIENT_LONG_POLL_WAIT_S);
+	snprintf(prefer, sizeof prefer, "wait=%d", CLIENT_LONG_POLL_WAIT_S);
+	esp_http_client_config_t poll_cfg = client_cfg;
+	poll_cfg.url = client->poll.url;
+	poll_cfg.timeout_ms = (CLIENT_LONG_POLL_WAIT_S + 10) * 1000;
+	app_http_conn_init(&client->poll.long_conn, &poll_cfg);
+	app_http_conn_set_header(&client->poll.long_conn, "Accept", APP_API_ACCEPT);
+	app_http_conn_set_header(&client->poll.long_conn, "Prefer", prefer);
+	_profile_set_long_poll(&client->poll, pdTRUE);
+#endif	/* CLIENT_PROFILE_LONG_POLL */
+#if CLIENT_WS_TRANSPORT
+	if (app_ws_start(	&client->ws,
+						app_instance.uri.ws,
+						app_instance.device.login,
+						app_instance.device.passwd,
+						_ws_on_text,
+						client) != ESP_OK) {
+		ESP_LOGW(tag, "WebSocket session is not available, falling back to polling");
+	}
+#endif	/* CLIENT_WS_TRANSPORT */
+	if (app_link_subscribe(_on_link_health, client) != ESP_OK) {
+		ESP_LOGW(tag, "The media tasks do not follow the link quality");
+	}
+	/* The media tasks and the profile drive the codec */
+	app_boot_wait(BOOT_STAGE_RESUME);
+	app_boot_begin(BOOT_STAGE_PROFILE);
+	if (client->is_resumed) {
+		/* The saved track starts while the first request is on its way, the answer
+		 * stops it if the server has moved on */
+		memcpy(&tmpprof, &client->resume_prof, sizeof tmpprof);
+		client->is_resumed = pdFALSE;
+		xSemaphoreTake(client->semphr, portMAX_DELAY);
+		_apply_profile(client, &tmpprof);
+		xSemaphoreGive(client->semphr);
+	}
 	xTaskCreatePinnedToCore(http_sound_getter_task,
 							"song_get",
 							8192,
@@ -131,53 +573,103 @@ void http_profile_getter_task(void *arg) {
 	for (;;) {
 		event_bits = xEventGroupGetBits(app_instance.event_group);
 		if (event_bits & BIT_STA_DISCONNECTED) {
-			app_client_halt_media_tasks(client);
+			/* The radio keeps capturing into the backlog while the station is offline. The
+			 * queued audio is left to play while the station roams */
+			if (!(event_bits & BIT_ROAMING)) {
+				app_client_halt_player(client);
+			}
+			app_retry_reset(&retry);
 			vTaskDelay(pdMS_TO_TICKS(2000));
 		} else {
-			if (!xSemaphoreTake(client->semphr, (TickType_t)10)) {
+#if CLIENT_WS_TRANSPORT
+			if (app_ws_is_connected(&client->ws)) {
+				/* The profile is pushed by the server */
+				vTaskDelay(pdMS_TO_TICKS(1000));
 				continue;
 			}
-			ret = app_client_get_device_profile(client->http_client, &tmpprof);
-			if (ret != ESP_OK) {
+#endif	/* CLIENT_WS_TRANSPORT */
+			/* The lock is not held over the request, a held request lasts for up to
+			 * CLIENT_LONG_POLL_WAIT_S and the pushed profiles must not wait for it */
+#if CLIENT_PROFILE_LONG_POLL
+			profile_conn = client->poll.is_long ? &client->poll.long_conn : &client->conn;
+			client->poll.is_applied = pdFALSE;
+#endif	/* CLIENT_PROFILE_LONG_POLL */
+			req_time = esp_timer_get_time();
+			ret = app_client_get_device_profile(profile_conn, &client->poll, &tmpprof);
+			if (ret != ESP_OK && (xEventGroupGetBits(app_instance.event_group) & BIT_STA_DISCONNECTED)) {
+				/* The station has gone during the request, the loop takes it from here */
+				continue;
+			}
+#if CLIENT_PROFILE_LONG_POLL
+			if (	client->poll.is_long && !client->poll.is_applied &&
+					(ret == ESP_OK || ret == ESP_ERR_TIMEOUT || ret == APP_CLIENT_ERR_NOT_MODIFIED)) {
+				/* The server has answered without holding the request */
+				ESP_LOGW(tag, "Long-poll is not supported by the server, falling back to polling");
+				_profile_set_long_poll(&client->poll, pdFALSE);
+			}
+			if (ret == ESP_ERR_TIMEOUT) {
+				/* The profile has not changed during the wait */
+				vTaskDelay(pdMS_TO_TICKS(CLIENT_LONG_POLL_MIN_GAP_MS));
+				continue;
+			}
+#endif	/* CLIENT_PROFILE_LONG_POLL */
+			if (ret != ESP_OK && ret != APP_CLIENT_ERR_NOT_MODIFIED) {
 				ESP_LOGE(tag, "Failed to perform profile HTTP request (%s)", esp_err_to_name(ret));
+				app_link_note_failure();
 				if (ret != ESP_ERR_INVALID_STATE) {
-					xSemaphoreGive(client->semphr);
+					/* A disconnect ends the wait, the loop then waits for the reconnect */
+					app_retry_wait(&retry);
 					continue;
 				} else {
 					/* Reset the device configuration, then perform the software reset */
-					xSemaphoreGive(client->semphr);
 					app_client_halt_media_tasks(client);
 					/* Sets the flag for deleting connection settings from device memory and resetting */
 					is_deleted = pdTRUE;
 					break;
 				}
 			}
-			xSemaphoreTake(client->player.semphr, portMAX_DELAY);
-			app_client_set_player_state(&client->player, &tmpprof);
-			xSemaphoreGive(client->player.semphr);
-			xSemaphoreTake(client->sampler.semphr, portMAX_DELAY);
-			app_client_set_sampler_state(&client->sampler, &tmpprof);
-			xSemaphoreGive(client->sampler.semphr);
-#if BOARD_USER_LED_FEATURE
-			if ((	(client->player.state == GETTER_ACTIVE || client->player.state == GETTER_STOP_AT_THE_END) ||
-					(client->sampler.state == SAMPLER_ACTIVE)) &&
-					!client->led_tracker) {
-				gpio_set_level(PIN_NUM_USER_LED, 1);
-				client->led_tracker = pdTRUE;
-			} else if (((client->player.state != GETTER_ACTIVE) &&
-						(client->sampler.state != SAMPLER_ACTIVE)) &&
-						client->led_tracker) {
-				gpio_set_level(PIN_NUM_USER_LED, 0);
-				client->led_tracker = pdFALSE;
+			app_boot_done(BOOT_STAGE_PROFILE);
+			app_retry_reset(&retry);
+			xSemaphoreTake(client->semphr, portMAX_DELAY);
+			if (ret == ESP_OK) {
+				_apply_profile(client, &tmpprof);
+			} else if (	(tmpprof.is_player && client->player.state == GETTER_IDLE) ||
+						(tmpprof.is_recorder && client->sampler.state == SAMPLER_IDLE)) {
+				/* Nothing has been parsed. The last profile is applied again only while it asks
+				 * for a media task that is idle, so that a start which has failed is retried */
+				_apply_profile(client, &tmpprof);
 			}
-#endif	/* BOARD_USER_LED_FEATURE */
+			app_resume_save(&tmpprof, _player_position(&client->player));
 			xSemaphoreGive(client->semphr);
+			_outbox_flush(&tmpprof);
+			_profile_stats(&client->poll, ret == APP_CLIENT_ERR_NOT_MODIFIED, esp_timer_get_time() - req_time);
+#if CLIENT_PROFILE_LONG_POLL
+			if (client->poll.is_long) {
+				/* The next request is held by the server until the profile changes */
+				vTaskDelay(pdMS_TO_TICKS(CLIENT_LONG_POLL_MIN_GAP_MS));
+				continue;
+			}
+			if (esp_timer_get_time() >= client->poll.probe_time) {
+				_profile_set_long_poll(&client->poll, pdTRUE);
+			}
+#endif	/* CLIENT_PROFILE_LONG_POLL */
+#if CLIENT_POLL_ADAPTIVE
+			vTaskDelay(_poll_next_delay(client, ret == ESP_OK));
+#else
 			vTaskDelay(pdMS_TO_TICKS(1000));
+#endif	/* CLIENT_POLL_ADAPTIVE */
 		}
 		int mem = heap_caps_get_free_size(MALLOC_CAP_8BIT);
 		ESP_LOGD(tag, "Current free memory: %d", mem);
 	}
-	esp_http_client_cleanup(client->http_client);
+	esp_http_client_cleanup(client->conn.hdl);
+#if CLIENT_PROFILE_LONG_POLL
+	esp_http_client_cleanup(client->poll.long_conn.hdl);
+#endif	/* CLIENT_PROFILE_LONG_POLL */
+	app_http_reader_deinit(&client->poll.reader);
+#if CLIENT_WS_TRANSPORT
+	app_ws_stop(&client->ws);
+#endif	/* CLIENT_WS_TRANSPORT */
 	if (is_deleted == pdTRUE) {
 		ESP_LOGW(tag, "Resetting device settings due to 401 error");
 		app_clear_device_connection_data();
@@ -203,12 +695,22 @@ void http_sound_getter_task(void *arg) {
 	int32_t ret = -1, data_len = -1, status = -1, remaining = -1;
 	BaseType_t is_chunked = pdFALSE, is_data_read = pdFALSE, is_stopped = pdFALSE;
 	xSemaphoreTake(player->semphr, portMAX_DELAY);
-	player->state = GETTER_IDLE;
+	/* A start requested ahead of the task by the saved profile is kept */
+	if (player->state != GETTER_STARTING) {
+		player->state = GETTER_IDLE;
+	}
 	xSemaphoreGive(player->semphr);
 	for (;;) {
+#if CLIENT_BANDWIDTH_ARBITER
+		/* The tokens of the next read are taken before the lock */
+		_player_acquire(player, player->state, is_data_read);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
 		xSemaphoreTake(player->semphr, portMAX_DELAY);
 		switch (player->state) {
 		case GETTER_IDLE:
+#if CLIENT_BANDWIDTH_ARBITER
+			app_arbiter_release(&app_instance.client.arbiter, ARBITER_DOWNLINK);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
 			xSemaphoreGive(player->semphr);
 			vTaskDelay(pdMS_TO_TICKS(100));
 			break;
@@ -251,16 +753,25 @@ void http_sound_getter_task(void *arg) {
 					.method = HTTP_METHOD_GET,
 					.event_handler = _http_client_event_handler,
 			};
-			player->http_getter_client = esp_http_client_init(&client_cfg);
+			player->http_getter_client = app_dns_client_init(&client_cfg);
 			heap_caps_free(url_buf);
 			heap_caps_free(query_buf);
+			if (player->resume_pos) {
+				char range[24];
+				snprintf(range, sizeof range, "bytes=%u-", (unsigned int)player->resume_pos);
+				esp_http_client_set_header(player->http_getter_client, "Range", range);
+			}
 			if ((ret = esp_http_client_open(player->http_getter_client, 0)) != ESP_OK) {
+				app_link_note_failure();
 				player->state = GETTER_IDLE;
 				break;
 			}
 			data_len = esp_http_client_fetch_headers(player->http_getter_client);
 			status = esp_http_client_get_status_code(player->http_getter_client);
-			if (status == HTTP_200) {
+			/* A server without range support sends the whole track */
+			player->play_pos = status == HTTP_206 ? player->resume_pos : 0;
+			player->resume_pos = 0;
+			if (status == HTTP_200 || status == HTTP_206) {
 				if (data_len < 0) {
 					player->state = GETTER_HALT;
 					break;
@@ -294,6 +805,7 @@ void http_sound_getter_task(void *arg) {
 						}
 					}
 				}
+				_player_account(player, ret);
 				if (ret == ESP_FAIL) {
 					/* XXX: Just leave this section */
 				} else {
@@ -316,7 +828,7 @@ void http_sound_getter_task(void *arg) {
 						break;
 					}
 					memset(player->http_buf, 0, sizeof player->http_buf);
-					if (	(uxQueueMessagesWaiting(player->queue) >= PLAYER_BUF_CAP_MSG && !is_data_read) ||
+					if (	(uxQueueMessagesWaiting(player->queue) >= _player_buf_target() && !is_data_read) ||
 							is_data_read) {
 						player->state = !is_data_read ? GETTER_ACTIVE : GETTER_STOP_AT_THE_END;
 						memset(player->codec_buf, 0, sizeof player->codec_buf);
@@ -346,6 +858,7 @@ void http_sound_getter_task(void *arg) {
 						}
 					}
 				}
+				_player_account(player, ret);
 				if (ret == ESP_FAIL) {
 					/* XXX: Just leave this section */
 				} else {
@@ -368,7 +881,7 @@ void http_sound_getter_task(void *arg) {
 						break;
 					}
 					memset(player->http_buf, 0, sizeof player->http_buf);
-					if ((uxQueueMessagesWaiting(player->queue) < PLAYER_BUF_CAP_MSG) && !is_data_read) {
+					if ((uxQueueMessagesWaiting(player->queue) < PLAYER_BUF_LOW_MSG) && !is_data_read) {
 						vTaskSuspend(player->decoder_hdl);
 						player->state = GETTER_BUFFERING;
 					} else if (is_data_read) {
@@ -396,6 +909,7 @@ void http_sound_getter_task(void *arg) {
 						}
 					}
 				}
+				_player_account(player, ret);
 				if (ret == ESP_FAIL) {
 					/* XXX: Just leave this section */
 				} else {
@@ -423,6 +937,10 @@ void http_sound_getter_task(void *arg) {
 			vTaskDelay(pdMS_TO_TICKS(100));
 			break;
 		case GETTER_STOP_AT_THE_END:
+#if CLIENT_BANDWIDTH_ARBITER
+			/* The whole track is in the queue, the link is left to the upload */
+			app_arbiter_release(&app_instance.client.arbiter, ARBITER_DOWNLINK);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
 			if (uxQueueMessagesWaiting(player->queue)) {
 				break;
 			}
@@ -460,6 +978,7 @@ void sound_decoder_task(void *arg) {
 				player->state == GETTER_STOP_AT_THE_END) {
 			if (xQueueReceive(player->queue, player->codec_buf, 0)) {
 				vs1053b_play_chunk(player->codec_buf, sizeof player->codec_buf);
+				player->play_pos += sizeof player->codec_buf;
 				memset(player->codec_buf, 0, sizeof player->codec_buf);
 			}
 		}
@@ -467,23 +986,6 @@ void sound_decoder_task(void *arg) {
 	}
 }
 
-static int send_chunk(esp_http_client_handle_t http, const void *buffer, int buffer_len)
-{
-    char str_buf[16];
-
-	int wlen = sprintf(str_buf, "%x\r\n", buffer_len);
-	if (esp_http_client_write(http, str_buf, wlen) <= 0) {
-		return ESP_FAIL;
-	}
-	if (esp_http_client_write(http, buffer, buffer_len) <= 0) {
-		return ESP_FAIL;
-	}
-	if (esp_http_client_write(http, "\r\n", 2) <= 0) {
-		return ESP_FAIL;
-	}
-	return buffer_len;
-}
-
 /**
  * @ingroup	app_client_rtos_tasks
  * Send audio recordings to the server
@@ -491,6 +993,7 @@ static int send_chunk(esp_http_client_handle_t http, const void *buffer, int buf
 void http_sound_sender_task(void *arg) {
 	// BaseType_t is_halted = pdFALSE;
 	sound_recorder_t *sampler = (sound_recorder_t *)arg;
+	sampler->is_armed = SAMPLER_PRE_TRIGGER_SECONDS ? pdTRUE : pdFALSE;
 	xTaskCreatePinnedToCore(sound_recorder_task,
 							"voice_rec",
 							2048,
@@ -498,10 +1001,38 @@ void http_sound_sender_task(void *arg) {
 							20,
 							&sampler->sampler_hdl,
 							1);
-	vTaskSuspend(sampler->sampler_hdl);
+	if (!sampler->is_armed) {
+		vTaskSuspend(sampler->sampler_hdl);
+	}
 	int32_t ret = -1, data_len = -1, read_len = -1;
-	sampler->wav_hdr.ChunkSize = 36 + QUEUE_MESSAGES_WAITING_THRESHOLD * sizeof sampler->http_buf;
-	sampler->wav_hdr.Subchunk2Size = QUEUE_MESSAGES_WAITING_THRESHOLD * sizeof sampler->http_buf;
+	int64_t retry_time = 0;
+	app_retry_t retry;
+	app_retry_init(&retry, &sampler_retry_policy);
+	int64_t offset_ms = 0;
+	uint32_t conn_rate = 0;
+	size_t conn_block = 0;
+	char offset_str[24];
+#if SAMPLER_FRAMED_UPLOAD
+	char time_str[24];
+	char format_str[40];
+#endif	/* SAMPLER_FRAMED_UPLOAD */
+#if CLIENT_WS_TRANSPORT
+	char *ws_frame = heap_caps_malloc(sizeof(sampler_frame_hdr_t) + RECORDER_TRANS_BUF_SIZE, MALLOC_CAP_8BIT);
+	while (!ws_frame) {
+		vTaskDelay(1);
+		ws_frame = heap_caps_malloc(sizeof(sampler_frame_hdr_t) + RECORDER_TRANS_BUF_SIZE, MALLOC_CAP_8BIT);
+	}
+#endif	/* CLIENT_WS_TRANSPORT */
+	app_chunked_writer_t writer;
+	while (app_chunked_init(&writer,
+							SAMPLER_CHUNK_BLOCKS * RECORDER_TRANS_BUF_SIZE,
+							SAMPLER_CHUNK_LATENCY_MS) != ESP_OK) {
+		vTaskDelay(1);
+	}
+	app_backlog_t backlog;
+	if (app_backlog_init(&backlog, SAMPLER_BACKLOG_RAM_SIZE, SAMPLER_BACKLOG_FLASH_BLOCKS) != ESP_OK) {
+		ESP_LOGW(tag, "No backlog, the audio captured while the uplink is down will be lost");
+	}
 	esp_http_client_config_t client_cfg = {
 			.url = app_instance.uri.sampler,
 			//.url = "http://192.168.1.57:8070/teddyserver-rest/webapis/0.1/device/radio",
@@ -511,125 +1042,202 @@ void http_sound_sender_task(void *arg) {
 			.method = HTTP_METHOD_POST,
 			.event_handler = _http_client_event_handler,
 	};
-	sampler->http_client = esp_http_client_init(&client_cfg);
+	sampler->http_client = app_dns_client_init(&client_cfg);
 	esp_http_client_set_header(sampler->http_client, "Connection", "keep-alive");
+#if SAMPLER_FRAMED_UPLOAD
+	esp_http_client_set_header(sampler->http_client, "Content-Type", SAMPLER_FRAMED_CONTENT_TYPE);
+#else
 	esp_http_client_set_header(sampler->http_client, "Content-Type", "audio/wav");
+#endif	/* SAMPLER_FRAMED_UPLOAD */
 	//esp_http_client_set_header(sampler->http_client, "Content-Type", "text/html");
 	xSemaphoreTake(sampler->semphr, portMAX_DELAY);
 	sampler->state = SAMPLER_IDLE;
 	xSemaphoreGive(sampler->semphr);
 	for (;;) {
+#if CLIENT_BANDWIDTH_ARBITER
+		/* No upload connection is open between the iterations. An uplink waiting for the
+		 * station or for its retry sends nothing, so it takes no share from the player,
+		 * _sampler_acquire marks it active again before each write */
+		app_arbiter_release(&app_instance.client.arbiter, ARBITER_UPLINK);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
 		xSemaphoreTake(sampler->semphr, portMAX_DELAY);
 		switch (sampler->state) {
 		case SAMPLER_IDLE:
+			if (sampler->is_armed) {
+				/* Keep only the last SAMPLER_PRE_TRIGGER_SECONDS of audio */
+				_sampler_stash_queue(sampler, &backlog);
+				app_backlog_trim(&backlog, _sampler_blocks(&sampler->profile, SAMPLER_PRE_TRIGGER_SECONDS));
+			}
 			xSemaphoreGive(sampler->semphr);
 			vTaskDelay(pdMS_TO_TICKS(100));
 			break;
 
 		case SAMPLER_STARTING:
 			ret = -1, data_len = -1, read_len = -1;
-			memset(sampler->rec_buf, 0, sizeof sampler->rec_buf);
-			memset(sampler->http_buf, 0, sizeof sampler->http_buf);
-			xQueueReset(sampler->queue);
+			memset(&sampler->http_blk, 0, sizeof sampler->http_blk);
+			if (!sampler->is_armed) {
+				memset(&sampler->rec_blk, 0, sizeof sampler->rec_blk);
+				xQueueReset(sampler->queue);
+			}
+			/* Otherwise the pre-trigger history is sent first */
 			sampler->state = SAMPLER_ACTIVE;
 			vTaskResume(sampler->sampler_hdl);
 			break;
 
 		case SAMPLER_ACTIVE:
-			//if (uxQueueMessagesWaiting(sampler->queue) >= QUEUE_MESSAGES_WAITING_THRESHOLD) {
-				ESP_LOGI("REC", "Opening connection... %s", client_cfg.url);
-				// сбросим очередь
-				xQueueReset(sampler->queue);
-				ret = esp_http_client_open(	sampler->http_client, -1);	// write_len = -1 для потока
-//											QUEUE_MESSAGES_WAITING_THRESHOLD * sizeof sampler->http_buf +
-//											sizeof sampler->wav_hdr);
-				if (ret != ESP_OK) {
-					break;
+			/* While the uplink is down the captured audio is kept in the backlog */
+			_sampler_stash_queue(sampler, &backlog);
+			if (app_retry_is_cancelled(&retry)) {
+				/* Nothing is attempted while the station is offline, the reconnect is
+				 * followed by an attempt at once */
+				app_retry_reset(&retry);
+				retry_time = 0;
+				xSemaphoreGive(sampler->semphr);
+				vTaskDelay(pdMS_TO_TICKS(100));
+				break;
+			}
+			if (esp_timer_get_time() < retry_time) {
+				xSemaphoreGive(sampler->semphr);
+				vTaskDelay(pdMS_TO_TICKS(100));
+				break;
+			}
+#if CLIENT_WS_TRANSPORT
+			if (app_ws_is_connected(&app_instance.client.ws)) {
+				if (_sampler_ws_stream(sampler, &backlog, ws_frame) != ESP_OK) {
+					ESP_LOGW("REC", "Stream interrupted, %u blocks kept", app_backlog_count(&backlog));
+					retry_time = _sampler_retry_time(&retry);
 				}
+				break;
+			}
+#endif	/* CLIENT_WS_TRANSPORT */
+			ESP_LOGI("REC", "Opening connection... %s", client_cfg.url);
+			/* The age of the oldest block lets the server place the record in time, and its
+			 * sample rate is the one of the whole upload */
+			offset_ms = 0;
+			conn_rate = sampler->profile.sample_rate;
+			conn_block = sampler->profile.block_size;
+			if (_sampler_peek_oldest(sampler, &backlog) == pdTRUE) {
+				offset_ms = (esp_timer_get_time() - sampler->http_blk.capture_us) / 1000;
+				conn_rate = sampler->http_blk.sample_rate;
+				conn_block = sampler->http_blk.len;
+			}
+			snprintf(offset_str, sizeof offset_str, "%lld", (long long)offset_ms);
+			esp_http_client_set_header(sampler->http_client, "X-Capture-Offset-Ms", offset_str);
+			sound_recorder_set_wav_rate(sampler, conn_rate);
+			sound_recorder_set_wav_size(sampler, QUEUE_MESSAGES_WAITING_THRESHOLD * conn_block);
+#if SAMPLER_FRAMED_UPLOAD
+			snprintf(format_str, sizeof format_str, "s16le;rate=%u;channels=1", (unsigned int)conn_rate);
+			esp_http_client_set_header(sampler->http_client, "X-Audio-Format", format_str);
+			/* Reference point for the capture timestamps of the frames */
+			snprintf(time_str, sizeof time_str, "%lld", (long long)esp_timer_get_time());
+			esp_http_client_set_header(sampler->http_client, "X-Device-Time-Us", time_str);
+#endif	/* SAMPLER_FRAMED_UPLOAD */
+			ret = esp_http_client_open(	sampler->http_client, -1);	// write_len = -1 для потока
+			if (ret != ESP_OK) {
+				app_link_note_failure();
+				retry_time = _sampler_retry_time(&retry);
+				ESP_LOGW("REC", "Uplink is down, %u blocks kept", app_backlog_count(&backlog));
+				break;
+			}
+			app_chunked_attach(&writer, sampler->http_client);
 
-				ESP_LOGI("REC", "Writing wave header...");
-				//ret = esp_http_client_write(sampler->http_client, (const char *)&sampler->wav_hdr, sizeof sampler->wav_hdr);
-				ret = send_chunk(sampler->http_client, &sampler->wav_hdr, sizeof sampler->wav_hdr);
-				if (ret > 0) {
-					// пока включена наня - читаем из очереди и отправляем
-					while (sampler->state == SAMPLER_ACTIVE)
-					{
-						// ждём данные до 0,5сек, потом повторяем
-						if (xQueueReceive(sampler->queue, sampler->http_buf, pdMS_TO_TICKS(500)) == pdTRUE)
-						{
-							UBaseType_t qCnt = uxQueueMessagesWaiting(sampler->queue);
-							if (qCnt > 6)
-							{
-								// прпускаем все, что накопилось лишнее
-								// буфер 4к, если > 4х буферов в ожидании, это больше 0,5 сек - выкидываем всё
-								xQueueReset(sampler->queue);
-								ESP_LOGI("REC", "REC - Drop buffers: %d", qCnt);
-							}
-							xSemaphoreGive(sampler->semphr);
-							ESP_LOGI("REC", "WR - %d", qCnt);
-							// esp_http_client_write(	sampler->http_client, (const char *)sampler->http_buf, sizeof sampler->http_buf);
-							ret = send_chunk(sampler->http_client, &sampler->http_buf, sizeof sampler->http_buf);
-							if (ret == ESP_FAIL)
-							{
-								ESP_LOGI("REC", "ERROR");
-							}
-
-							xSemaphoreTake(sampler->semphr, portMAX_DELAY);
-							if (sampler->state == SAMPLER_HALT) {
-								// is_halted = pdTRUE;
-								break;
-							}
-						}
+#if SAMPLER_FRAMED_UPLOAD
+			ret = 1;
+#else
+			ESP_LOGI("REC", "Writing wave header...");
+			ret = app_chunked_write(&writer, &sampler->wav_hdr, sizeof sampler->wav_hdr);
+#endif	/* SAMPLER_FRAMED_UPLOAD */
+			// пока включена наня - сначала выгружаем накопленное (быстрее реального времени),
+			// затем читаем из очереди и отправляем
+			while (ret > 0 && sampler->state == SAMPLER_ACTIVE) {
+				if (app_backlog_count(&backlog)) {
+					/* Blocks captured meanwhile are queued behind the backlog to keep the order */
+					_sampler_stash_queue(sampler, &backlog);
+					if (app_backlog_peek(&backlog, &sampler->http_blk) != ESP_OK) {
+						/* An unreadable block of the spill file is skipped */
+						app_backlog_pop(&backlog);
+						continue;
 					}
-					/*
-					for (int i = 0; i < QUEUE_MESSAGES_WAITING_THRESHOLD; ++i) {
-						xQueueReceive(sampler->queue, sampler->http_buf, 0);
-						int32_t write_ret = -1;
-						while (write_ret == -1) {
-							xSemaphoreGive(sampler->semphr);
-							ESP_LOGI(tag, "REC - Writing buffer");
-							write_ret = esp_http_client_write(	sampler->http_client,
-																(const char *)sampler->http_buf,
-																sizeof sampler->http_buf);
-							xSemaphoreTake(sampler->semphr, portMAX_DELAY);
-							if (sampler->state == SAMPLER_HALT) {
-								is_halted = pdTRUE;
-								break;
-							}
-						}
-						memset(sampler->http_buf, 0, sizeof sampler->http_buf);
-						if (is_halted == pdTRUE) {
-							is_halted = pdFALSE;
-							break;
-						}
-					}*/
-				}
-				ESP_LOGI("REC", "Close connection");
-
-				// записываем конец потока
- 		       	esp_http_client_write(sampler->http_client, "0\r\n\r\n", 5);
- 
-				// получаем ответ сервера
-				data_len = esp_http_client_fetch_headers(sampler->http_client);
-				int status_code = esp_http_client_get_status_code(sampler->http_client);
-				ESP_LOGI("REC", "Status Code: %d, content length: %d", status_code, data_len);
-				char *buf = malloc(MAX_HTTP_RECV_BUF + 1);
-				while (data_len > 0) {
-					if ((read_len = esp_http_client_read( sampler->http_client, buf, MIN(data_len, MAX_HTTP_RECV_BUF)) ) <= 0)
-					{
+					if (sampler->http_blk.sample_rate != conn_rate) {
+						/* The capture profile has changed, the rest goes with a new header */
+						ret = 0;
+						break;
+					}
+					xSemaphoreGive(sampler->semphr);
+#if CLIENT_BANDWIDTH_ARBITER
+					_sampler_acquire(sampler, &backlog, sampler->http_blk.len);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
+					ret = _sampler_send_block(&writer, &sampler->http_blk);
+					if (ret > 0) {
+						/* The backlog goes out as fast as the link takes it */
+						app_link_note_bytes(sampler->http_blk.len, true);
+						app_backlog_pop(&backlog);
+						app_retry_reset(&retry);
+					}
+					xSemaphoreTake(sampler->semphr, portMAX_DELAY);
+				} else if (xQueueReceive(	sampler->queue,
+											&sampler->http_blk,
+											app_chunked_wait_ticks(&writer, pdMS_TO_TICKS(500))) == pdTRUE) {
+					// ждём данные до 0,5сек (или до истечения задержки накопленного блока), потом повторяем
+					if (sampler->http_blk.sample_rate != conn_rate) {
+						_sampler_backlog_push(&backlog, &sampler->http_blk);
+						ret = 0;
 						break;
 					}
-					data_len -= read_len;
+					xSemaphoreGive(sampler->semphr);
+#if CLIENT_BANDWIDTH_ARBITER
+					_sampler_acquire(sampler, &backlog, sampler->http_blk.len);
+#endif	/* CLIENT_BANDWIDTH_ARBITER */
+					ret = _sampler_send_block(&writer, &sampler->http_blk);
+					if (ret == ESP_FAIL) {
+						/* The block goes out with the next connection */
+						_sampler_backlog_push(&backlog, &sampler->http_blk);
+					} else {
+						app_retry_reset(&retry);
+					}
+					xSemaphoreTake(sampler->semphr, portMAX_DELAY);
+				} else if (app_chunked_poll(&writer) != ESP_OK) {
+					ret = ESP_FAIL;
 				}
-				free(buf);
-
+			}
+			if (ret == ESP_FAIL) {
+				ESP_LOGW("REC", "Upload interrupted, %u blocks kept", app_backlog_count(&backlog));
+				app_link_note_failure();
 				esp_http_client_close(sampler->http_client);
-			//}
+				retry_time = _sampler_retry_time(&retry);
+				break;
+			}
+			ESP_LOGI("REC", "Close connection");
+
+			// дописываем накопленные данные и конец потока одной записью
+			app_chunked_finish(&writer);
+
+			// получаем ответ сервера
+			data_len = esp_http_client_fetch_headers(sampler->http_client);
+			int status_code = esp_http_client_get_status_code(sampler->http_client);
+			ESP_LOGI("REC", "Status Code: %d, content length: %d", status_code, data_len);
+			char *buf = malloc(MAX_HTTP_RECV_BUF + 1);
+			while (data_len > 0) {
+				if ((read_len = esp_http_client_read( sampler->http_client, buf, MIN(data_len, MAX_HTTP_RECV_BUF)) ) <= 0)
+				{
+					break;
+				}
+				data_len -= read_len;
+			}
+			free(buf);
+
+			esp_http_client_close(sampler->http_client);
 			break;
 
 		case SAMPLER_HALT:
-			vTaskSuspend(sampler->sampler_hdl);
+			if (!sampler->is_armed) {
+				vTaskSuspend(sampler->sampler_hdl);
+			}
 			esp_http_client_close(sampler->http_client);
+			/* The radio is switched off, the audio kept so far is no longer wanted */
+			app_backlog_clear(&backlog);
+			app_retry_reset(&retry);
+			retry_time = 0;
 			sampler->state = SAMPLER_IDLE;
 			break;
 		default:
@@ -639,6 +1247,10 @@ void http_sound_sender_task(void *arg) {
 		vTaskDelay(1);
 	}
 	esp_http_client_cleanup(sampler->http_client);
+	app_chunked_deinit(&writer);
+#if CLIENT_WS_TRANSPORT
+	heap_caps_free(ws_frame);
+#endif	/* CLIENT_WS_TRANSPORT */
 	sampler->sender_hdl = NULL;
 	vTaskDelete(NULL);
 }
@@ -649,15 +1261,42 @@ void http_sound_sender_task(void *arg) {
  */
 void sound_recorder_task(void *arg) {
 	sound_recorder_t *recorder = (sound_recorder_t *)arg;
-	int32_t read_len = -1;
+	size_t read_len = 0;
+	uint32_t seq = 0;
+	sound_recorder_profile_t profile;
 	for (;;) {
-		if (recorder->state == SAMPLER_ACTIVE) {
-			mp45dt02_take_samples(	(char *)recorder->rec_buf,
-									sizeof recorder->rec_buf,
-									(size_t *)&read_len,
-									portMAX_DELAY);
-			xQueueSendToBack(recorder->queue, recorder->rec_buf, 0);
-			memset(recorder->rec_buf, 0, sizeof recorder->rec_buf);
+		/* The microphone is reconfigured here, as no one else reads it */
+		if (sound_recorder_take_profile(recorder, &profile) == pdTRUE) {
+			if (mp45dt02_reconfigure(	profile.sample_rate,
+										profile.dma_buf_count,
+										profile.dma_buf_len) == ESP_OK) {
+				recorder->profile = profile;
+			} else {
+				ESP_LOGW(tag, "Failed to apply the capture profile");
+			}
+		}
+		if (!mp45dt02_is_installed()) {
+			/* Not even the previous configuration could be installed again, it is tried
+			 * again later rather than read from a driver that is gone */
+			vTaskDelay(pdMS_TO_TICKS(SAMPLER_RETRY_PERIOD_MS));
+			mp45dt02_reconfigure(	recorder->profile.sample_rate,
+									recorder->profile.dma_buf_count,
+									recorder->profile.dma_buf_len);
+			continue;
+		}
+		if (recorder->state == SAMPLER_ACTIVE || recorder->is_armed) {
+			if (	mp45dt02_take_samples(	recorder->rec_blk.data,
+											recorder->profile.block_size,
+											&read_len,
+											portMAX_DELAY) == ESP_OK &&
+					read_len) {
+				recorder->rec_blk.seq = seq++;
+				recorder->rec_blk.sample_rate = recorder->profile.sample_rate;
+				recorder->rec_blk.capture_us = esp_timer_get_time();
+				recorder->rec_blk.len = (uint32_t)read_len;
+				xQueueSendToBack(recorder->queue, &recorder->rec_blk, 0);
+			}
+			memset(&recorder->rec_blk, 0, sizeof recorder->rec_blk);
 		}
 		vTaskDelay(1);
 	}
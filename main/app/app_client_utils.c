@@ -21,11 +21,14 @@
 #include <esp_err.h>
 #include <esp_heap_caps.h>
 #include <esp_log.h>
-#include <cJSON.h>
 
 /* User files */
 #include "app.h"
+#include "app_cbor.h"
 #include "app_client.h"
+#include "app_outbox.h"
+#include "app_profile_parser.h"
+#include "app_resume.h"
 #include "board_def.h"
 #include "uuid.h"
 #include "vs1053b.h"
@@ -35,108 +38,26 @@
 static const char *tag = "app_client";
 static bool firstShowProfile = true;
 
-/* Export functions ----------------------------------------------------------*/
+#define PROFILE_READ_CHUNK_SIZE	128	/*!< Piece of the profile response read at a time */
 
-/**
- * @ingroup	app_client_utils
- * Get JSON string that contains current device profile keys values
- */
-esp_err_t app_client_get_device_profile(esp_http_client_handle_t cli_hdl, app_client_profile_t *profile) {
-	int32_t ret = -1, data_len = -1, status = -1, read_len = -1;
-	ret = esp_http_client_open(cli_hdl, 0);
-	if (ret != ESP_OK) {
-		return ESP_FAIL;
-	}
-	data_len = esp_http_client_fetch_headers(cli_hdl);
-	status = esp_http_client_get_status_code(cli_hdl);
-	if (status == HTTP_200) {
-		if (data_len <= 0) {
-			esp_http_client_close(cli_hdl);
-			return ESP_FAIL;
-		} else if (data_len > 0) {
-			char *buf = malloc(MAX_HTTP_RECV_BUF + 1);
-			while (data_len > 0) {
-				if ((read_len = esp_http_client_read(	cli_hdl,
-														buf,
-														MIN(data_len, MAX_HTTP_RECV_BUF))) <= 0) {
-					break;
-				}
-				data_len -= read_len;
-			}
-			if (app_client_parse_profile(profile, (const char * const)buf) == ESP_FAIL) {
-				esp_http_client_close(cli_hdl);
-				free(buf);
-				return ESP_ERR_NOT_FOUND;
-			}
-			esp_http_client_close(cli_hdl);
-			free(buf);
-		}
-	} else {
-		ESP_LOGD(tag, "HTTP response status code is invalid = %d", status);
-		esp_http_client_close(cli_hdl);
-		if (status == HTTP_401) {
-			return ESP_ERR_INVALID_STATE;
-		} else {
-			return ESP_FAIL;
-		}
+/* Private functions ---------------------------------------------------------*/
+
+/* FNV-1a hash of the profile content, used when the server gives no ETag */
+static uint32_t _hash_update(uint32_t hash, const char *data, size_t len) {
+	while (len--) {
+		hash ^= (uint8_t)*data++;
+		hash *= 16777619U;
 	}
-	return ESP_OK;
+	return hash;
 }
 
-/**
- * @ingroup	app_client_utils
- * Parse JSON string that contains current device profile keys values
- */
-esp_err_t app_client_parse_profile(app_client_profile_t *profile, const char * const content) {
-	BaseType_t does_trid_exist = pdFALSE;
-	cJSON *root = cJSON_Parse(content);
-	char *key1 = NULL, *key2 = NULL, *key3 = NULL;
-	cJSON *obj1 = cJSON_GetObjectItem(root, "id");
-	if (obj1) {
-		key1 = obj1->valuestring;
-		if (key1) {
-			strlcpy(profile->id, key1, sizeof profile->id);
-		} else {
-			return ESP_FAIL;
-		}
-	} else {
-		return ESP_FAIL;
-	}
-	cJSON *obj2 = cJSON_GetObjectItem(root, "name");
-	if (obj2) {
-		key2 = obj2->valuestring;
-		if (key2) {
-			strlcpy(profile->name, key2, sizeof profile->name);
-		} else {
-			return ESP_FAIL;
-		}
-	} else {
-		return ESP_FAIL;
-	}
-	cJSON *obj3 = cJSON_GetObjectItem(root, "currentVoiceCommandId");
-	if (obj3) {
-		key3 = obj3->valuestring;
-		if (key3) {
-			if (uuid_parse((const char *)key3, &profile->track_id) == ESP_OK) {
-				does_trid_exist = pdTRUE;
-			}
-		}
-	}
-	profile->is_muted = cJSON_GetObjectItem(root, "mute")->valueint;
-	profile->is_player = cJSON_GetObjectItem(root, "playerActive")->valueint;
-	profile->is_recorder = cJSON_GetObjectItem(root, "radioActive")->valueint;
-	profile->track_cnt = cJSON_GetObjectItem(root, "soundCnt")->valuedouble;
-	profile->vol = cJSON_GetObjectItem(root, "volume")->valuedouble;
-	cJSON_Delete(root);
-	char *tmpstr = malloc(UUID_NULL_TERM_STRING_LEN);
-	if (does_trid_exist == pdTRUE) {
-		if (uuid_to_string(&profile->track_id, tmpstr, UUID_NULL_TERM_STRING_LEN) != ESP_OK) {
-			return ESP_FAIL;
-		}
-	} else {
-		memset(&profile->track_id.b, 0, sizeof profile->track_id.b);
+/* Print the parsed profile, the first one in full */
+static void _log_profile(const app_client_profile_t *profile) {
+	static const uuid_t null_id = { 0 };
+	char track_id[UUID_NULL_TERM_STRING_LEN] = "";
+	if (memcmp(&profile->track_id, &null_id, sizeof null_id)) {
+		uuid_to_string(&profile->track_id, track_id, sizeof track_id);
 	}
-
 	if (firstShowProfile)
 	{
 		firstShowProfile = false;
@@ -156,7 +77,7 @@ esp_err_t app_client_parse_profile(app_client_profile_t *profile, const char * c
 						profile->vol,
 						profile->is_recorder,
 						profile->track_cnt,
-						does_trid_exist == pdFALSE ? "" : (const char *)tmpstr);
+						track_id);
 	}
 	else
 	{
@@ -166,10 +87,121 @@ esp_err_t app_client_parse_profile(app_client_profile_t *profile, const char * c
 						profile->vol,
 						profile->is_recorder,
 						profile->track_cnt,
-						does_trid_exist == pdFALSE ? "" : (const char *)tmpstr);
+						track_id);
+	}
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @ingroup	app_client_utils
+ * Get JSON string that contains current device profile keys values
+ */
+esp_err_t app_client_get_device_profile(	app_http_conn_t *conn,
+											app_client_poll_t *poll,
+											app_client_profile_t *profile) {
+	int32_t data_len = -1, status = -1, read_len = -1, total = 0;
+	uint32_t hash = 2166136261U;
+	poll->etag_rx[0] = '\0';
+	poll->is_cbor = pdFALSE;
+	poll->conn = conn;
+	app_http_conn_follow(conn);
+	app_http_reader_prepare(&poll->reader, conn->hdl);
+	if (poll->etag[0]) {
+		esp_http_client_set_header(conn->hdl, "If-None-Match", poll->etag);
+	} else {
+		esp_http_client_delete_header(conn->hdl, "If-None-Match");
+	}
+	if ((data_len = app_http_conn_request(conn)) < 0) {
+		return ESP_FAIL;
 	}
-	
-	free(tmpstr);
+	status = esp_http_client_get_status_code(conn->hdl);
+	if (status == HTTP_200) {
+		/* A chunked body has no length, a profile compressed on the fly comes this way */
+		if (data_len < 0 || (data_len == 0 && !esp_http_client_is_chunked_response(conn->hdl))) {
+			app_http_conn_done(conn, false);
+			return ESP_FAIL;
+		} else if (app_http_reader_start(&poll->reader, data_len) != ESP_OK) {
+			app_http_conn_done(conn, false);
+			return ESP_FAIL;
+		} else {
+			/* The body is parsed as it arrives, into a scratch copy so that a broken
+			 * response leaves the current profile intact. CBOR is decoded as a whole */
+			char chunk[PROFILE_READ_CHUNK_SIZE];
+			uint8_t cbor[MAX_HTTP_RECV_BUF];
+			app_client_profile_t parsed;
+			app_profile_parser_t parser;
+			int64_t decode_us = 0, start;
+			app_profile_parser_init(&parser, &parsed);
+			while (total < MAX_HTTP_RECV_BUF) {
+				char *dst = poll->is_cbor ? (char *)cbor + total : chunk;
+				size_t size = poll->is_cbor ? MAX_HTTP_RECV_BUF - total : sizeof chunk;
+				if ((read_len = app_http_reader_read(&poll->reader, dst, size)) <= 0) {
+					break;
+				}
+				hash = _hash_update(hash, dst, read_len);
+				if (!poll->is_cbor) {
+					start = esp_timer_get_time();
+					app_profile_parser_feed(&parser, chunk, read_len);
+					decode_us += esp_timer_get_time() - start;
+				}
+				total += read_len;
+			}
+			if (poll->is_cbor) {
+				start = esp_timer_get_time();
+				app_profile_parser_cbor(&parser, cbor, total);
+				decode_us += esp_timer_get_time() - start;
+			}
+			app_http_conn_done(conn, read_len == 0 && app_http_reader_is_complete(&poll->reader));
+			/* Without an ETag the content itself tells whether the profile has changed */
+			if (!poll->etag_rx[0] && poll->hash == hash) {
+				return APP_CLIENT_ERR_NOT_MODIFIED;
+			}
+			if (app_profile_parser_finish(&parser) != ESP_OK) {
+				return ESP_ERR_NOT_FOUND;
+			}
+			memcpy(profile, &parsed, sizeof *profile);
+			_log_profile(profile);
+			++poll->parsed_cnt;
+			poll->cbor_cnt += poll->is_cbor ? 1 : 0;
+			poll->rx_bytes += poll->reader.wire_bytes;
+			poll->decode_us += decode_us;
+			/* The validators are kept only for a profile that has been parsed */
+			strlcpy(poll->etag, poll->etag_rx, sizeof poll->etag);
+			poll->hash = hash;
+		}
+	} else if (status == HTTP_304) {
+		app_http_conn_done(conn, true);
+		return APP_CLIENT_ERR_NOT_MODIFIED;
+	} else if (status == HTTP_204) {
+		app_http_conn_done(conn, true);
+		return ESP_ERR_TIMEOUT;
+	} else {
+		ESP_LOGD(tag, "HTTP response status code is invalid = %d", status);
+		app_http_conn_done(conn, false);
+		if (status == HTTP_401) {
+			return ESP_ERR_INVALID_STATE;
+		} else {
+			return ESP_FAIL;
+		}
+	}
+	return ESP_OK;
+}
+
+/**
+ * @ingroup	app_client_utils
+ * Parse JSON string that contains current device profile keys values
+ */
+esp_err_t app_client_parse_profile(app_client_profile_t *profile, const char * const content) {
+	app_client_profile_t parsed;
+	app_profile_parser_t parser;
+	app_profile_parser_init(&parser, &parsed);
+	if (	app_profile_parser_feed(&parser, content, strlen(content)) != ESP_OK ||
+			app_profile_parser_finish(&parser) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	memcpy(profile, &parsed, sizeof *profile);
+	_log_profile(profile);
 	return ESP_OK;
 }
 
@@ -199,9 +231,13 @@ void app_client_set_player_state(sound_player_t *player, app_client_profile_t *p
 				player->state != GETTER_HALT) {
 			player->state = GETTER_HALT;
 		}
+		/* The saved position belongs to the previous track */
+		player->resume_pos = 0;
 	} else {
 		if (profile->is_player && profile->track_cnt) {
-			if (player->state == GETTER_IDLE) {
+			/* A track played to its end whose acknowledgement is kept is not played again */
+			if (	player->state == GETTER_IDLE &&
+					!app_outbox_has(OUTBOX_TRACK_DONE, &profile->track_id)) {
 				player->state = GETTER_STARTING;
 			} else if (player->state == GETTER_PAUSE) {
 				player->state = GETTER_ACTIVE;
@@ -219,6 +255,25 @@ void app_client_set_player_state(sound_player_t *player, app_client_profile_t *p
 	memcpy(player->pend_tr_id.b, profile->track_id.b, UUID_SIZE);
 }
 
+/**
+ * @ingroup	app_client_utils
+ * Apply the profile saved before the restart
+ */
+esp_err_t app_client_resume(sound_player_t *player, app_client_profile_t *profile) {
+	app_resume_state_t state;
+	if (app_resume_load(&state) != ESP_OK) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	memcpy(profile, &state.profile, sizeof *profile);
+	profile->is_recorder = pdFALSE;
+	xSemaphoreTake(player->semphr, portMAX_DELAY);
+	/* The player is idle, the track is only noted */
+	app_client_set_player_state(player, profile);
+	player->resume_pos = state.play_pos;
+	xSemaphoreGive(player->semphr);
+	return ESP_OK;
+}
+
 /**
  * @ingroup	app_client_utils
  * Change the state of the recorder in accordance with the current
@@ -235,15 +290,22 @@ void app_client_set_sampler_state(sound_recorder_t *sampler, app_client_profile_
 			sampler->state = SAMPLER_HALT;
 		}
 	}
+	/* Capture profile control node */
+	if (sound_recorder_request_profile(sampler, &profile->rec_cfg) != ESP_OK) {
+		ESP_LOGD(tag, "Unsupported capture profile: %u Hz, %u x %u DMA, %u bytes",
+						(unsigned int)profile->rec_cfg.sample_rate,
+						(unsigned int)profile->rec_cfg.dma_buf_count,
+						(unsigned int)profile->rec_cfg.dma_buf_len,
+						(unsigned int)profile->rec_cfg.block_size);
+	}
 }
 
 /**
  * @ingroup	app_client_utils
- * Suspend execution of all current media tasks
+ * Suspend the sound player only
  */
-void app_client_halt_media_tasks(void *arg) {
+void app_client_halt_player(void *arg) {
 	app_client_func_t *client = (app_client_func_t *)arg;
-	/* Stop the player */
 	xSemaphoreTake(client->player.semphr, portMAX_DELAY);
 	if (	client->player.state != GETTER_IDLE &&
 			client->player.state != GETTER_HALT) {
@@ -253,6 +315,16 @@ void app_client_halt_media_tasks(void *arg) {
 	while (client->player.state != GETTER_IDLE) {
 		vTaskDelay(pdMS_TO_TICKS(100));
 	}
+}
+
+/**
+ * @ingroup	app_client_utils
+ * Suspend execution of all current media tasks
+ */
+void app_client_halt_media_tasks(void *arg) {
+	app_client_func_t *client = (app_client_func_t *)arg;
+	/* Stop the player */
+	app_client_halt_player(client);
 	/* Stop the sampler */
 	xSemaphoreTake(client->sampler.semphr, portMAX_DELAY);
 	if (	client->sampler.state != SAMPLER_IDLE &&
@@ -267,3 +339,27 @@ void app_client_halt_media_tasks(void *arg) {
 	gpio_set_level(PIN_NUM_USER_LED, 0);
 	client->led_tracker = pdFALSE;
 }
+
+/**
+ * @ingroup	app_client_utils
+ * HTTP client event handler of the profile requests
+ */
+esp_err_t app_client_profile_event_handler(esp_http_client_event_t *evt) {
+	app_client_poll_t *poll = (app_client_poll_t *)evt->user_data;
+	if (evt->event_id != HTTP_EVENT_ON_HEADER || !poll) {
+		return ESP_OK;
+	}
+	app_http_reader_on_header(&poll->reader, evt);
+	if (poll->conn) {
+		app_http_conn_on_header(poll->conn, evt);
+	}
+	if (!strcasecmp(evt->header_key, "ETag")) {
+		strlcpy(poll->etag_rx, evt->header_value, sizeof poll->etag_rx);
+	} else if (!strcasecmp(evt->header_key, "Content-Type")) {
+		poll->is_cbor = strstr(evt->header_value, APP_CBOR_CONTENT_TYPE) ? pdTRUE : pdFALSE;
+	} else if (	!strcasecmp(evt->header_key, "Preference-Applied") &&
+				strstr(evt->header_value, "wait")) {
+		poll->is_applied = pdTRUE;
+	}
+	return ESP_OK;
+}
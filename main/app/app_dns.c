@@ -0,0 +1,282 @@
+/**
+ * *****************************************************************************
+ * @file		app_dns.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Resolution of the work and upgrade server names ahead of the requests
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+
+/* User files */
+#include "app.h"
+#include "app_dns.h"
+#include "app_wifi.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_dns";
+
+/* Private variables ---------------------------------------------------------*/
+
+static portMUX_TYPE dns_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_dns_entry_t dns_cache[APP_DNS_CACHE_SIZE];
+static esp_timer_handle_t dns_tim;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Find the server name of the URL. Returns false for a URL without a name,
+ * or whose host is an address already */
+static bool _split_url(const char *url, const char **host, size_t *host_len, size_t *authority_len) {
+	const char *p = strstr(url, "://");
+	if (!p) {
+		return false;
+	}
+	*host = p + 3;
+	*authority_len = strcspn(*host, "/?#");
+	*host_len = strcspn(*host, ":/?#");
+	if (!*host_len || *host_len >= APP_DNS_HOST_SIZE) {
+		return false;
+	}
+	return strspn(*host, "0123456789.") < *host_len;
+}
+
+/* Find the entry of a server name, a free entry is taken for a new one */
+static app_dns_entry_t *_get_entry(const char *host, size_t host_len) {
+	app_dns_entry_t *entry = NULL;
+	portENTER_CRITICAL(&dns_lock);
+	for (int i = 0; i < APP_DNS_CACHE_SIZE; ++i) {
+		if (!dns_cache[i].host[0]) {
+			entry = entry ? entry : &dns_cache[i];
+		} else if (!strncasecmp(dns_cache[i].host, host, host_len) && !dns_cache[i].host[host_len]) {
+			entry = &dns_cache[i];
+			break;
+		}
+	}
+	if (entry && !entry->host[0]) {
+		memcpy(entry->host, host, host_len);
+		entry->host[host_len] = '\0';
+	}
+	portEXIT_CRITICAL(&dns_lock);
+	if (!entry) {
+		ESP_LOGW(tag, "No room for the server name %.*s", (int)host_len, host);
+	}
+	return entry;
+}
+
+/* Store the result of a lookup, called in the lwIP thread */
+static void _lookup_done(const char *name, const ip_addr_t *ipaddr, void *arg) {
+	app_dns_entry_t *entry = (app_dns_entry_t *)arg;
+	portENTER_CRITICAL(&dns_lock);
+	if (ipaddr) {
+		entry->addr = *ipaddr;
+		entry->is_valid = true;
+	}
+	entry->is_failed = !ipaddr;
+	entry->is_pending = false;
+	portEXIT_CRITICAL(&dns_lock);
+}
+
+/* Start a lookup, called in the lwIP thread. The answer comes from the lwIP table
+ * while its TTL has not expired */
+static void _lookup_start(void *arg) {
+	app_dns_entry_t *entry = (app_dns_entry_t *)arg;
+	ip_addr_t addr;
+	err_t err = dns_gethostbyname(entry->host, &addr, _lookup_done, entry);
+	if (err == ERR_OK) {
+		_lookup_done(entry->host, &addr, entry);
+	} else if (err != ERR_INPROGRESS) {
+		_lookup_done(entry->host, NULL, entry);
+	}
+}
+
+/* Post a lookup to the lwIP thread, unless one is in progress */
+static void _lookup(app_dns_entry_t *entry) {
+	portENTER_CRITICAL(&dns_lock);
+	bool is_pending = entry->is_pending;
+	entry->is_pending = true;
+	portEXIT_CRITICAL(&dns_lock);
+	if (!is_pending && tcpip_callback(_lookup_start, entry) != ERR_OK) {
+		_lookup_done(entry->host, NULL, entry);
+	}
+}
+
+/* Look the names up again, so that they stay in the lwIP table */
+static void _refresh_timer_callback(void *arg) {
+	if (!(xEventGroupGetBits(app_instance.event_group) & BIT_STA_CONNECTED)) {
+		return;
+	}
+	/* A name may be written by _get_entry meanwhile, the taken entries are listed first */
+	app_dns_entry_t *entries[APP_DNS_CACHE_SIZE];
+	int count = 0;
+	portENTER_CRITICAL(&dns_lock);
+	for (int i = 0; i < APP_DNS_CACHE_SIZE; ++i) {
+		if (dns_cache[i].host[0]) {
+			entries[count++] = &dns_cache[i];
+		}
+	}
+	portEXIT_CRITICAL(&dns_lock);
+	for (int i = 0; i < count; ++i) {
+		_lookup(entries[i]);
+	}
+}
+
+/* Resolve the name, returns false if the last known address has to be used */
+static bool _resolve(app_dns_entry_t *entry, ip_addr_t *addr) {
+	bool is_pending = true, is_failed = false, is_valid = false;
+	_lookup(entry);
+	for (int waited = 0; waited < APP_DNS_WAIT_MS; waited += 10) {
+		portENTER_CRITICAL(&dns_lock);
+		is_pending = entry->is_pending;
+		is_failed = entry->is_failed;
+		is_valid = entry->is_valid;
+		*addr = entry->addr;
+		portEXIT_CRITICAL(&dns_lock);
+		if (!is_pending) {
+			break;
+		}
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+	return !is_valid || (!is_pending && !is_failed);
+}
+
+/* Create an HTTP client, the server name is followed if client is not NULL */
+static esp_http_client_handle_t _client_init(app_dns_client_t *client, const esp_http_client_config_t *cfg) {
+	const char *host;
+	size_t host_len, authority_len;
+	bool is_http = !strncasecmp(cfg->url, "http://", 7);
+	if (client) {
+		memset(client, 0, sizeof *client);
+		client->is_http = is_http;
+	}
+	if (!_split_url(cfg->url, &host, &host_len, &authority_len)) {
+		return esp_http_client_init(cfg);
+	}
+	app_dns_entry_t *entry = _get_entry(host, host_len);
+	if (client) {
+		client->entry = entry;
+	}
+	if (!entry) {
+		return esp_http_client_init(cfg);
+	}
+	if (!is_http) {
+		/* The address cannot stand in for the name of a TLS server, the name is only
+		 * kept resolved */
+		_lookup(entry);
+		return esp_http_client_init(cfg);
+	}
+	ip_addr_t addr;
+	if (_resolve(entry, &addr)) {
+		if (client) {
+			client->addr = addr;
+		}
+		return esp_http_client_init(cfg);
+	}
+	char ip[IPADDR_STRLEN_MAX];
+	char url[strlen(cfg->url) + sizeof ip];
+	char authority[authority_len + 1];
+	ipaddr_ntoa_r(&addr, ip, sizeof ip);
+	snprintf(url, sizeof url, "http://%s%s", ip, host + host_len);
+	memcpy(authority, host, authority_len);
+	authority[authority_len] = '\0';
+	ESP_LOGW(tag, "%s is not resolved, using the last known address %s", entry->host, ip);
+	esp_http_client_config_t addr_cfg = *cfg;
+	addr_cfg.url = url;
+	esp_http_client_handle_t hdl = esp_http_client_init(&addr_cfg);
+	if (hdl) {
+		esp_http_client_set_header(hdl, "Host", authority);
+	}
+	if (client) {
+		client->addr = addr;
+		client->is_addr_url = true;
+	}
+	return hdl;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Start the background lookups */
+void app_dns_init(void) {
+	const esp_timer_create_args_t timer_args = {
+			.callback = &_refresh_timer_callback,
+			.name = "dns",
+	};
+	if (esp_timer_create(&timer_args, &dns_tim) == ESP_OK) {
+		esp_timer_start_periodic(dns_tim, APP_DNS_REFRESH_MS * 1000ULL);
+	}
+}
+
+/* Start resolving the server name of the URL */
+void app_dns_prefetch(const char *url) {
+	const char *host;
+	size_t host_len, authority_len;
+	if (!_split_url(url, &host, &host_len, &authority_len)) {
+		return;
+	}
+	app_dns_entry_t *entry = _get_entry(host, host_len);
+	if (entry) {
+		_lookup(entry);
+	}
+}
+
+/* Create an HTTP client */
+esp_http_client_handle_t app_dns_client_init(const esp_http_client_config_t *cfg) {
+	return _client_init(NULL, cfg);
+}
+
+/* Create a long-lived HTTP client */
+esp_http_client_handle_t app_dns_client_init_kept(app_dns_client_t *client, const esp_http_client_config_t *cfg) {
+	return _client_init(client, cfg);
+}
+
+/* Compare the address of a long-lived client with the background lookups */
+app_dns_change_e app_dns_client_check(app_dns_client_t *client, bool is_connected) {
+	if (!client->entry) {
+		return APP_DNS_UNCHANGED;
+	}
+	portENTER_CRITICAL(&dns_lock);
+	bool is_valid = client->entry->is_valid;
+	bool is_failed = client->entry->is_failed;
+	bool is_resolved = is_valid && !is_failed && !client->entry->is_pending;
+	ip_addr_t addr = client->entry->addr;
+	portEXIT_CRITICAL(&dns_lock);
+	if (client->is_addr_url) {
+		/* The name is back, the client goes to the server by name again */
+		return is_resolved ? APP_DNS_REBUILD : APP_DNS_UNCHANGED;
+	}
+	if (!is_valid) {
+		return APP_DNS_UNCHANGED;
+	}
+	if (!is_resolved) {
+		/* The next connection would wait for the name in vain */
+		return client->is_http && !is_connected && is_failed ? APP_DNS_REBUILD : APP_DNS_UNCHANGED;
+	}
+	if (ip_addr_isany_val(client->addr)) {
+		client->addr = addr;
+		return APP_DNS_UNCHANGED;
+	}
+	if (!ip_addr_cmp(&client->addr, &addr)) {
+		char ip[IPADDR_STRLEN_MAX];
+		ESP_LOGI(tag, "%s has moved to %s", client->entry->host, ipaddr_ntoa_r(&addr, ip, sizeof ip));
+		client->addr = addr;
+		return APP_DNS_MOVED;
+	}
+	return APP_DNS_UNCHANGED;
+}
@@ -0,0 +1,158 @@
+/**
+ * *****************************************************************************
+ * @file		app_http_conn.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Persistent connections of the repeated work server requests
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <string.h>
+#include <strings.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+/* User files */
+#include "app_dns.h"
+#include "app_http_conn.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_http_conn";
+
+/* Private variables ---------------------------------------------------------*/
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_http_conn_stats_t stats;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Count a request that has received its headers */
+static void _count(bool is_reused, bool is_stale, int64_t connect_us) {
+	portENTER_CRITICAL(&stats_lock);
+	stats.reused_cnt += is_reused ? 1 : 0;
+	stats.new_cnt += is_reused ? 0 : 1;
+	stats.stale_cnt += is_stale ? 1 : 0;
+	stats.connect_us += connect_us;
+	portEXIT_CRITICAL(&stats_lock);
+}
+
+/* Create the handle from the configuration and set the request headers */
+static esp_http_client_handle_t _create(app_http_conn_t *conn) {
+	app_dns_client_t dns;
+	esp_http_client_handle_t hdl = app_dns_client_init_kept(&dns, &conn->cfg);
+	if (!hdl) {
+		return NULL;
+	}
+	conn->dns = dns;
+	for (int i = 0; i < APP_HTTP_CONN_HEADERS && conn->headers[i][0]; ++i) {
+		esp_http_client_set_header(hdl, conn->headers[i][0], conn->headers[i][1]);
+	}
+	return hdl;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Create the handle of the connection */
+esp_err_t app_http_conn_init(app_http_conn_t *conn, const esp_http_client_config_t *cfg) {
+	memset(conn, 0, sizeof *conn);
+	conn->cfg = *cfg;
+	conn->hdl = _create(conn);
+	return conn->hdl ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* Set a header of every request */
+esp_err_t app_http_conn_set_header(app_http_conn_t *conn, const char *key, const char *value) {
+	for (int i = 0; i < APP_HTTP_CONN_HEADERS; ++i) {
+		if (!conn->headers[i][0] || !strcasecmp(conn->headers[i][0], key)) {
+			conn->headers[i][0] = key;
+			conn->headers[i][1] = value;
+			return esp_http_client_set_header(conn->hdl, key, value);
+		}
+	}
+	return ESP_ERR_NO_MEM;
+}
+
+/* Follow a change of the server address */
+void app_http_conn_follow(app_http_conn_t *conn) {
+	esp_http_client_handle_t hdl;
+	switch (app_dns_client_check(&conn->dns, conn->is_kept)) {
+	case APP_DNS_MOVED:
+		/* The kept connection leads to the old address */
+		conn->is_kept = false;
+		esp_http_client_close(conn->hdl);
+		break;
+	case APP_DNS_REBUILD:
+		/* The old handle is kept if there is no memory for the new one */
+		if ((hdl = _create(conn))) {
+			esp_http_client_cleanup(conn->hdl);
+			conn->hdl = hdl;
+			conn->is_kept = false;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* Send a request and receive the response headers */
+int32_t app_http_conn_request(app_http_conn_t *conn) {
+	bool is_stale = false;
+	conn->is_closing = false;
+	for (;;) {
+		bool is_reused = conn->is_kept;
+		int64_t start = esp_timer_get_time();
+		int32_t data_len = ESP_FAIL;
+		conn->is_kept = false;
+		/* The client skips the connect while its connection is open */
+		if (esp_http_client_open(conn->hdl, 0) == ESP_OK) {
+			data_len = esp_http_client_fetch_headers(conn->hdl);
+		}
+		if (data_len >= 0) {
+			_count(is_reused, is_stale, is_reused ? 0 : esp_timer_get_time() - start);
+			return data_len;
+		}
+		esp_http_client_close(conn->hdl);
+		if (!is_reused) {
+			return ESP_FAIL;
+		}
+		/* The server has dropped the idle connection, the request is repeated once */
+		ESP_LOGD(tag, "Kept connection is closed, reconnecting");
+		is_stale = true;
+	}
+}
+
+/* Pick up the Connection header of the response */
+void app_http_conn_on_header(app_http_conn_t *conn, const esp_http_client_event_t *evt) {
+	if (	evt->event_id == HTTP_EVENT_ON_HEADER &&
+			!strcasecmp(evt->header_key, "Connection")) {
+		conn->is_closing = !strcasecmp(evt->header_value, "close");
+	}
+}
+
+/* Finish the response */
+void app_http_conn_done(app_http_conn_t *conn, bool is_drained) {
+	/* Unread body bytes would be taken for the next response */
+	if (is_drained && !conn->is_closing) {
+		conn->is_kept = true;
+		return;
+	}
+	conn->is_kept = false;
+	esp_http_client_close(conn->hdl);
+}
+
+/* Take the statistics gathered since the previous call */
+void app_http_conn_take_stats(app_http_conn_stats_t *out) {
+	portENTER_CRITICAL(&stats_lock);
+	memcpy(out, &stats, sizeof *out);
+	memset(&stats, 0, sizeof stats);
+	portEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,288 @@
+/**
+ * *****************************************************************************
+ * @file		app_http_reader.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Reader of the work server response bodies, transparently inflates
+ * 				the gzip content encoding
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+/* Framework */
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp32/rom/crc.h>
+#include <esp32/rom/miniz.h>
+
+/* User files */
+#include "app.h"
+#include "app_http_reader.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_http_reader";
+
+/* gzip member header (RFC 1952) */
+#define GZIP_ID1			0x1F
+#define GZIP_ID2			0x8B
+#define GZIP_CM_DEFLATE		8
+#define GZIP_FHCRC			0x02
+#define GZIP_FEXTRA			0x04
+#define GZIP_FNAME			0x08
+#define GZIP_FCOMMENT		0x10
+#define GZIP_FRESERVED		0xE0
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Allocate a buffer in PSRAM, in the internal memory if there is no PSRAM */
+static void *_alloc(size_t size) {
+	void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+	return ptr ? ptr : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+/* Tell whether more of the body is to be received. A chunked body has no length, it ends
+ * with its last chunk */
+static bool _has_more(const app_http_reader_t *reader) {
+	if (reader->is_chunked) {
+		return !reader->is_eof && !esp_http_client_is_complete_data_received(reader->hdl);
+	}
+	return reader->remaining > 0;
+}
+
+/* Receive the next piece of the body as it is on the wire */
+static int _recv(app_http_reader_t *reader, char *buf, size_t len) {
+	int ret = esp_http_client_read(	reader->hdl,
+									buf,
+									reader->is_chunked ? (int)len : MIN(reader->remaining, (int32_t)len));
+	if (ret > 0) {
+		reader->remaining -= reader->is_chunked ? 0 : ret;
+		reader->wire_bytes += ret;
+	} else if (ret == 0 && reader->is_chunked) {
+		reader->is_eof = true;
+	}
+	return ret;
+}
+
+/* Receive the next piece of the compressed body */
+static esp_err_t _fill(app_http_reader_t *reader) {
+	if (!_has_more(reader)) {
+		return ESP_FAIL;
+	}
+	int ret = _recv(reader, (char *)reader->in_buf, sizeof reader->in_buf);
+	if (ret <= 0) {
+		return ESP_FAIL;
+	}
+	reader->in_pos = 0;
+	reader->in_len = ret;
+	return ESP_OK;
+}
+
+/* Take a byte of the compressed body */
+static esp_err_t _in_byte(app_http_reader_t *reader, uint8_t *byte) {
+	if (reader->in_pos == reader->in_len && _fill(reader) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	*byte = reader->in_buf[reader->in_pos++];
+	return ESP_OK;
+}
+
+/* Take a little-endian value of the compressed body */
+static esp_err_t _in_le(app_http_reader_t *reader, size_t len, uint32_t *value) {
+	uint8_t byte;
+	*value = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (_in_byte(reader, &byte) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		*value |= (uint32_t)byte << (8 * i);
+	}
+	return ESP_OK;
+}
+
+/* Skip a null-terminated field of the gzip header */
+static esp_err_t _skip_string(app_http_reader_t *reader) {
+	uint8_t byte;
+	do {
+		if (_in_byte(reader, &byte) != ESP_OK) {
+			return ESP_FAIL;
+		}
+	} while (byte);
+	return ESP_OK;
+}
+
+/* Check the gzip header and skip its optional fields */
+static esp_err_t _read_header(app_http_reader_t *reader) {
+	uint8_t hdr[10];
+	uint32_t len;
+	for (size_t i = 0; i < sizeof hdr; ++i) {
+		if (_in_byte(reader, &hdr[i]) != ESP_OK) {
+			return ESP_FAIL;
+		}
+	}
+	if (	hdr[0] != GZIP_ID1 || hdr[1] != GZIP_ID2 || hdr[2] != GZIP_CM_DEFLATE ||
+			(hdr[3] & GZIP_FRESERVED)) {
+		return ESP_FAIL;
+	}
+	if (hdr[3] & GZIP_FEXTRA) {
+		if (_in_le(reader, 2, &len) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		while (len--) {
+			if (_in_byte(reader, &hdr[0]) != ESP_OK) {
+				return ESP_FAIL;
+			}
+		}
+	}
+	if ((hdr[3] & GZIP_FNAME) && _skip_string(reader) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	if ((hdr[3] & GZIP_FCOMMENT) && _skip_string(reader) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	if ((hdr[3] & GZIP_FHCRC) && _in_le(reader, 2, &len) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* Check the CRC-32 and the length of the inflated data against the gzip trailer */
+static esp_err_t _read_trailer(app_http_reader_t *reader) {
+	uint32_t crc, size;
+	if (_in_le(reader, 4, &crc) != ESP_OK || _in_le(reader, 4, &size) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	if (crc != reader->crc || size != reader->size) {
+		ESP_LOGW(tag, "gzip trailer mismatch");
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* Run the inflater once, the output is left in the window */
+static esp_err_t _inflate(app_http_reader_t *reader) {
+	/* The last chunk only tells the end of the body, the inflater then reports whether
+	 * the stream is complete */
+	if (	reader->in_pos == reader->in_len && _has_more(reader) &&
+			_fill(reader) != ESP_OK && !reader->is_eof) {
+		return ESP_FAIL;
+	}
+	size_t in_size = reader->in_len - reader->in_pos;
+	size_t out_size = TINFL_LZ_DICT_SIZE - reader->win_pos;
+	tinfl_status status = tinfl_decompress(	reader->inflater,
+											reader->in_buf + reader->in_pos,
+											&in_size,
+											reader->window,
+											reader->window + reader->win_pos,
+											&out_size,
+											_has_more(reader) ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+	reader->in_pos += in_size;
+	reader->out_pos = reader->win_pos;
+	reader->out_len = out_size;
+	reader->crc = crc32_le(reader->crc, reader->window + reader->win_pos, out_size);
+	reader->size += out_size;
+	reader->win_pos = (reader->win_pos + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+	if (status == TINFL_STATUS_DONE) {
+		reader->is_done = true;
+		return _read_trailer(reader);
+	}
+	return status < TINFL_STATUS_DONE ? ESP_FAIL : ESP_OK;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Prepare the reader for a new request */
+void app_http_reader_prepare(app_http_reader_t *reader, esp_http_client_handle_t hdl) {
+	reader->hdl = hdl;
+	reader->is_gzip = false;
+#if APP_API_GZIP
+	esp_http_client_set_header(hdl, "Accept-Encoding", "gzip");
+#endif	/* APP_API_GZIP */
+}
+
+/* Pick up the Content-Encoding of the response */
+void app_http_reader_on_header(app_http_reader_t *reader, const esp_http_client_event_t *evt) {
+	if (	evt->event_id == HTTP_EVENT_ON_HEADER &&
+			!strcasecmp(evt->header_key, "Content-Encoding")) {
+		reader->is_gzip = strstr(evt->header_value, "gzip") != NULL;
+	}
+}
+
+/* Start reading the body */
+esp_err_t app_http_reader_start(app_http_reader_t *reader, int32_t content_len) {
+	reader->is_chunked = esp_http_client_is_chunked_response(reader->hdl);
+	reader->is_eof = false;
+	reader->remaining = reader->is_chunked ? 0 : content_len;
+	reader->wire_bytes = 0;
+	reader->is_done = false;
+	reader->in_pos = 0;
+	reader->in_len = 0;
+	reader->out_len = 0;
+	if (!reader->is_gzip) {
+		return ESP_OK;
+	}
+	if (!reader->inflater) {
+		reader->inflater = _alloc(sizeof *reader->inflater);
+		reader->window = _alloc(TINFL_LZ_DICT_SIZE);
+		if (!reader->inflater || !reader->window) {
+			app_http_reader_deinit(reader);
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	tinfl_init(reader->inflater);
+	reader->win_pos = 0;
+	reader->crc = 0;
+	reader->size = 0;
+	return _read_header(reader);
+}
+
+/* Read the next piece of the body */
+int32_t app_http_reader_read(app_http_reader_t *reader, char *buf, size_t len) {
+	if (!reader->is_gzip) {
+		if (!_has_more(reader)) {
+			return 0;
+		}
+		int ret = _recv(reader, buf, len);
+		if (ret < 0 || (ret == 0 && !reader->is_chunked)) {
+			return -1;
+		}
+		return ret;
+	}
+	while (!reader->out_len) {
+		if (reader->is_done) {
+			return 0;
+		}
+		if (_inflate(reader) != ESP_OK) {
+			reader->is_done = true;
+			reader->out_len = 0;
+			return -1;
+		}
+	}
+	size_t n = MIN(len, reader->out_len);
+	memcpy(buf, reader->window + reader->out_pos, n);
+	reader->out_pos += n;
+	reader->out_len -= n;
+	return n;
+}
+
+/* Tell whether the body has been received to its end */
+bool app_http_reader_is_complete(const app_http_reader_t *reader) {
+	return !_has_more(reader) && (!reader->is_chunked || esp_http_client_is_complete_data_received(reader->hdl));
+}
+
+/* Release the inflater of the reader */
+void app_http_reader_deinit(app_http_reader_t *reader) {
+	heap_caps_free(reader->inflater);
+	heap_caps_free(reader->window);
+	reader->inflater = NULL;
+	reader->window = NULL;
+}
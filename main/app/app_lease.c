@@ -0,0 +1,195 @@
+/**
+ * *****************************************************************************
+ * @file		app_lease.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		DHCP leases of the access points, reused on reconnect
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <tcpip_adapter.h>
+#include <lwip/dhcp.h>
+#include <lwip/netif.h>
+#include <lwip/netifapi.h>
+
+/* User files */
+#include "app_lease.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_lease";
+
+/* Private variables ---------------------------------------------------------*/
+
+static portMUX_TYPE lease_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_lease_t leases[LEASE_CACHE_SIZE];
+static bool is_cached;	/* The address of the current connect comes from the cache */
+static bool is_raw_dhcp;	/* The DHCP client has been started past tcpip_adapter by _confirm */
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Find the lease of a BSSID, called with the lock held */
+static app_lease_t *_find(const uint8_t *bssid) {
+	for (int i = 0; i < LEASE_CACHE_SIZE; ++i) {
+		if (leases[i].bound_us && !memcmp(leases[i].bssid, bssid, sizeof leases[i].bssid)) {
+			return &leases[i];
+		}
+	}
+	return NULL;
+}
+
+/* Take the entry of a BSSID, the oldest lease is replaced. Called with the lock held */
+static app_lease_t *_alloc(const uint8_t *bssid) {
+	app_lease_t *dst = _find(bssid);
+	for (int i = 0; !dst && i < LEASE_CACHE_SIZE; ++i) {
+		if (!leases[i].bound_us) {
+			dst = &leases[i];
+		}
+	}
+	if (!dst) {
+		dst = &leases[0];
+		for (int i = 1; i < LEASE_CACHE_SIZE; ++i) {
+			if (leases[i].bound_us < dst->bound_us) {
+				dst = &leases[i];
+			}
+		}
+	}
+	memcpy(dst->bssid, bssid, sizeof dst->bssid);
+	return dst;
+}
+
+/* Lease time given by the server. The DHCP data stays allocated while the client is bound,
+ * the word is read outside of the lwIP thread */
+static uint32_t _lease_time(void) {
+	struct netif *netif = NULL;
+	if (tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) == ESP_OK && netif) {
+		struct dhcp *dhcp = netif_dhcp_data(netif);
+		if (dhcp && dhcp->offered_t0_lease) {
+			return dhcp->offered_t0_lease;
+		}
+	}
+	return LEASE_DEFAULT_S;
+}
+
+/* Confirm the lease taken from the cache. The DHCP client is started past tcpip_adapter,
+ * which would clear the address first: it works under the address in use, and binding the
+ * same address again leaves the connections open */
+static esp_err_t _confirm(void) {
+	struct netif *netif = NULL;
+	if (	tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) != ESP_OK || !netif ||
+			netifapi_dhcp_start(netif) != ERR_OK) {
+		return ESP_FAIL;
+	}
+	portENTER_CRITICAL(&lease_lock);
+	is_raw_dhcp = true;
+	portEXIT_CRITICAL(&lease_lock);
+	return ESP_OK;
+}
+
+/* Stop the DHCP client started by _confirm, which tcpip_adapter reports as stopped */
+static void _stop_raw_dhcp(void) {
+	struct netif *netif = NULL;
+	portENTER_CRITICAL(&lease_lock);
+	bool is_running = is_raw_dhcp;
+	is_raw_dhcp = false;
+	portEXIT_CRITICAL(&lease_lock);
+	if (is_running && tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) == ESP_OK && netif) {
+		netifapi_dhcp_stop(netif);
+	}
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Set up the address of the station before it connects */
+void app_lease_prepare(const wifi_sta_config_t *sta) {
+	app_lease_t lease = { 0 };
+	bool is_fresh = false;
+	if (sta->bssid_set) {
+		int64_t now = esp_timer_get_time();
+		portENTER_CRITICAL(&lease_lock);
+		app_lease_t *found = _find(sta->bssid);
+		/* Up to T1 the server is sure to keep the address */
+		if (found && now - found->bound_us < found->lease_s * 1000000LL / 2) {
+			lease = *found;
+			is_fresh = true;
+		}
+		portEXIT_CRITICAL(&lease_lock);
+	}
+	_stop_raw_dhcp();
+	tcpip_adapter_dhcp_status_t status = TCPIP_ADAPTER_DHCP_INIT;
+	tcpip_adapter_dhcpc_get_status(TCPIP_ADAPTER_IF_STA, &status);
+	is_cached = is_fresh;
+	if (!is_fresh) {
+		if (status == TCPIP_ADAPTER_DHCP_STOPPED) {
+			tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+		}
+		return;
+	}
+	if (status != TCPIP_ADAPTER_DHCP_STOPPED) {
+		tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+	}
+	/* The adapter reports the address as soon as the station is associated */
+	tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &lease.ip_info);
+	tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &lease.dns[0]);
+	tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_BACKUP, &lease.dns[1]);
+	ESP_LOGD(	tag,
+				"Reusing %s for "MACSTR,
+				ip4addr_ntoa(&lease.ip_info.ip),
+				MAC2STR(sta->bssid));
+}
+
+/* Store the lease of the current association */
+void app_lease_on_got_ip(void) {
+	if (is_cached) {
+		is_cached = false;
+		if (_confirm() != ESP_OK) {
+			ESP_LOGW(tag, "The cached lease is not confirmed");
+		}
+		return;
+	}
+	wifi_ap_record_t ap;
+	app_lease_t lease = { 0 };
+	if (	esp_wifi_sta_get_ap_info(&ap) != ESP_OK ||
+			tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &lease.ip_info) != ESP_OK) {
+		return;
+	}
+	tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &lease.dns[0]);
+	tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_BACKUP, &lease.dns[1]);
+	lease.lease_s = _lease_time();
+	lease.bound_us = esp_timer_get_time();
+	portENTER_CRITICAL(&lease_lock);
+	app_lease_t *dst = _alloc(ap.bssid);
+	memcpy(&dst->ip_info, &lease.ip_info, sizeof dst->ip_info);
+	memcpy(dst->dns, lease.dns, sizeof dst->dns);
+	dst->lease_s = lease.lease_s;
+	dst->bound_us = lease.bound_us;
+	portEXIT_CRITICAL(&lease_lock);
+}
+
+/* Let another access point of the network reuse the lease of the current one */
+void app_lease_carry(const uint8_t *bssid) {
+	wifi_ap_record_t ap;
+	if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+		return;
+	}
+	portENTER_CRITICAL(&lease_lock);
+	app_lease_t *src = _find(ap.bssid);
+	if (src) {
+		app_lease_t lease = *src;
+		app_lease_t *dst = _alloc(bssid);
+		memcpy(dst, &lease, sizeof *dst);
+		memcpy(dst->bssid, bssid, sizeof dst->bssid);
+	}
+	portEXIT_CRITICAL(&lease_lock);
+}
@@ -0,0 +1,158 @@
+/**
+ * *****************************************************************************
+ * @file		app_link.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		WiFi link quality service
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+/* User files */
+#include "app.h"
+#include "app_link.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_link";
+
+/* Private typedef -----------------------------------------------------------*/
+
+/** @brief	Subscriber of the health */
+typedef struct {
+	app_link_cb_t cb;
+	void *arg;
+} link_subscriber_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_link_model_t model;
+static link_subscriber_t subscribers[LINK_MAX_SUBSCRIBERS];
+static uint32_t bytes_acc;
+static uint16_t fail_acc;
+static esp_timer_handle_t link_tim;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Sample the link */
+static void _sample_timer_callback(void *arg) {
+	app_link_sample_t sample = {
+			.time_ms = esp_timer_get_time() / 1000,
+	};
+	wifi_ap_record_t ap;
+	if (	(xEventGroupGetBits(app_instance.event_group) & BIT_STA_CONNECTED) &&
+			esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+		sample.rssi = ap.rssi < 0 ? ap.rssi : -1;
+		sample.phy =	(ap.phy_11b ? LINK_PHY_11B : 0) |
+						(ap.phy_11g ? LINK_PHY_11G : 0) |
+						(ap.phy_11n ? LINK_PHY_11N : 0) |
+						(ap.second != WIFI_SECOND_CHAN_NONE ? LINK_PHY_HT40 : 0);
+	}
+	portENTER_CRITICAL(&link_lock);
+	sample.bytes = bytes_acc;
+	sample.fail_cnt = fail_acc;
+	bytes_acc = 0;
+	fail_acc = 0;
+	portEXIT_CRITICAL(&link_lock);
+#if LINK_TRACE
+	char line[LINK_TRACE_LINE_SIZE];
+	app_link_trace_format(&sample, line, sizeof line);
+	ESP_LOGI(tag, "%s", line);
+#endif	/* LINK_TRACE */
+	app_link_feed(&sample);
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Start sampling the link */
+esp_err_t app_link_init(void) {
+	app_link_model_init(&model);
+	const esp_timer_create_args_t timer_args = {
+			.callback = &_sample_timer_callback,
+			.name = "link",
+	};
+	if (	esp_timer_create(&timer_args, &link_tim) != ESP_OK ||
+			esp_timer_start_periodic(link_tim, LINK_SAMPLE_MS * 1000ULL) != ESP_OK) {
+		ESP_LOGE(tag, "Failed to start the link sampling");
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
+
+/* Stop sampling the link */
+void app_link_stop(void) {
+	if (link_tim) {
+		esp_timer_stop(link_tim);
+	}
+}
+
+/* Take a sample into account */
+void app_link_feed(const app_link_sample_t *sample) {
+	app_link_health_t health;
+	portENTER_CRITICAL(&link_lock);
+	app_link_model_feed(&model, sample);
+	health = model.health;
+	portEXIT_CRITICAL(&link_lock);
+	for (int i = 0; i < LINK_MAX_SUBSCRIBERS && subscribers[i].cb; ++i) {
+		subscribers[i].cb(&health, subscribers[i].arg);
+	}
+}
+
+/* Get the health of the link */
+void app_link_get(app_link_health_t *health) {
+	portENTER_CRITICAL(&link_lock);
+	*health = model.health;
+	portEXIT_CRITICAL(&link_lock);
+}
+
+/* Subscribe to the health of the link */
+esp_err_t app_link_subscribe(app_link_cb_t cb, void *arg) {
+	esp_err_t ret = ESP_ERR_NO_MEM;
+	portENTER_CRITICAL(&link_lock);
+	for (int i = 0; i < LINK_MAX_SUBSCRIBERS; ++i) {
+		if (!subscribers[i].cb) {
+			subscribers[i].arg = arg;
+			subscribers[i].cb = cb;
+		}
+		if (subscribers[i].cb == cb && subscribers[i].arg == arg) {
+			ret = ESP_OK;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&link_lock);
+	return ret;
+}
+
+/* Account the bytes of a transfer */
+void app_link_note_bytes(size_t len, bool is_waiting) {
+	if (!is_waiting) {
+		return;
+	}
+	portENTER_CRITICAL(&link_lock);
+	bytes_acc += len;
+	portEXIT_CRITICAL(&link_lock);
+}
+
+/* Account a failed transfer */
+void app_link_note_failure(void) {
+	portENTER_CRITICAL(&link_lock);
+	if (fail_acc < UINT16_MAX) {
+		++fail_acc;
+	}
+	portEXIT_CRITICAL(&link_lock);
+}
@@ -0,0 +1,125 @@
+/**
+ * *****************************************************************************
+ * @file		app_link_model.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Health model of the WiFi link and its trace format
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+/* User files */
+#include "app_link_model.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Scale a value between two bounds to 0..100 */
+static int _percent(int32_t value, int32_t low, int32_t high) {
+	if (value <= low) {
+		return 0;
+	}
+	if (value >= high) {
+		return 100;
+	}
+	return (value - low) * 100 / (high - low);
+}
+
+/* Score of the health. The signal is taken alone until a transfer has measured the
+ * goodput, the failures are a penalty of up to 50 */
+static uint8_t _score(const app_link_health_t *health) {
+	if (!health->is_up) {
+		return 0;
+	}
+	int score = _percent(health->rssi, LINK_RSSI_FLOOR, LINK_RSSI_CEIL);
+	if (health->goodput) {
+		score = (score + _percent(health->goodput, 0, LINK_GOODPUT_GOOD)) / 2;
+	}
+	score -= MIN(health->fail_avg / 4, 50);
+	return score > 0 ? score : 0;
+}
+
+/* Level of a score */
+static app_link_level_e _level(const app_link_health_t *health) {
+	if (!health->is_up) {
+		return LINK_DOWN;
+	}
+	if (health->score < LINK_SCORE_POOR) {
+		return LINK_POOR;
+	}
+	return health->score < LINK_SCORE_GOOD ? LINK_FAIR : LINK_GOOD;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Reset the model */
+void app_link_model_init(app_link_model_t *model) {
+	memset(model, 0, sizeof *model);
+}
+
+/* Take a sample into account */
+void app_link_model_feed(app_link_model_t *model, const app_link_sample_t *sample) {
+	app_link_health_t *health = &model->health;
+	int64_t elapsed_ms = model->last_ms ? sample->time_ms - model->last_ms : 0;
+	model->last_ms = sample->time_ms;
+	/* Failures are counted with the link down too, the station may be reconnecting */
+	health->fail_avg = (3 * health->fail_avg + 100 * MIN(sample->fail_cnt, LINK_FAIL_MAX)) / 4;
+	if (!sample->rssi) {
+		/* The goodput is kept, the next association is likely to the same network */
+		health->is_up = false;
+		health->rssi = 0;
+		health->phy = 0;
+	} else {
+		/* A single weak beacon does not make the link poor */
+		health->rssi = health->is_up ? (3 * health->rssi + sample->rssi) / 4 : sample->rssi;
+		health->is_up = true;
+		health->phy = sample->phy;
+		if (sample->bytes && elapsed_ms > 0) {
+			/* The flows are not always waiting for the network, so the estimate follows
+			 * the peaks and slowly forgets them */
+			uint32_t rate = (uint64_t)sample->bytes * 1000 / elapsed_ms;
+			health->goodput = MAX(rate, health->goodput - health->goodput / 8);
+		}
+	}
+	health->score = _score(health);
+	health->level = _level(health);
+}
+
+/* Format a sample as a trace line */
+int app_link_trace_format(const app_link_sample_t *sample, char *buf, size_t size) {
+	return snprintf(buf,
+					size,
+					"L,%lld,%d,%u,%u,%u",
+					(long long)sample->time_ms,
+					(int)sample->rssi,
+					(unsigned int)sample->phy,
+					(unsigned int)sample->bytes,
+					(unsigned int)sample->fail_cnt);
+}
+
+/* Parse a trace line */
+bool app_link_trace_parse(const char *line, app_link_sample_t *sample) {
+	const char *start = strstr(line, "L,");
+	long long time_ms;
+	int rssi;
+	unsigned int phy, bytes, fail_cnt;
+	if (	!start ||
+			sscanf(start, "L,%lld,%d,%u,%u,%u", &time_ms, &rssi, &phy, &bytes, &fail_cnt) != 5 ||
+			rssi < INT8_MIN || rssi > 0) {
+		return false;
+	}
+	sample->time_ms = time_ms;
+	sample->rssi = rssi;
+	sample->phy = phy;
+	sample->bytes = bytes;
+	sample->fail_cnt = MIN(fail_cnt, UINT16_MAX);
+	return true;
+}
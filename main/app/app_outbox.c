@@ -0,0 +1,183 @@
+/**
+ * *****************************************************************************
+ * @file		app_outbox.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Reports to the server kept while the station is offline
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp32/rom/crc.h>
+
+/* User files */
+#include "app.h"
+#include "app_outbox.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_outbox";
+static const char *outbox_path = "/spiffs/outbox.bin";
+
+#define OUTBOX_MAGIC		0x4f425831	/* "OBX1", changes with the entry layout */
+
+/* Private typedef -----------------------------------------------------------*/
+
+/** @brief	Saved copy of the outbox */
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	app_outbox_entry_t entries[OUTBOX_SIZE];
+	uint32_t crc;
+} outbox_copy_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static SemaphoreHandle_t outbox_mtx;
+static outbox_copy_t box;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* CRC-32 of the outbox, its magic, count and entries */
+static uint32_t _crc(const outbox_copy_t *copy) {
+	return crc32_le(0, (const uint8_t *)copy, offsetof(outbox_copy_t, crc));
+}
+
+/* Index of a report, -1 if it is not in the outbox. Called with the lock held */
+static int _find(uint8_t type, const uuid_t *key) {
+	for (int i = 0; i < (int)box.count; ++i) {
+		if (box.entries[i].type == type && !memcmp(&box.entries[i].key, key, sizeof *key)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Write the outbox to the file system. Called with the lock held */
+static esp_err_t _save(void) {
+	esp_err_t ret = ESP_FAIL;
+	box.magic = OUTBOX_MAGIC;
+	box.crc = _crc(&box);
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *file = fopen(outbox_path, "wb");
+	if (file) {
+		ret = fwrite(&box, sizeof box, 1, file) == 1 ? ESP_OK : ESP_FAIL;
+		fclose(file);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return ret;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Load the reports kept before the restart */
+esp_err_t app_outbox_init(void) {
+	outbox_mtx = xSemaphoreCreateMutex();
+	if (!outbox_mtx) {
+		return ESP_ERR_NO_MEM;
+	}
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *file = fopen(outbox_path, "rb");
+	if (file) {
+		if (fread(&box, sizeof box, 1, file) != 1) {
+			memset(&box, 0, sizeof box);
+		}
+		fclose(file);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	if (box.magic != OUTBOX_MAGIC || box.crc != _crc(&box) || box.count > OUTBOX_SIZE) {
+		memset(&box, 0, sizeof box);
+	}
+	if (box.count) {
+		ESP_LOGI(tag, "%u reports are waiting to be sent", (unsigned int)box.count);
+	}
+	return ESP_OK;
+}
+
+/* Keep a report until it is sent */
+esp_err_t app_outbox_put(app_outbox_type_e type, const uuid_t *key) {
+	esp_err_t ret = ESP_OK;
+	if (!outbox_mtx) {
+		return ESP_FAIL;
+	}
+	xSemaphoreTake(outbox_mtx, portMAX_DELAY);
+	if (_find(type, key) < 0) {
+		if (box.count == OUTBOX_SIZE) {
+			memmove(&box.entries[0], &box.entries[1], (OUTBOX_SIZE - 1) * sizeof box.entries[0]);
+			--box.count;
+		}
+		box.entries[box.count].type = type;
+		memcpy(&box.entries[box.count].key, key, sizeof *key);
+		++box.count;
+		ret = _save();
+	}
+	xSemaphoreGive(outbox_mtx);
+	if (ret != ESP_OK) {
+		ESP_LOGW(tag, "Failed to save the outbox");
+	}
+	return ret;
+}
+
+/* Check for a report */
+bool app_outbox_has(app_outbox_type_e type, const uuid_t *key) {
+	if (!outbox_mtx) {
+		return false;
+	}
+	xSemaphoreTake(outbox_mtx, portMAX_DELAY);
+	bool is_found = _find(type, key) >= 0;
+	xSemaphoreGive(outbox_mtx);
+	return is_found;
+}
+
+/* Copy the reports waiting to be sent */
+size_t app_outbox_peek(app_outbox_entry_t *entries, size_t max) {
+	if (!outbox_mtx) {
+		return 0;
+	}
+	xSemaphoreTake(outbox_mtx, portMAX_DELAY);
+	size_t count = box.count < max ? box.count : max;
+	memcpy(entries, box.entries, count * sizeof *entries);
+	xSemaphoreGive(outbox_mtx);
+	return count;
+}
+
+/* Remove the reports sent */
+void app_outbox_remove(const app_outbox_entry_t *entries, size_t count) {
+	bool is_changed = false;
+	esp_err_t ret = ESP_OK;
+	if (!outbox_mtx) {
+		return;
+	}
+	xSemaphoreTake(outbox_mtx, portMAX_DELAY);
+	for (size_t i = 0; i < count; ++i) {
+		int found = _find(entries[i].type, &entries[i].key);
+		if (found < 0) {
+			continue;
+		}
+		memmove(&box.entries[found],
+				&box.entries[found + 1],
+				(box.count - found - 1) * sizeof box.entries[0]);
+		--box.count;
+		is_changed = true;
+	}
+	if (is_changed) {
+		ret = _save();
+	}
+	xSemaphoreGive(outbox_mtx);
+	if (ret != ESP_OK) {
+		ESP_LOGW(tag, "Failed to save the outbox");
+	}
+}
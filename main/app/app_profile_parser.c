@@ -0,0 +1,559 @@
+/**
+ * *****************************************************************************
+ * @file		app_profile_parser.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Streaming parser of the device profile JSON, with a CBOR variant
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "app_cbor.h"
+#include "app_profile_parser.h"
+#include "uuid.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+/* Fields of the profile known to the parser */
+enum {
+	FIELD_ID = 0,
+	FIELD_NAME,
+	FIELD_TRACK_ID,
+	FIELD_MUTE,
+	FIELD_PLAYER,
+	FIELD_RADIO,
+	FIELD_TRACK_CNT,
+	FIELD_VOLUME,
+	FIELD_REC_PROFILE,
+	FIELD_REC_RATE,
+	FIELD_REC_DMA_CNT,
+	FIELD_REC_DMA_LEN,
+	FIELD_REC_BLOCK,
+	FIELD_COUNT,
+	FIELD_NONE = 0xFF,
+};
+
+static const char * const field_keys[FIELD_COUNT] = {
+		[FIELD_ID] = "id",
+		[FIELD_NAME] = "name",
+		[FIELD_TRACK_ID] = "currentVoiceCommandId",
+		[FIELD_MUTE] = "mute",
+		[FIELD_PLAYER] = "playerActive",
+		[FIELD_RADIO] = "radioActive",
+		[FIELD_TRACK_CNT] = "soundCnt",
+		[FIELD_VOLUME] = "volume",
+		[FIELD_REC_PROFILE] = "radioProfile",
+		[FIELD_REC_RATE] = "radioSampleRate",
+		[FIELD_REC_DMA_CNT] = "radioDmaBufCount",
+		[FIELD_REC_DMA_LEN] = "radioDmaBufLen",
+		[FIELD_REC_BLOCK] = "radioBlockSize",
+};
+
+/* Fields the profile is not valid without */
+#define REQUIRED_FIELDS		(	(1U << FIELD_ID) | (1U << FIELD_NAME) | (1U << FIELD_MUTE) |	\
+								(1U << FIELD_PLAYER) | (1U << FIELD_RADIO) |					\
+								(1U << FIELD_TRACK_CNT) | (1U << FIELD_VOLUME))
+
+#define MAX_SKIP_DEPTH		16	/*!< Deepest nesting of the skipped values */
+
+/* Kinds of the parsed values */
+typedef enum {
+	KIND_STRING = 0,
+	KIND_NULL,
+	KIND_BOOL,
+	KIND_NUMBER,
+} value_kind_e;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Check for the JSON whitespace */
+static bool _is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Check for a character of a number, true, false or null */
+static bool _is_literal(char c) {
+	return	(c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			c == '-' || c == '+' || c == '.';
+}
+
+/* Get the value of a hex digit */
+static int _hex(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/* Append a byte to the current token, longer strings are truncated */
+static void _tok_put(app_profile_parser_t *parser, uint8_t c) {
+	if (parser->tok_len < sizeof parser->tok - 1) {
+		parser->tok[parser->tok_len++] = (char)c;
+	}
+}
+
+/* Append a code point to the current token as UTF-8 */
+static void _tok_put_utf8(app_profile_parser_t *parser, uint32_t cp) {
+	if (cp < 0x80) {
+		_tok_put(parser, cp);
+	} else if (cp < 0x800) {
+		_tok_put(parser, 0xC0 | (cp >> 6));
+		_tok_put(parser, 0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		_tok_put(parser, 0xE0 | (cp >> 12));
+		_tok_put(parser, 0x80 | ((cp >> 6) & 0x3F));
+		_tok_put(parser, 0x80 | (cp & 0x3F));
+	} else {
+		_tok_put(parser, 0xF0 | (cp >> 18));
+		_tok_put(parser, 0x80 | ((cp >> 12) & 0x3F));
+		_tok_put(parser, 0x80 | ((cp >> 6) & 0x3F));
+		_tok_put(parser, 0x80 | (cp & 0x3F));
+	}
+}
+
+/* Process a byte of a string: -1 - malformed, 0 - continue, 1 - end of the string */
+static int _string_byte(app_profile_parser_t *parser, char c) {
+	if (parser->esc == 1) {
+		parser->esc = 0;
+		if (parser->high && c != 'u') {
+			return -1;
+		}
+		switch (c) {
+		case '"': case '\\': case '/': _tok_put(parser, c); break;
+		case 'b': _tok_put(parser, '\b'); break;
+		case 'f': _tok_put(parser, '\f'); break;
+		case 'n': _tok_put(parser, '\n'); break;
+		case 'r': _tok_put(parser, '\r'); break;
+		case 't': _tok_put(parser, '\t'); break;
+		case 'u': parser->esc = 2; parser->code = 0; break;
+		default: return -1;
+		}
+		return 0;
+	}
+	if (parser->esc >= 2) {
+		int h = _hex(c);
+		if (h < 0) {
+			return -1;
+		}
+		parser->code = (parser->code << 4) | h;
+		if (++parser->esc < 6) {
+			return 0;
+		}
+		parser->esc = 0;
+		if (parser->code >= 0xD800 && parser->code < 0xDC00) {
+			if (parser->high) {
+				return -1;
+			}
+			parser->high = parser->code;
+		} else if (parser->code >= 0xDC00 && parser->code < 0xE000) {
+			if (!parser->high) {
+				return -1;
+			}
+			_tok_put_utf8(parser, 0x10000 + ((uint32_t)(parser->high - 0xD800) << 10) + (parser->code - 0xDC00));
+			parser->high = 0;
+		} else {
+			if (parser->high) {
+				return -1;
+			}
+			_tok_put_utf8(parser, parser->code);
+		}
+		return 0;
+	}
+	if (c == '\\') {
+		parser->esc = 1;
+		return 0;
+	}
+	if (parser->high || (uint8_t)c < 0x20) {
+		/* A lone high surrogate or an unescaped control character */
+		return -1;
+	}
+	if (c == '"') {
+		return 1;
+	}
+	_tok_put(parser, c);
+	return 0;
+}
+
+/* Parse a JSON number, strtod of newlib may allocate memory */
+static bool _parse_number(const char *s, double *out) {
+	double val = 0;
+	int exp = 0, exp_val = 0;
+	bool is_neg = false, is_exp_neg = false;
+	if (*s == '-') {
+		is_neg = true;
+		++s;
+	}
+	if (*s < '0' || *s > '9') {
+		return false;
+	}
+	if (*s == '0') {
+		++s;
+	} else {
+		while (*s >= '0' && *s <= '9') {
+			val = val * 10 + (*s++ - '0');
+		}
+	}
+	if (*s == '.') {
+		++s;
+		if (*s < '0' || *s > '9') {
+			return false;
+		}
+		while (*s >= '0' && *s <= '9') {
+			val = val * 10 + (*s++ - '0');
+			--exp;
+		}
+	}
+	if (*s == 'e' || *s == 'E') {
+		++s;
+		if (*s == '-' || *s == '+') {
+			is_exp_neg = *s++ == '-';
+		}
+		if (*s < '0' || *s > '9') {
+			return false;
+		}
+		while (*s >= '0' && *s <= '9') {
+			if (exp_val < 400) {
+				exp_val = exp_val * 10 + (*s - '0');
+			}
+			++s;
+		}
+		exp += is_exp_neg ? -exp_val : exp_val;
+	}
+	if (*s) {
+		return false;
+	}
+	for (; exp > 0; --exp) val *= 10;
+	for (; exp < 0; ++exp) val /= 10;
+	*out = is_neg ? -val : val;
+	return true;
+}
+
+/* Convert a number to a flag, saturated as cJSON fills valueint */
+static BaseType_t _to_flag(double num) {
+	if (num >= INT_MAX) return INT_MAX;
+	if (num <= INT_MIN) return INT_MIN;
+	return (BaseType_t)num;
+}
+
+/* Store the value of the current field, a string value is kept in the token */
+static esp_err_t _store(app_profile_parser_t *parser, value_kind_e kind, double num) {
+	app_client_profile_t *profile = parser->profile;
+	parser->tok[parser->tok_len] = '\0';
+	if (parser->field != FIELD_NONE && (parser->seen & (1U << parser->field))) {
+		/* A repeated key is ignored, as cJSON_GetObjectItem finds the first one */
+		return ESP_OK;
+	}
+	switch (parser->field) {
+	case FIELD_ID:
+		if (kind != KIND_STRING) return ESP_FAIL;
+		strlcpy(profile->id, parser->tok, sizeof profile->id);
+		break;
+	case FIELD_NAME:
+		if (kind != KIND_STRING) return ESP_FAIL;
+		strlcpy(profile->name, parser->tok, sizeof profile->name);
+		break;
+	case FIELD_TRACK_ID:
+		if (kind != KIND_STRING || uuid_parse(parser->tok, &profile->track_id) != ESP_OK) {
+			memset(&profile->track_id, 0, sizeof profile->track_id);
+		}
+		break;
+	case FIELD_MUTE:
+	case FIELD_PLAYER:
+	case FIELD_RADIO:
+		if (kind != KIND_BOOL && kind != KIND_NUMBER) return ESP_FAIL;
+		if (parser->field == FIELD_MUTE) profile->is_muted = _to_flag(num);
+		else if (parser->field == FIELD_PLAYER) profile->is_player = _to_flag(num);
+		else profile->is_recorder = _to_flag(num);
+		break;
+	case FIELD_TRACK_CNT:
+	case FIELD_VOLUME:
+		if (kind != KIND_NUMBER) return ESP_FAIL;
+		if (parser->field == FIELD_TRACK_CNT) profile->track_cnt = num;
+		else profile->vol = num;
+		break;
+	case FIELD_REC_PROFILE:
+		parser->rec_base = kind == KIND_STRING ? sound_recorder_find_profile(parser->tok) : NULL;
+		break;
+	case FIELD_REC_RATE:
+	case FIELD_REC_DMA_CNT:
+	case FIELD_REC_DMA_LEN:
+	case FIELD_REC_BLOCK:
+		/* Optional overrides, unusable values are ignored */
+		if (kind == KIND_NUMBER && num >= 1 && num <= UINT32_MAX) {
+			parser->rec_over[parser->field - FIELD_REC_RATE] = (uint32_t)num;
+		}
+		break;
+	default:
+		return ESP_OK;
+	}
+	parser->seen |= 1U << parser->field;
+	return ESP_OK;
+}
+
+/* Store the value of the current field given as a JSON string or literal */
+static esp_err_t _commit(app_profile_parser_t *parser, bool is_string) {
+	value_kind_e kind = KIND_STRING;
+	double num = 0;
+	parser->tok[parser->tok_len] = '\0';
+	if (!is_string) {
+		if (!strcmp(parser->tok, "true")) {
+			kind = KIND_BOOL;
+			num = 1;
+		} else if (!strcmp(parser->tok, "false")) {
+			kind = KIND_BOOL;
+		} else if (!strcmp(parser->tok, "null")) {
+			kind = KIND_NULL;
+		} else if (_parse_number(parser->tok, &num)) {
+			kind = KIND_NUMBER;
+		} else {
+			return ESP_FAIL;
+		}
+	}
+	return _store(parser, kind, num);
+}
+
+/* Copy a CBOR string into the token, longer strings are truncated */
+static void _tok_set(app_profile_parser_t *parser, const char *str, size_t len) {
+	parser->tok_len = MIN(len, sizeof parser->tok - 1);
+	memcpy(parser->tok, str, parser->tok_len);
+}
+
+/* Find the field of the key in the token */
+static uint8_t _find_field(app_profile_parser_t *parser) {
+	parser->tok[parser->tok_len] = '\0';
+	for (uint8_t i = 0; i < FIELD_COUNT; ++i) {
+		if (!strcmp(field_keys[i], parser->tok)) {
+			return i;
+		}
+	}
+	return FIELD_NONE;
+}
+
+/* Enter an object or an array, only the unknown and repeated keys may have them as values */
+static app_profile_parser_state_e _push(app_profile_parser_t *parser, bool is_array) {
+	if (parser->depth == 1 && parser->field != FIELD_NONE && !(parser->seen & (1U << parser->field))) {
+		return PROFILE_PARSER_ERROR;
+	}
+	if (parser->depth > MAX_SKIP_DEPTH) {
+		return PROFILE_PARSER_ERROR;
+	}
+	if (is_array) {
+		parser->arrays |= 1U << parser->depth;
+	} else {
+		parser->arrays &= ~(1U << parser->depth);
+	}
+	++parser->depth;
+	parser->field = FIELD_NONE;
+	return is_array ? PROFILE_PARSER_ARRAY : PROFILE_PARSER_OBJECT;
+}
+
+/* Leave the object or the array at its closing bracket */
+static app_profile_parser_state_e _pop(app_profile_parser_t *parser, char c) {
+	bool is_array = parser->arrays & (1U << (parser->depth - 1));
+	if (c != (is_array ? ']' : '}')) {
+		return PROFILE_PARSER_ERROR;
+	}
+	return --parser->depth ? PROFILE_PARSER_NEXT : PROFILE_PARSER_DONE;
+}
+
+/* Start reading a string */
+static void _string_start(app_profile_parser_t *parser, app_profile_parser_state_e state) {
+	parser->tok_len = 0;
+	parser->esc = 0;
+	parser->high = 0;
+	parser->state = state;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Prepare the parser for a new profile */
+void app_profile_parser_init(app_profile_parser_t *parser, app_client_profile_t *profile) {
+	memset(parser, 0, sizeof *parser);
+	memset(profile, 0, sizeof *profile);
+	parser->profile = profile;
+	parser->state = PROFILE_PARSER_START;
+	parser->field = FIELD_NONE;
+}
+
+/* Feed the next piece of the profile JSON to the parser */
+esp_err_t app_profile_parser_feed(app_profile_parser_t *parser, const char *data, size_t len) {
+	for (size_t i = 0; i < len && parser->state != PROFILE_PARSER_ERROR; ++i) {
+		char c = data[i];
+		app_profile_parser_state_e next = PROFILE_PARSER_ERROR;
+		int ret;
+		switch (parser->state) {
+		case PROFILE_PARSER_START:
+			if (_is_space(c)) continue;
+			if (c == '{') {
+				parser->depth = 1;
+				parser->arrays = 0;
+				next = PROFILE_PARSER_OBJECT;
+			}
+			break;
+		case PROFILE_PARSER_OBJECT:
+		case PROFILE_PARSER_KEY_START:
+			if (_is_space(c)) continue;
+			if (c == '"') {
+				_string_start(parser, PROFILE_PARSER_KEY);
+				continue;
+			}
+			if (c == '}' && parser->state == PROFILE_PARSER_OBJECT) next = _pop(parser, c);
+			break;
+		case PROFILE_PARSER_ARRAY:
+			if (_is_space(c)) continue;
+			if (c == ']') {
+				next = _pop(parser, c);
+				break;
+			}
+			/* The character starts the first value */
+			parser->state = PROFILE_PARSER_VALUE;
+			--i;
+			continue;
+		case PROFILE_PARSER_KEY:
+			if ((ret = _string_byte(parser, c)) == 0) continue;
+			if (ret > 0) {
+				/* The keys of the nested objects are not fields of the profile */
+				parser->field = parser->depth == 1 ? _find_field(parser) : FIELD_NONE;
+				next = PROFILE_PARSER_COLON;
+			}
+			break;
+		case PROFILE_PARSER_COLON:
+			if (_is_space(c)) continue;
+			if (c == ':') next = PROFILE_PARSER_VALUE;
+			break;
+		case PROFILE_PARSER_VALUE:
+			if (_is_space(c)) continue;
+			if (c == '"') {
+				_string_start(parser, PROFILE_PARSER_STRING);
+				continue;
+			}
+			if (c == '{' || c == '[') {
+				next = _push(parser, c == '[');
+			} else if (_is_literal(c)) {
+				parser->tok_len = 0;
+				_tok_put(parser, c);
+				next = PROFILE_PARSER_LITERAL;
+			}
+			break;
+		case PROFILE_PARSER_STRING:
+			if ((ret = _string_byte(parser, c)) == 0) continue;
+			if (ret > 0 && _commit(parser, true) == ESP_OK) next = PROFILE_PARSER_NEXT;
+			break;
+		case PROFILE_PARSER_LITERAL:
+			if (_is_literal(c)) {
+				if (parser->tok_len >= sizeof parser->tok - 1) break;
+				_tok_put(parser, c);
+				continue;
+			}
+			if (_commit(parser, false) != ESP_OK) break;
+			/* The delimiter belongs to the next state */
+			parser->state = PROFILE_PARSER_NEXT;
+			--i;
+			continue;
+		case PROFILE_PARSER_NEXT:
+			if (_is_space(c)) continue;
+			if (c == ',') {
+				next = parser->arrays & (1U << (parser->depth - 1)) ? PROFILE_PARSER_VALUE : PROFILE_PARSER_KEY_START;
+			} else if (c == '}' || c == ']') {
+				next = _pop(parser, c);
+			}
+			break;
+		case PROFILE_PARSER_DONE:
+			if (_is_space(c)) continue;
+			break;
+		default:
+			break;
+		}
+		parser->state = next;
+	}
+	return parser->state == PROFILE_PARSER_ERROR ? ESP_FAIL : ESP_OK;
+}
+
+/* Complete parsing of the profile */
+esp_err_t app_profile_parser_finish(app_profile_parser_t *parser) {
+	if (parser->state != PROFILE_PARSER_DONE) {
+		return ESP_FAIL;
+	}
+	if ((parser->seen & REQUIRED_FIELDS) != REQUIRED_FIELDS) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	sound_recorder_profile_t *rec_cfg = &parser->profile->rec_cfg;
+	*rec_cfg = parser->rec_base ? *parser->rec_base : recorder_profile_default;
+	if (parser->rec_over[0]) rec_cfg->sample_rate = parser->rec_over[0];
+	if (parser->rec_over[1]) rec_cfg->dma_buf_count = parser->rec_over[1];
+	if (parser->rec_over[2]) rec_cfg->dma_buf_len = parser->rec_over[2];
+	if (parser->rec_over[3]) rec_cfg->block_size = parser->rec_over[3];
+	return ESP_OK;
+}
+
+/* Parse a profile encoded in CBOR */
+esp_err_t app_profile_parser_cbor(app_profile_parser_t *parser, const void *data, size_t len) {
+	app_cbor_reader_t reader;
+	app_cbor_item_t item;
+	const char *str;
+	app_cbor_init(&reader, data, len);
+	if (	parser->state != PROFILE_PARSER_START ||
+			app_cbor_read_head(&reader, &item) != ESP_OK ||
+			item.major != APP_CBOR_MAP) {
+		parser->state = PROFILE_PARSER_ERROR;
+		return ESP_FAIL;
+	}
+	parser->state = PROFILE_PARSER_ERROR;
+	for (uint64_t pairs = item.arg; pairs; --pairs) {
+		/* Only text keys are used by the server */
+		if (	app_cbor_read_head(&reader, &item) != ESP_OK ||
+				app_cbor_read_string(&reader, &item, &str) != ESP_OK ||
+				item.major != APP_CBOR_TEXT) {
+			return ESP_FAIL;
+		}
+		_tok_set(parser, str, item.arg);
+		parser->field = _find_field(parser);
+		if (app_cbor_read_head(&reader, &item) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		value_kind_e kind = KIND_NUMBER;
+		double num = 0;
+		if (item.major == APP_CBOR_TEXT) {
+			if (app_cbor_read_string(&reader, &item, &str) != ESP_OK) {
+				return ESP_FAIL;
+			}
+			_tok_set(parser, str, item.arg);
+			kind = KIND_STRING;
+		} else if (item.major == APP_CBOR_SIMPLE && (item.arg == APP_CBOR_FALSE || item.arg == APP_CBOR_TRUE)) {
+			kind = KIND_BOOL;
+			num = item.arg == APP_CBOR_TRUE;
+		} else if (item.major == APP_CBOR_SIMPLE && (item.arg == APP_CBOR_NULL || item.arg == APP_CBOR_UNDEFINED)) {
+			kind = KIND_NULL;
+		} else if (!app_cbor_get_number(&item, &num)) {
+			/* Byte strings, arrays, maps and tags are only allowed for the unknown keys */
+			if (parser->field != FIELD_NONE || app_cbor_skip(&reader, &item) != ESP_OK) {
+				return ESP_FAIL;
+			}
+			continue;
+		}
+		if (kind != KIND_STRING) {
+			parser->tok_len = 0;
+		}
+		if (_store(parser, kind, num) != ESP_OK) {
+			return ESP_FAIL;
+		}
+	}
+	if (reader.pos != reader.end) {
+		return ESP_FAIL;
+	}
+	parser->state = PROFILE_PARSER_DONE;
+	return ESP_OK;
+}
@@ -0,0 +1,126 @@
+/**
+ * *****************************************************************************
+ * @file		app_resume.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Last applied profile and player position, kept across restarts
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp32/rom/crc.h>
+
+/* User files */
+#include "app.h"
+#include "app_resume.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_resume";
+static const char *resume_path = "/spiffs/resume_state.bin";
+
+#define RESUME_MAGIC		0x52534d31	/* "RSM1", changes with the profile layout */
+
+/* Private typedef -----------------------------------------------------------*/
+
+/** @brief	Saved copy of the state */
+typedef struct {
+	uint32_t magic;
+	app_resume_state_t state;
+	uint32_t crc;
+} resume_copy_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static RTC_NOINIT_ATTR resume_copy_t rtc_copy;
+static resume_copy_t flash_copy;
+static int64_t flash_time;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* CRC-32 of a copy, its magic and state */
+static uint32_t _crc(const resume_copy_t *copy) {
+	return crc32_le(0, (const uint8_t *)copy, offsetof(resume_copy_t, crc));
+}
+
+/* Check a copy */
+static bool _is_valid(const resume_copy_t *copy) {
+	return copy->magic == RESUME_MAGIC && copy->crc == _crc(copy);
+}
+
+/* Write the flash copy to the file system */
+static esp_err_t _save(void) {
+	esp_err_t ret = ESP_FAIL;
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *file = fopen(resume_path, "wb");
+	if (file) {
+		ret = fwrite(&flash_copy, sizeof flash_copy, 1, file) == 1 ? ESP_OK : ESP_FAIL;
+		fclose(file);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return ret;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Load the state saved before the restart */
+esp_err_t app_resume_load(app_resume_state_t *state) {
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *file = fopen(resume_path, "rb");
+	if (file) {
+		if (fread(&flash_copy, sizeof flash_copy, 1, file) != 1) {
+			memset(&flash_copy, 0, sizeof flash_copy);
+		}
+		fclose(file);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	/* The RTC memory holds garbage after a power-on, the CRC tells */
+	const resume_copy_t *copy = _is_valid(&rtc_copy) ? &rtc_copy : &flash_copy;
+	if (!_is_valid(copy)) {
+		memset(&flash_copy, 0, sizeof flash_copy);
+		return ESP_ERR_NOT_FOUND;
+	}
+	memcpy(state, &copy->state, sizeof *state);
+	ESP_LOGI(	tag,
+				"Resuming from the %s copy, volume %d, %s, position %u",
+				copy == &rtc_copy ? "RTC" : "flash",
+				(int)state->profile.vol,
+				state->profile.is_player ? "playing" : "stopped",
+				(unsigned int)state->play_pos);
+	return ESP_OK;
+}
+
+/* Save the last applied profile and the player position */
+void app_resume_save(const app_client_profile_t *profile, uint32_t play_pos) {
+	rtc_copy.magic = RESUME_MAGIC;
+	memcpy(&rtc_copy.state.profile, profile, sizeof rtc_copy.state.profile);
+	rtc_copy.state.play_pos = play_pos;
+	rtc_copy.crc = _crc(&rtc_copy);
+	int64_t now = esp_timer_get_time();
+	bool is_changed = memcmp(&flash_copy.state.profile, profile, sizeof *profile) != 0;
+	if (	!is_changed &&
+			(flash_copy.state.play_pos == play_pos ||
+			now - flash_time < RESUME_FLASH_PERIOD_MS * 1000LL)) {
+		return;
+	}
+	memcpy(&flash_copy, &rtc_copy, sizeof flash_copy);
+	flash_time = now;
+	if (_save() != ESP_OK) {
+		ESP_LOGW(tag, "Failed to save the state");
+	}
+}
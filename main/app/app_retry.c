@@ -0,0 +1,102 @@
+/**
+ * *****************************************************************************
+ * @file		app_retry.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Retries of the network operations with an exponential backoff
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_err.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+/* User files */
+#include "app.h"
+#include "app_retry.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Count a failed attempt and draw the delay before the next one */
+static uint32_t _next_delay_ms(app_retry_t *retry) {
+	const app_retry_policy_t *policy = retry->policy;
+	uint32_t delay_ms = policy->base_ms;
+	for (uint16_t i = 1; i < retry->attempt && delay_ms < policy->max_ms; ++i) {
+		delay_ms *= 2;
+	}
+	if (retry->attempt < UINT16_MAX) {
+		++retry->attempt;
+	}
+	if (delay_ms > policy->max_ms) {
+		delay_ms = policy->max_ms;
+	}
+	return delay_ms - esp_random() % (delay_ms / 2 + 1);
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Start counting the attempts of an operation */
+void app_retry_init(app_retry_t *retry, const app_retry_policy_t *policy) {
+	retry->policy = policy;
+	retry->attempt = 1;
+	retry->deadline = policy->deadline_ms ? esp_timer_get_time() + policy->deadline_ms * 1000LL : 0;
+}
+
+/* Note a successful attempt */
+void app_retry_reset(app_retry_t *retry) {
+	retry->attempt = 1;
+}
+
+/* Note a failed attempt and wait for the next one */
+esp_err_t app_retry_wait(app_retry_t *retry) {
+	const app_retry_policy_t *policy = retry->policy;
+	if (app_retry_is_cancelled(retry)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (policy->max_attempts && retry->attempt >= policy->max_attempts) {
+		return ESP_ERR_TIMEOUT;
+	}
+	int64_t delay_us = _next_delay_ms(retry) * 1000LL;
+	if (retry->deadline) {
+		int64_t left_us = retry->deadline - esp_timer_get_time();
+		if (left_us <= 0) {
+			return ESP_ERR_TIMEOUT;
+		}
+		/* The last attempt is made at the deadline rather than not at all */
+		delay_us = MIN(delay_us, left_us);
+	}
+	TickType_t ticks = MAX(pdMS_TO_TICKS(delay_us / 1000), 1);
+	if (!policy->cancel_bits) {
+		vTaskDelay(ticks);
+		return ESP_OK;
+	}
+	/* A disconnect wakes the task up at once instead of letting it sleep the delay out */
+	EventBits_t bits = xEventGroupWaitBits(	app_instance.event_group,
+											policy->cancel_bits,
+											pdFALSE,
+											pdFALSE,
+											ticks);
+	return bits & policy->cancel_bits ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+/* Note a failed attempt and get the time of the next one */
+int64_t app_retry_schedule(app_retry_t *retry) {
+	return esp_timer_get_time() + _next_delay_ms(retry) * 1000LL;
+}
+
+/* Check the cancel bits of the policy */
+bool app_retry_is_cancelled(const app_retry_t *retry) {
+	return	retry->policy->cancel_bits &&
+			(xEventGroupGetBits(app_instance.event_group) & retry->policy->cancel_bits);
+}
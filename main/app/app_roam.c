@@ -0,0 +1,145 @@
+/**
+ * *****************************************************************************
+ * @file		app_roam.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Roaming between the access points of the current network
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+/* User files */
+#include "app.h"
+#include "app_lease.h"
+#include "app_link.h"
+#include "app_roam.h"
+#include "app_wifi_cache.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_roam";
+
+#define ROAM_SCAN_SIZE		8	/* BSSIDs of the current SSID looked at */
+
+/* Private functions ---------------------------------------------------------*/
+
+/* The queued audio covers the reassociation, or nothing is being played */
+static bool _is_audio_covered(app_network_conn_t *app) {
+	sound_player_t *player = &app->client.player;
+	return	player->state == GETTER_IDLE ||
+			uxQueueMessagesWaiting(player->queue) >= ROAM_MIN_QUEUED;
+}
+
+/* Scan the channels for the SSID of the association. Returns true if another BSSID
+ * is stronger by the hysteresis */
+static bool _find_better(	app_network_conn_t *app,
+							const wifi_ap_record_t *cur,
+							int rssi,
+							wifi_ap_record_t *cand) {
+	wifi_scan_config_t scan_cfg = {
+			.ssid = (const uint8_t *)app->wifi_config.ssid,
+			.scan_time.active.max = ROAM_SCAN_DWELL_MS,
+	};
+	wifi_ap_record_t scan[ROAM_SCAN_SIZE];
+	uint16_t scan_num = ROAM_SCAN_SIZE;
+	if (	esp_wifi_scan_start(&scan_cfg, true) != ESP_OK ||
+			esp_wifi_scan_get_ap_records(&scan_num, scan) != ESP_OK) {
+		return false;
+	}
+	const wifi_ap_record_t *best = NULL;
+	for (int i = 0; i < scan_num; ++i) {
+		if (	memcmp(scan[i].bssid, cur->bssid, sizeof cur->bssid) &&
+				scan[i].rssi >= rssi + ROAM_HYSTERESIS_DB &&
+				(!best || scan[i].rssi > best->rssi)) {
+			best = &scan[i];
+		}
+	}
+	ESP_LOGD(tag, "Link RSSI %d, %d BSSIDs in sight", rssi, scan_num);
+	if (!best) {
+		return false;
+	}
+	memcpy(cand, best, sizeof *cand);
+	return true;
+}
+
+/* Reassociate to the candidate, the event handler reconnects with the new BSSID */
+static void _roam(app_network_conn_t *app, const wifi_ap_record_t *cand) {
+	wifi_config_t wifi_config;
+	if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) != ESP_OK) {
+		return;
+	}
+	ESP_LOGI(	tag,
+				"Roaming to "MACSTR" on channel %d, RSSI %d",
+				MAC2STR(cand->bssid),
+				cand->primary,
+				cand->rssi);
+	wifi_config.sta.bssid_set = true;
+	memcpy(wifi_config.sta.bssid, cand->bssid, sizeof wifi_config.sta.bssid);
+	wifi_config.sta.channel = cand->primary;
+	/* The access points of the network share its DHCP server */
+	app_lease_carry(cand->bssid);
+	xEventGroupSetBits(app->event_group, BIT_ROAMING);
+	esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+	esp_wifi_disconnect();
+	for (int waited = 0; waited < ROAM_CANDIDATE_MS; waited += 100) {
+		if (!(xEventGroupGetBits(app->event_group) & BIT_ROAMING)) {
+			break;
+		}
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+	if (xEventGroupGetBits(app->event_group) & BIT_STA_CONNECTED) {
+		app_wifi_cache_update(app->wifi_config.ssid, app->wifi_config.password);
+	}
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Roaming task */
+void app_roam_task(void *arg) {
+	app_network_conn_t *app = (app_network_conn_t *)arg;
+	wifi_ap_record_t cur, cand;
+	app_link_health_t health;
+	bool is_cand = false;
+	int64_t scan_time = 0, cand_time = 0, now;
+	for (;;) {
+		vTaskDelay(pdMS_TO_TICKS(ROAM_CHECK_MS));
+		EventBits_t event_bits = xEventGroupGetBits(app->event_group);
+		/* The smoothed RSSI of the link service, a single weak beacon is not a reason to leave */
+		app_link_get(&health);
+		if (	!(event_bits & BIT_STA_CONNECTED) || (event_bits & BIT_ROAMING) || !health.is_up ||
+				esp_wifi_sta_get_ap_info(&cur) != ESP_OK) {
+			is_cand = false;
+			continue;
+		}
+		now = esp_timer_get_time();
+		if (	!is_cand && health.rssi < ROAM_RSSI_WEAK &&
+				(!scan_time || now - scan_time >= ROAM_SCAN_GAP_MS * 1000LL)) {
+			scan_time = now;
+			cand_time = now;
+			is_cand = _find_better(app, &cur, health.rssi, &cand);
+		}
+		if (is_cand && now - cand_time > ROAM_CANDIDATE_MS * 1000LL) {
+			ESP_LOGD(tag, "The player queue has not filled up, roaming is cancelled");
+			is_cand = false;
+		}
+		if (is_cand && _is_audio_covered(app)) {
+			_roam(app, &cand);
+			is_cand = false;
+		}
+	}
+}
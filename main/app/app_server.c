@@ -32,11 +32,25 @@
 
 /* User files */
 #include "app.h"
+#include "app_dns.h"
+#include "app_retry.h"
 
 /* Private constants ---------------------------------------------------------*/
 
 static const char *tag = "app_server";
 
+#define REGDEV_RETRY_BASE_MS		250		/* First delay between the registration attempts */
+#define REGDEV_RETRY_MAX_MS			4000	/* Longest delay between the registration attempts */
+#define REGDEV_RETRY_DEADLINE_MS	20000	/* Time the registration request is retried for */
+
+/* Retries of the registration request, given up on a disconnect */
+static const app_retry_policy_t regdev_retry_policy = {
+		.base_ms = REGDEV_RETRY_BASE_MS,
+		.max_ms = REGDEV_RETRY_MAX_MS,
+		.deadline_ms = REGDEV_RETRY_DEADLINE_MS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
+
 /* Private variables ---------------------------------------------------------*/
 
 xTaskHandle reg_task_hdl = NULL;
@@ -229,8 +243,8 @@ static esp_err_t app_server_extract_request_params(httpd_req_t *req) {
 /* Send registration parameters to the server */
 void http_registration_task(void *arg) {
 	app_network_conn_t *ctx = (app_network_conn_t *)arg;
-	int32_t ret = -1, data_len = -1, status = -1, err_cnt = 0;
-	EventBits_t event_bits = 0;
+	int32_t ret = -1, data_len = -1, status = -1;
+	app_retry_t retry;
 	BaseType_t xReturned = pdFALSE;
 	for (;;) {
 		xEventGroupClearBits(ctx->event_group, BIT_RECONNECT);
@@ -264,27 +278,24 @@ void http_registration_task(void *arg) {
 					.method = HTTP_METHOD_POST,
 					.event_handler = _http_client_event_handler,
 			};
-			esp_http_client_handle_t tmpcli = esp_http_client_init(&cli_cfg);
+			esp_http_client_handle_t tmpcli = app_dns_client_init(&cli_cfg);
 			esp_http_client_set_post_field(tmpcli, str, strlen(str));
 			esp_http_client_set_header(tmpcli, "Content-Type", HTTPD_TYPE_JSON);
 			ESP_LOGD(tag, "Performing POST for the URL %s", (const char *)ctx->uri.regdev);
-			ret = esp_http_client_open(tmpcli, strlen(str));
-			if (ret != ESP_OK) {
-				while (ret != ESP_OK) {
-					vTaskDelay(1);
-					++err_cnt;
-					event_bits = xEventGroupGetBits(ctx->event_group);
-					if (err_cnt > 99 || (event_bits & BIT_STA_DISCONNECTED)) {
-						break;
-					}
-					ret = esp_http_client_open(tmpcli, strlen(str));
+			app_retry_init(&retry, &regdev_retry_policy);
+			while ((ret = esp_http_client_open(tmpcli, strlen(str))) != ESP_OK) {
+				if (app_retry_wait(&retry) != ESP_OK) {
+					break;
 				}
-			} else {
+			}
+			if (ret == ESP_OK) {
+				/* The body goes out whichever attempt has opened the connection */
 				esp_http_client_write(tmpcli, str, strlen(str));
 			}
 			cJSON_Delete(root);
 			free(client_token);
-			if (err_cnt > 99 || (event_bits & BIT_STA_DISCONNECTED)) {
+			if (ret != ESP_OK) {
+				esp_http_client_cleanup(tmpcli);
 				break;
 			}
 			data_len = esp_http_client_fetch_headers(tmpcli);
@@ -20,10 +20,17 @@
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
 #include <cJSON.h>
 
 /* User files */
+#include "app_boot.h"
+#include "app_cbor.h"
+#include "app_dns.h"
+#include "app_http_reader.h"
+#include "app_retry.h"
 #include "app_update.h"
+#include "app_wifi.h"
 
 /* Private constants ---------------------------------------------------------*/
 
@@ -32,6 +39,19 @@ static const char *tag = "app_update";
 #define BUF_LEN					1024
 #define MAX_JSON_BUF			2048
 #define MAX_ATTEMPTS_ALLOC_BUF	10
+#define UPDATE_INFO_TIMEOUT_MS	5000			/* Network timeout of the version request */
+#define UPDATE_INFO_ATTEMPTS	3				/* Connection attempts of the version request */
+#define UPDATE_INFO_RETRY_MS	1000			/* First delay between the attempts */
+#define UPDATE_CHECK_WAIT_MS	(60 * 1000)		/* Longest wait for the first profile */
+#define UPDATE_CHECK_SETTLE_MS	(10 * 1000)		/* Time left to the first track to buffer */
+
+/* Retries of the version request, the check waits for the next start on a disconnect */
+static const app_retry_policy_t info_retry_policy = {
+		.base_ms = UPDATE_INFO_RETRY_MS,
+		.max_ms = UPDATE_INFO_RETRY_MS * 4,
+		.max_attempts = UPDATE_INFO_ATTEMPTS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
 
 /* Private typedef -----------------------------------------------------------*/
 
@@ -50,11 +70,17 @@ typedef struct {
 
 static upgrade_struct_t upgrade;
 
+typedef struct {
+	bool is_cbor;
+	app_http_reader_t reader;
+} update_info_rx_t;
+
 /* Private functions prototypes ----------------------------------------------*/
 
 static void _check_version_and_update(app_network_conn_t *app, char *ver, char *url);
 static void _get_update_info(char *info_url);
 static void http_device_update_task(void *arg);
+static void _update_check_task(void *arg);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -96,54 +122,154 @@ void _check_version_and_update(app_network_conn_t *app, char *ver, char *url) {
 							1);
 }
 
+/* Pick up the encodings of the firmware version response */
+static esp_err_t _update_info_event_handler(esp_http_client_event_t *evt) {
+	update_info_rx_t *rx = (update_info_rx_t *)evt->user_data;
+	app_http_reader_on_header(&rx->reader, evt);
+	if (evt->event_id == HTTP_EVENT_ON_HEADER && !strcasecmp(evt->header_key, "Content-Type")) {
+		rx->is_cbor = strstr(evt->header_value, APP_CBOR_CONTENT_TYPE) != NULL;
+	}
+	return ESP_OK;
+}
+
+/* Get the version and the URL of the firmware from a CBOR map */
+static esp_err_t _parse_update_info_cbor(const char *buf, size_t len, char *version, char *url) {
+	app_cbor_reader_t reader;
+	app_cbor_item_t item;
+	const char *key, *str;
+	app_cbor_init(&reader, buf, len);
+	if (app_cbor_read_head(&reader, &item) != ESP_OK || item.major != APP_CBOR_MAP) {
+		return ESP_FAIL;
+	}
+	version[0] = '\0';
+	url[0] = '\0';
+	for (uint64_t pairs = item.arg; pairs; --pairs) {
+		if (	app_cbor_read_head(&reader, &item) != ESP_OK ||
+				item.major != APP_CBOR_TEXT ||
+				app_cbor_read_string(&reader, &item, &key) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		size_t key_len = item.arg;
+		if (app_cbor_read_head(&reader, &item) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		if (item.major != APP_CBOR_TEXT) {
+			if (app_cbor_skip(&reader, &item) != ESP_OK) {
+				return ESP_FAIL;
+			}
+			continue;
+		}
+		if (app_cbor_read_string(&reader, &item, &str) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		if (key_len == 3 && !strncmp(key, "url", 3) && item.arg <= MAX_FIRMWARE_UPGRADE_URL_LENGTH) {
+			memcpy(url, str, item.arg);
+			url[item.arg] = '\0';
+		} else if (key_len == 7 && !strncmp(key, "version", 7) && item.arg <= MAX_FIRMWARE_UPGRADE_VERSION_LENGTH) {
+			memcpy(version, str, item.arg);
+			version[item.arg] = '\0';
+		}
+	}
+	return version[0] && url[0] ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
 static void _get_update_info(char *info_url) {
 	esp_err_t err;
+	update_info_rx_t rx = { 0 };
 	ESP_LOGI(tag, "Checking for updates");
 	esp_http_client_config_t http_client_config = {
 			.url = info_url,
 			.method = HTTP_METHOD_GET,
+			.event_handler = _update_info_event_handler,
+			.user_data = &rx,
+			.timeout_ms = UPDATE_INFO_TIMEOUT_MS,
 	};
-	esp_http_client_handle_t http_client = esp_http_client_init(&http_client_config);
-	esp_http_client_set_header(http_client, "Accept", "application/json");
-	err = esp_http_client_open(http_client, 0);
-	if (err != ESP_OK) {
-		while (err != ESP_OK) {
-			err = esp_http_client_open(http_client, 0);
+	esp_http_client_handle_t http_client = app_dns_client_init(&http_client_config);
+	if (!http_client) {
+		return;
+	}
+	esp_http_client_set_header(http_client, "Accept", APP_API_ACCEPT);
+	app_http_reader_prepare(&rx.reader, http_client);
+	app_retry_t retry;
+	app_retry_init(&retry, &info_retry_policy);
+	while ((err = esp_http_client_open(http_client, 0)) != ESP_OK) {
+		if (app_retry_wait(&retry) != ESP_OK) {
+			break;
 		}
 	}
+	if (err != ESP_OK) {
+		ESP_LOGW(tag, "The update server is not available (%s)", esp_err_to_name(err));
+		esp_http_client_cleanup(http_client);
+		app_http_reader_deinit(&rx.reader);
+		return;
+	}
 	int content_len = esp_http_client_fetch_headers(http_client);
 	if (content_len >= MAX_HTTP_TRANS_BUF) {
 		ESP_LOGE(tag, "The size of the received data is larger than it can be accepted. "
 				"Received data size = %d, buffer size = %d", content_len, MAX_JSON_BUF - 1);
 		esp_http_client_cleanup(http_client);
+		app_http_reader_deinit(&rx.reader);
 		return;
 	}
 	int status_code = esp_http_client_get_status_code(http_client);
 	ESP_LOGI(tag, "HTTP status code = %d, content length = %d", status_code, content_len);
 	char *buf = malloc(MAX_JSON_BUF);
+	for (int i = 1; !buf && i < MAX_ATTEMPTS_ALLOC_BUF; ++i) {
+		vTaskDelay(pdMS_TO_TICKS(10));
+		buf = malloc(MAX_JSON_BUF);
+	}
 	if (!buf) {
-		while (!buf) {
-			buf = malloc(MAX_JSON_BUF);
+		ESP_LOGE(tag, "Cannot allocate memory for the update info");
+		esp_http_client_cleanup(http_client);
+		app_http_reader_deinit(&rx.reader);
+		return;
+	}
+	/* The body may be gzip encoded, so it is read until the reader reports its end */
+	int data_read = 0, ret = -1;
+	if (app_http_reader_start(&rx.reader, content_len) == ESP_OK) {
+		while ((ret = app_http_reader_read(&rx.reader, buf + data_read, MAX_JSON_BUF - 1 - data_read)) > 0) {
+			data_read += ret;
+			if (data_read == MAX_JSON_BUF - 1) {
+				break;
+			}
 		}
 	}
-	int data_read = esp_http_client_read(http_client, buf, content_len);
 	esp_http_client_cleanup(http_client);
-	if (data_read != content_len) {
+	app_http_reader_deinit(&rx.reader);
+	if (ret != 0) {
 		free(buf);
     	return;
 	}
-	buf[content_len] = 0;
+	buf[data_read] = 0;
 	char *url = NULL;
 	char *version = NULL;
-	cJSON *json_root = cJSON_Parse(buf);
-	cJSON *json_item = cJSON_GetObjectItem(json_root, "url");
-	if (json_item != NULL) {
-		url = json_item->valuestring;
-	}
-	json_item = cJSON_GetObjectItem(json_root, "version");
-	if (json_item != NULL) {
-		version = json_item->valuestring;
+	char cbor_url[MAX_FIRMWARE_UPGRADE_URL_LENGTH + 1];
+	char cbor_version[MAX_FIRMWARE_UPGRADE_VERSION_LENGTH + 1];
+	cJSON *json_root = NULL;
+	int64_t start = esp_timer_get_time();
+	if (rx.is_cbor) {
+		if (_parse_update_info_cbor(buf, data_read, cbor_version, cbor_url) == ESP_OK) {
+			url = cbor_url;
+			version = cbor_version;
+		}
+	} else {
+		json_root = cJSON_Parse(buf);
+		cJSON *json_item = cJSON_GetObjectItem(json_root, "url");
+		if (json_item != NULL) {
+			url = json_item->valuestring;
+		}
+		json_item = cJSON_GetObjectItem(json_root, "version");
+		if (json_item != NULL) {
+			version = json_item->valuestring;
+		}
 	}
+	ESP_LOGI(	tag,
+				"Update info: %d bytes of %s%s (%d on the wire) decoded in %lld us",
+				data_read,
+				rx.is_cbor ? "CBOR" : "JSON",
+				rx.reader.is_gzip ? " gzip" : "",
+				content_len,
+				(long long)(esp_timer_get_time() - start));
 	if ((url == NULL) || (version == NULL)) {
 		ESP_LOGI(tag, "No information about the new firmware version");
 	} else {
@@ -197,7 +323,7 @@ static void http_device_update_task(void *arg) {
     	http_client_config.method = HTTP_METHOD_GET;
     }
     ESP_LOGI(tag, "Connecting to the server: %s", upgrade.url);
-    esp_http_client_handle_t client = esp_http_client_init(&http_client_config);
+    esp_http_client_handle_t client = app_dns_client_init(&http_client_config);
     if (client == NULL) {
     	ESP_LOGE(tag, "Failed to initialize HTTP connection");
     	task_fatal_error(UPGRADE_STATE_IDLE);
@@ -325,6 +451,15 @@ static void http_device_update_task(void *arg) {
     return;
 }
 
+/* Check the firmware version once the start-up traffic is over */
+static void _update_check_task(void *arg) {
+	if (app_boot_wait_ms(BOOT_STAGE_PROFILE, UPDATE_CHECK_WAIT_MS) == ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(UPDATE_CHECK_SETTLE_MS));
+	}
+	app_update_get_and_check_version();
+	vTaskDelete(NULL);
+}
+
 /* Export functions ----------------------------------------------------------*/
 
 /* Requests the current firmware version and download link for it */
@@ -332,6 +467,7 @@ void app_update_get_and_check_version() {
 	char *url = (char *)calloc(MAX_FIRMWARE_UPGRADE_URL_LENGTH + 1, sizeof(char));
 	if (url == NULL) {
 		ESP_LOGE(tag, "Cannot allocate memory for upgrade URL");
+		return;
 	}
 	app_devdesc_string_read(url, SPI_FLASH_URL_UPGRADE_ADDR_OFFSET, MAX_FIRMWARE_UPGRADE_URL_LENGTH);
 	ESP_LOGI(tag, "Firmware upgrade URL: %s", url);
@@ -342,3 +478,14 @@ void app_update_get_and_check_version() {
 #endif	/* DEVELOP_VERSION */
 	free(url);
 }
+
+/* Check the firmware version in the background */
+void app_update_check_deferred(void) {
+	xTaskCreatePinnedToCore(&_update_check_task,
+							"fw_check",
+							6144,
+							NULL,
+							2,
+							NULL,
+							0);
+}
@@ -25,13 +25,21 @@
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_partition.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
 #include <cJSON.h>
 
 /* User files */
 #include "app.h"
+#include "app_boot.h"
 #include "app_client.h"
+#include "app_dns.h"
+#include "app_roam.h"
+#include "app_http_reader.h"
+#include "app_lease.h"
+#include "app_retry.h"
 #include "app_update.h"
+#include "app_wifi_cache.h"
 #include "board_def.h"
 
 /* Export constants ----------------------------------------------------------*/
@@ -42,6 +50,14 @@ const char *wifi_ap_recs_path = "/spiffs/wifi_ap_record.csv";
 
 static const char *tag = "app_wifi";
 
+/* Retries of the login request, given up on a disconnect */
+static const app_retry_policy_t login_retry_policy = {
+		.base_ms = WIFI_LOGIN_RETRY_BASE_MS,
+		.max_ms = WIFI_LOGIN_RETRY_MAX_MS,
+		.deadline_ms = WIFI_LOGIN_DEADLINE_MS,
+		.cancel_bits = BIT_STA_DISCONNECTED,
+};
+
 /* Change the below entries to strings with the required values */
 #define SOFTAP_ESP_WIFI_SSID	"RACCOON_APSTA"
 #define SOFTAP_ESP_WIFI_PASSWD	""
@@ -63,9 +79,143 @@ static esp_err_t _exec_login_request(void *arg, int32_t *status_code);
 
 /* Dummy HTTP client event handler */
 static esp_err_t _http_client_event_handler(esp_http_client_event_t *evt) {
+	if (evt->user_data) {
+		app_http_reader_on_header((app_http_reader_t *)evt->user_data, evt);
+	}
+	return ESP_OK;
+}
+
+/* Let the station scan all the channels for any BSSID of the SSID */
+static void _sta_undirect(void) {
+	wifi_config_t wifi_config;
+	if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) == ESP_OK && wifi_config.sta.bssid_set) {
+		wifi_config.sta.bssid_set = false;
+		wifi_config.sta.channel = 0;
+		esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+	}
+}
+
+/* Join an access point, directed to the given BSSID or else to the cached one */
+static esp_err_t _sta_join(	app_network_conn_t *ctx,
+							wifi_mode_t mode,
+							const char *ssid,
+							const char *pass,
+							const wifi_ap_record_t *ap) {
+	if (mode != WIFI_MODE_STA && mode != WIFI_MODE_APSTA) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	wifi_config_t wifi_config;
+	memset(&wifi_config, 0, sizeof wifi_config);
+	strlcpy((char *)wifi_config.sta.ssid,
+			(const char *)ssid,
+			sizeof wifi_config.sta.ssid);
+	if (pass) {
+		strlcpy((char *)wifi_config.sta.password,
+				(const char *)pass,
+				sizeof wifi_config.sta.password);
+	}
+	app_wifi_cache_rec_t rec;
+	if (ap) {
+		/* The scan has just seen the access point, the connect does not scan again */
+		wifi_config.sta.bssid_set = true;
+		memcpy(wifi_config.sta.bssid, ap->bssid, sizeof wifi_config.sta.bssid);
+		wifi_config.sta.channel = ap->primary;
+	}
+	if (pass && app_wifi_cache_find(ssid, pass, &rec) == ESP_OK) {
+		/* The last association tells where to look, the scan covers one channel */
+		if (!ap && rec.channel) {
+			wifi_config.sta.bssid_set = true;
+			memcpy(wifi_config.sta.bssid, rec.bssid, sizeof wifi_config.sta.bssid);
+			wifi_config.sta.channel = rec.channel;
+		}
+		if (rec.is_pmk) {
+			/* 64 hexadecimal digits are taken by the driver as the PMK itself, they fill
+			 * the password field without a terminator */
+			static const char hex[] = "0123456789abcdef";
+			for (int i = 0; i < WIFI_CACHE_PMK_LEN; ++i) {
+				wifi_config.sta.password[2 * i] = hex[rec.pmk[i] >> 4];
+				wifi_config.sta.password[2 * i + 1] = hex[rec.pmk[i] & 0x0F];
+			}
+		}
+	}
+	app_wifi_sta_detach(ctx);
+	if (strlen(pass) == 0) {
+		ESP_LOGD(	tag,
+					"Trying to connect. SSID: %s",
+					(const char *)wifi_config.sta.ssid);
+	} else {
+		ESP_LOGD(	tag,
+					"Trying to connect. SSID: %s; password: %s",
+					(const char *)wifi_config.sta.ssid,
+					pass);
+	}
+	esp_wifi_set_mode(mode);
+	esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+	app_lease_prepare(&wifi_config.sta);
+	esp_wifi_connect();
 	return ESP_OK;
 }
 
+/* Join a saved access point and wait for the result. Returns ESP_OK once the station has
+ * got an address */
+static esp_err_t _sta_try_join(	app_network_conn_t *app,
+								const app_spiffs_ap_record_t *saved,
+								const wifi_ap_record_t *ap) {
+	memset(app->wifi_config.ssid, 0, sizeof app->wifi_config.ssid);
+	memset(app->wifi_config.password, 0, sizeof app->wifi_config.password);
+	memcpy(app->wifi_config.ssid, saved->ssid, SPIFFS_WIFI_SSID_LENGTH);
+	memcpy(app->wifi_config.password, saved->password, SPIFFS_WIFI_PASSWORD_LENGTH);
+	xEventGroupClearBits(app->event_group, BIT_RECONNECT);
+	xEventGroupSetBits(app->event_group, BIT_CHECK_PENDING);
+	_sta_join(app, WIFI_MODE_STA, app->wifi_config.ssid, app->wifi_config.password, ap);
+	app_wifi_wait_conn_attempt(app->event_group);
+	xEventGroupSetBits(app->event_group, BIT_RECONNECT);
+	if (xEventGroupGetBits(app->event_group) & BIT_CONN_TO_INTERNET_OK) {
+		xEventGroupClearBits(app->event_group, BIT_CONN_TO_INTERNET_OK);
+		return ESP_OK;
+	}
+	xEventGroupClearBits(app->event_group, BIT_CONN_TO_INTERNET_FAIL);
+	return ESP_FAIL;
+}
+
+/* Rank the saved access points found by the scan, each one is represented by the strongest
+ * BSSID of its SSID. Returns the number of the candidates */
+static int _rank_saved_aps(	const app_spiffs_ap_record_t *saved,
+							int saved_num,
+							const wifi_ap_record_t *scan,
+							int scan_num,
+							int *order,
+							wifi_ap_record_t *target) {
+	int score[saved_num];
+	int cnt = 0;
+	for (int j = 0; j < saved_num; ++j) {
+		const wifi_ap_record_t *best = NULL;
+		for (int i = 0; i < scan_num; ++i) {
+			if (	!strncmp((const char *)scan[i].ssid, (const char *)saved[j].ssid, DEFAULT_WIFI_SSID_LEN) &&
+					(!best || scan[i].rssi > best->rssi)) {
+				best = &scan[i];
+			}
+		}
+		if (!best) {
+			continue;
+		}
+		/* A reliable access point is preferred by up to 20 dB */
+		int k = cnt++;
+		int val = best->rssi + app_wifi_cache_success_rate((const char *)best->ssid) / 5;
+		while (k > 0 && score[k - 1] < val) {
+			score[k] = score[k - 1];
+			order[k] = order[k - 1];
+			target[k] = target[k - 1];
+			--k;
+		}
+		score[k] = val;
+		order[k] = j;
+		target[k] = *best;
+		ESP_LOGD(tag, "Candidate %s: RSSI %d, score %d", (const char *)best->ssid, best->rssi, val);
+	}
+	return cnt;
+}
+
 /* WiFi Event Handler */
 static esp_err_t _wifi_event_handler(void *arg, system_event_t *event) {
 	app_network_conn_t *ctx = (app_network_conn_t *)arg;
@@ -75,8 +225,11 @@ static esp_err_t _wifi_event_handler(void *arg, system_event_t *event) {
 		ESP_LOGD(	tag,
 					"Got IP: %s",
 					ip4addr_ntoa(&event->event_info.got_ip.ip_info.ip));
-		xEventGroupClearBits(ctx->event_group, BIT_STA_DISCONNECTED);
+		xEventGroupClearBits(ctx->event_group, BIT_STA_DISCONNECTED | BIT_ROAMING);
 		xEventGroupSetBits(ctx->event_group, BIT_STA_CONNECTED);
+		app_lease_on_got_ip();
+		/* The work server name is resolved while the connection is being checked */
+		app_dns_prefetch(ctx->device.server_url);
 		esp_timer_stop(ctx->tim);
 		if (event_bits & BIT_NEW_WIFI_CONF) {
 			xEventGroupClearBits(ctx->event_group, BIT_NEW_WIFI_CONF);
@@ -107,6 +260,15 @@ static esp_err_t _wifi_event_handler(void *arg, system_event_t *event) {
 		if (event_bits & BIT_RECONNECT) {
 			if (!(event_bits & BIT_CONN_CORRUPTED)) {
 				ESP_LOGD(tag, "Attempt to connect to the access point failed. Trying to reconnect");
+				if (!(event_bits & BIT_STA_CONNECTED)) {
+					/* The directed reconnect has failed, the access point may have moved */
+					xEventGroupClearBits(ctx->event_group, BIT_ROAMING);
+					_sta_undirect();
+				}
+				wifi_config_t wifi_config;
+				if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) == ESP_OK) {
+					app_lease_prepare(&wifi_config.sta);
+				}
 				esp_timer_start_once(ctx->tim, 60000000);
 				esp_wifi_connect();
 			} else {
@@ -161,9 +323,11 @@ static esp_err_t _wifi_event_handler(void *arg, system_event_t *event) {
 /* Perform the GET HTTP request to login */
 static esp_err_t _exec_login_request(void *arg, int32_t *status_code) {
 	app_network_conn_t *ctx = (app_network_conn_t *)arg;
-	int32_t ret = -1, data_len = -1, status = -1, err_cnt = 0;
-	EventBits_t event_bits = 0;
+	int32_t ret = -1, data_len = -1, status = -1;
+	app_retry_t retry;
 	static char tx_item[MAX_HTTP_RECV_BUF + 1] = { 0 };
+	app_http_reader_t reader = { 0 };
+	size_t rx_total = 0;
 	char *uri_buf = (char *)calloc(DEFAULT_HTTP_BUF_SIZE, sizeof(char));
 	if (!uri_buf) {
 		while (!uri_buf) {
@@ -185,19 +349,18 @@ static esp_err_t _exec_login_request(void *arg, int32_t *status_code) {
 			.auth_type = HTTP_AUTH_TYPE_BASIC,
 			.method = HTTP_METHOD_GET,
 			.event_handler = _http_client_event_handler,
+			.user_data = &reader,
+			.timeout_ms = WIFI_LOGIN_TIMEOUT_MS,
 	};
-	esp_http_client_handle_t tmpcli = esp_http_client_init(&client_cfg);
-	ret = esp_http_client_open(tmpcli, 0);
-	if (ret != ESP_OK) {
-		while (ret != ESP_OK) {
-			vTaskDelay(1);
-			++err_cnt;
-			event_bits = xEventGroupGetBits(ctx->event_group);
-			if (err_cnt > 99 || (event_bits & BIT_STA_DISCONNECTED)) {
-				free(uri_buf);
-				return ESP_FAIL;
-			}
-			ret = esp_http_client_open(tmpcli, 0);
+	esp_http_client_handle_t tmpcli = app_dns_client_init(&client_cfg);
+	app_http_reader_prepare(&reader, tmpcli);
+	app_retry_init(&retry, &login_retry_policy);
+	while ((ret = esp_http_client_open(tmpcli, 0)) != ESP_OK) {
+		if (app_retry_wait(&retry) != ESP_OK) {
+			esp_http_client_cleanup(tmpcli);
+			app_http_reader_deinit(&reader);
+			free(uri_buf);
+			return ESP_FAIL;
 		}
 	}
 	esp_http_client_write(tmpcli, NULL, 0);
@@ -208,13 +371,15 @@ static esp_err_t _exec_login_request(void *arg, int32_t *status_code) {
 				(const char *)uri_buf,
 				status,
 				data_len);
-	if (data_len < COMMON_RING_BUF_SIZE) {
-		while (data_len > 0) {
-			if ((ret = esp_http_client_read(tmpcli,
-											tx_item,
-											MIN(data_len, MAX_HTTP_RECV_BUF))) <= 0) {
+	if (app_http_reader_start(&reader, data_len) != ESP_OK) {
+		ESP_LOGD(tag, "Failed to start reading the login response HTTP message");
+	} else if (data_len < COMMON_RING_BUF_SIZE) {
+		/* An inflated body may be larger than the ring buffer, the excess is not logged */
+		while (rx_total + MAX_HTTP_RECV_BUF < COMMON_RING_BUF_SIZE) {
+			if ((ret = app_http_reader_read(&reader, tx_item, MAX_HTTP_RECV_BUF)) <= 0) {
 				break;
 			}
+			rx_total += ret;
 			UBaseType_t res = xRingbufferSend(	ctx->rbuf_hdl,
 												tx_item,
 												strlen(tx_item),
@@ -228,7 +393,6 @@ static esp_err_t _exec_login_request(void *arg, int32_t *status_code) {
 				}
 			}
 			memset(tx_item, 0, sizeof tx_item);
-			data_len -= ret;
 		}
 		size_t item_size;
 		char *item = (char *)xRingbufferReceiveUpTo(ctx->rbuf_hdl,
@@ -250,19 +414,14 @@ static esp_err_t _exec_login_request(void *arg, int32_t *status_code) {
 				buf = (char *)malloc(MAX_HTTP_RECV_BUF + 1);
 			}
 		}
-		while (data_len > 0) {
-			if ((ret = esp_http_client_read(tmpcli,
-											buf,
-											MIN(data_len, MAX_HTTP_RECV_BUF))) <= 0) {
-				break;
-			}
-			data_len -= ret;
+		while (app_http_reader_read(&reader, buf, MAX_HTTP_RECV_BUF) > 0) {
 		}
 		free(buf);
 		ESP_LOGD(tag, "The memory required to hold the login response HTTP message could not be allocated");
 	}
 	esp_http_client_close(tmpcli);
 	esp_http_client_cleanup(tmpcli);
+	app_http_reader_deinit(&reader);
 	free(uri_buf);
 	*status_code = status;
 	return ESP_OK;
@@ -307,6 +466,22 @@ void app_wifi_wait_conn_attempt(EventGroupHandle_t event_group) {
 						portMAX_DELAY);
 }
 
+/**
+ * @ingroup	app_wifi_init
+ * Start the network interface and the WiFi driver in station mode
+ */
+void app_wifi_radio_start(void *ctx) {
+	app_boot_begin(BOOT_STAGE_RADIO);
+	tcpip_adapter_init();
+	esp_event_loop_init(_wifi_event_handler, ctx);
+	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+	esp_wifi_init(&cfg);
+	esp_wifi_set_storage(WIFI_STORAGE_RAM);
+	esp_wifi_set_mode(WIFI_MODE_STA);
+	esp_wifi_start();
+	app_boot_done(BOOT_STAGE_RADIO);
+}
+
 /**
  * @ingroup	app_wifi_init
  * Initialize the application WiFi node
@@ -314,23 +489,21 @@ void app_wifi_wait_conn_attempt(EventGroupHandle_t event_group) {
 void app_wifi_init(void *ctx, int arg) {
 	app_network_conn_t *app = (app_network_conn_t *)ctx;
 	int32_t status = -1;
-	tcpip_adapter_init();
-	esp_event_loop_init(_wifi_event_handler, app);
 	if (arg != ESP_OK) {
 		if (arg == ESP_ERR_NOT_FOUND) {
-			app_wifi_apsta_set(SOFTAP_ESP_WIFI_SSID, SOFTAP_ESP_WIFI_PASSWD);
-			return;
+			app_wifi_switch_to_apsta();
+		} else {
+			esp_wifi_stop();
+			esp_wifi_deinit();
 		}
+		return;
 	}
 	if (strlen(app->device.server_url) == 0) {
-		app_wifi_apsta_set(SOFTAP_ESP_WIFI_SSID, SOFTAP_ESP_WIFI_PASSWD);
+		app_wifi_switch_to_apsta();
 		return;
 	}
-	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-	esp_wifi_init(&cfg);
-	esp_wifi_set_storage(WIFI_STORAGE_RAM);
-	esp_wifi_set_mode(WIFI_MODE_STA);
-	esp_wifi_start();
+	app_boot_begin(BOOT_STAGE_JOIN);
+	app_wifi_cache_load();
 	int32_t read_ret = app_spiffs_get_lines_num(wifi_ap_recs_path);
 	if (read_ret <= 0) {
 		if (read_ret == ESP_FAIL) {
@@ -361,46 +534,79 @@ void app_wifi_init(void *ctx, int arg) {
 			return;
 		}
 		ESP_LOGD(tag, "Read password: %s", (const char *)ap_saved[i].password);
-		memset(app->wifi_config.ssid, 0, sizeof app->wifi_config.ssid);
-		memset(app->wifi_config.password, 0, sizeof app->wifi_config.password);
-		strlcpy(app->wifi_config.ssid, (const char *)ap_saved[i].ssid, sizeof app->wifi_config.ssid);
-		strlcpy(app->wifi_config.password, (const char *)ap_saved[i].password, sizeof app->wifi_config.password);
-		xEventGroupClearBits(app->event_group, BIT_RECONNECT);
-		xEventGroupSetBits(app->event_group, BIT_CHECK_PENDING);
-		app_wifi_sta_join(app, WIFI_MODE_STA, app->wifi_config.ssid, app->wifi_config.password);
-		app_wifi_wait_conn_attempt(app->event_group);
-		if (xEventGroupGetBits(app->event_group) & BIT_CONN_TO_INTERNET_OK) {
-			xEventGroupSetBits(app->event_group, BIT_RECONNECT);
-			xEventGroupClearBits(app->event_group, BIT_CONN_TO_INTERNET_OK);
-			esp_err_t ret = _exec_login_request(app, &status);
-			if (ret == ESP_OK) {
-				if (status == HTTP_200) {
-					xTaskCreatePinnedToCore(&http_profile_getter_task,
-											"get_profile",
-											8192,
-											&app->client,
-											4,
-											&app->client.hdl,
-											0);
-					app_update_get_and_check_version();
-				} else if (status == 401) {
-					ESP_LOGW(tag, "Reset device settings due to 401 error");
-					app_clear_device_connection_data();
-				} else {
-					app_restart_device();
-				}
+	}
+	/* The access point of the last association is tried first, directed to its BSSID */
+	esp_err_t ret = ESP_FAIL;
+	int last = app_wifi_cache_last_used(read_ret, ap_saved);
+	if (last >= 0 && (ret = _sta_try_join(app, &ap_saved[last], NULL)) != ESP_OK) {
+		app_wifi_cache_forget_bssid(app->wifi_config.ssid);
+	}
+	if (ret != ESP_OK) {
+		/* One scan ranks all the saved access points in sight */
+		uint16_t scan_num = WIFI_RANK_SCAN_SIZE;
+		wifi_ap_record_t scan[WIFI_RANK_SCAN_SIZE];
+		int order[read_ret];
+		wifi_ap_record_t target[read_ret];
+		bool is_tried[read_ret];
+		memset(is_tried, 0, sizeof is_tried);
+		app_wifi_scan(&scan_num, scan);
+		int cnt = _rank_saved_aps(ap_saved, read_ret, scan, scan_num, order, target);
+		for (int k = 0; k < cnt && ret != ESP_OK; ++k) {
+			is_tried[order[k]] = true;
+			if ((ret = _sta_try_join(app, &ap_saved[order[k]], &target[k])) != ESP_OK) {
+				app_wifi_cache_note_failure(app->wifi_config.ssid);
+			}
+		}
+		/* A hidden access point is not matched by the scan, the rest are tried newest first */
+		for (int i = read_ret - 1; i >= 0 && ret != ESP_OK; --i) {
+			if (is_tried[i] || i == last) {
+				continue;
+			}
+			if ((ret = _sta_try_join(app, &ap_saved[i], NULL)) != ESP_OK) {
+				app_wifi_cache_note_failure(app->wifi_config.ssid);
+			}
+		}
+	}
+	if (ret == ESP_OK) {
+		app_boot_done(BOOT_STAGE_JOIN);
+		/* The profile requests carry the credentials themselves, the first one is sent
+		 * alongside the login. A refused login restarts the device anyway */
+		xTaskCreatePinnedToCore(&http_profile_getter_task,
+								"get_profile",
+								8192,
+								&app->client,
+								4,
+								&app->client.hdl,
+								0);
+		xTaskCreatePinnedToCore(&app_roam_task,
+								"wifi_roam",
+								4096,
+								app,
+								3,
+								NULL,
+								0);
+		app_boot_begin(BOOT_STAGE_LOGIN);
+		ret = _exec_login_request(app, &status);
+		if (ret == ESP_OK) {
+			if (status == HTTP_200) {
+				app_boot_done(BOOT_STAGE_LOGIN);
+				/* Once per access point the PMK is derived here, off the connect path */
+				app_wifi_cache_update(app->wifi_config.ssid, app->wifi_config.password);
+				/* The update server is asked once the first profile has been applied */
+				app_update_check_deferred();
+			} else if (status == 401) {
+				ESP_LOGW(tag, "Reset device settings due to 401 error");
+				app_clear_device_connection_data();
 			} else {
-				ESP_LOGD(	tag,
-							"Error performing GET request for the URL %s",
-							(const char *)app->uri.login);
 				app_restart_device();
 			}
-			return;
-		} else if (xEventGroupGetBits(app->event_group) & BIT_CONN_TO_INTERNET_FAIL) {
-			xEventGroupSetBits(app->event_group, BIT_RECONNECT);
-			xEventGroupClearBits(app->event_group, BIT_CONN_TO_INTERNET_FAIL);
-			continue;
+		} else {
+			ESP_LOGD(	tag,
+						"Error performing GET request for the URL %s",
+						(const char *)app->uri.login);
+			app_restart_device();
 		}
+		return;
 	}
 	ESP_LOGW(tag, "No suitable SSID exists");
 	app_wifi_switch_to_apsta();
@@ -414,35 +620,7 @@ esp_err_t app_wifi_sta_join(void *arg,
 							wifi_mode_t mode,
 							const char *ssid,
 							const char *pass) {
-	app_network_conn_t *ctx = (app_network_conn_t *)arg;
-	if (mode != WIFI_MODE_STA && mode != WIFI_MODE_APSTA) {
-		return ESP_ERR_INVALID_ARG;
-	}
-	wifi_config_t wifi_config;
-	memset(&wifi_config, 0, sizeof wifi_config);
-	strlcpy((char *)wifi_config.sta.ssid,
-			(const char *)ssid,
-			sizeof wifi_config.sta.ssid);
-	if (pass) {
-		strlcpy((char *)wifi_config.sta.password,
-				(const char *)pass,
-				sizeof wifi_config.sta.password);
-	}
-	app_wifi_sta_detach(ctx);
-	if (strlen(pass) == 0) {
-		ESP_LOGD(	tag,
-					"Trying to connect. SSID: %s",
-					(const char *)wifi_config.sta.ssid);
-	} else {
-		ESP_LOGD(	tag,
-					"Trying to connect. SSID: %s; password: %s",
-					(const char *)wifi_config.sta.ssid,
-					(const char *)wifi_config.sta.password);
-	}
-	esp_wifi_set_mode(mode);
-	esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
-	esp_wifi_connect();
-	return ESP_OK;
+	return _sta_join((app_network_conn_t *)arg, mode, ssid, pass, NULL);
 }
 
 /**
@@ -523,7 +701,7 @@ int32_t app_wifi_scan(uint16_t *ap_num, wifi_ap_record_t *ap_list_buf) {
 	esp_wifi_scan_get_ap_records(ap_num, ap_list_buf);
 	esp_wifi_scan_get_ap_num(&cnt);
 	ESP_LOGD(tag, "Total APs scanned = %d", cnt);
-	for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < cnt); ++i) {
+	for (int i = 0; i < *ap_num; ++i) {
 		ESP_LOGD(	tag,
 					"[SSID:%s][RSSI:%d][channel:%d]",
 					ap_list_buf[i].ssid,
@@ -557,6 +735,9 @@ esp_err_t app_wifi_check_if_ap_exists(	int scan_ap_num,
 /* WiFi initialization task */
 void app_wifi_init_task(void *arg) {
 	app_wifi_initializer_t *wifi_cfg = (app_wifi_initializer_t *)arg;
+	/* Most devices are configured, the station is started while the file system is mounted */
+	app_wifi_radio_start(wifi_cfg->app_ptr);
+	app_boot_wait(BOOT_STAGE_APP);
 	app_wifi_init(wifi_cfg->app_ptr, wifi_cfg->init_state);
 	vTaskDelete(NULL);
 }
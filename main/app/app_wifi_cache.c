@@ -0,0 +1,263 @@
+/**
+ * *****************************************************************************
+ * @file		app_wifi_cache.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Association parameters of the saved access points, kept to shorten
+ * 				the next connect
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdio.h>
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_wifi.h>
+#include <esp32/rom/crc.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pkcs5.h>
+
+/* User files */
+#include "app.h"
+#include "app_wifi_cache.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_wifi_cache";
+static const char *cache_path = "/spiffs/wifi_ap_cache.bin";
+
+#define WIFI_CACHE_MAGIC		0x57434132	/* "WCA2", changes with the record layout */
+#define WIFI_CACHE_PBKDF2_ROUNDS	4096
+
+/* Private typedef -----------------------------------------------------------*/
+
+/** @brief	Content of the cache file, followed by its CRC-32 */
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+	app_wifi_cache_rec_t rec[WIFI_CACHE_SIZE];
+} wifi_cache_t;
+
+/* Private variables ---------------------------------------------------------*/
+
+static wifi_cache_t cache;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* CRC-32 of a password */
+static uint32_t _pass_crc(const char *pass) {
+	return crc32_le(0, (const uint8_t *)pass, strlen(pass));
+}
+
+/* Find the record of an SSID, called with the mutex held */
+static app_wifi_cache_rec_t *_find(const char *ssid) {
+	for (int i = 0; i < WIFI_CACHE_SIZE; ++i) {
+		if (cache.rec[i].ssid[0] && !strncmp(cache.rec[i].ssid, ssid, SPIFFS_WIFI_SSID_LENGTH)) {
+			return &cache.rec[i];
+		}
+	}
+	return NULL;
+}
+
+/* Take a free record for an SSID, the least recently used one if there is none.
+ * Called with the mutex held */
+static app_wifi_cache_rec_t *_alloc(const char *ssid) {
+	app_wifi_cache_rec_t *dst = &cache.rec[0];
+	for (int i = 1; i < WIFI_CACHE_SIZE; ++i) {
+		if (cache.rec[i].seq < dst->seq) {
+			dst = &cache.rec[i];
+		}
+	}
+	memset(dst, 0, sizeof *dst);
+	strlcpy(dst->ssid, ssid, sizeof dst->ssid);
+	return dst;
+}
+
+/* Count a connect, the old history is faded out. Called with the mutex held */
+static void _count(app_wifi_cache_rec_t *rec, bool is_success) {
+	if (rec->attempt_cnt >= WIFI_CACHE_HISTORY) {
+		rec->attempt_cnt /= 2;
+		rec->success_cnt /= 2;
+	}
+	++rec->attempt_cnt;
+	rec->success_cnt += is_success ? 1 : 0;
+}
+
+/* Write the records to the file system, called with the mutex held */
+static esp_err_t _save(void) {
+	FILE *file = fopen(cache_path, "wb");
+	if (!file) {
+		return ESP_FAIL;
+	}
+	uint32_t crc = crc32_le(0, (const uint8_t *)&cache, sizeof cache);
+	size_t ret = fwrite(&cache, sizeof cache, 1, file);
+	ret += fwrite(&crc, sizeof crc, 1, file);
+	fclose(file);
+	return ret == 2 ? ESP_OK : ESP_FAIL;
+}
+
+/* Derive the WPA2 PMK from the password (IEEE 802.11i, PBKDF2-SHA1) */
+static esp_err_t _derive_pmk(const char *ssid, const char *pass, uint8_t *pmk) {
+	mbedtls_md_context_t md;
+	mbedtls_md_init(&md);
+	int ret = mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1);
+	if (!ret) {
+		ret = mbedtls_pkcs5_pbkdf2_hmac(&md,
+										(const unsigned char *)pass,
+										strlen(pass),
+										(const unsigned char *)ssid,
+										strlen(ssid),
+										WIFI_CACHE_PBKDF2_ROUNDS,
+										WIFI_CACHE_PMK_LEN,
+										pmk);
+	}
+	mbedtls_md_free(&md);
+	return ret ? ESP_FAIL : ESP_OK;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Load the records from the file system */
+esp_err_t app_wifi_cache_load(void) {
+	esp_err_t ret = ESP_ERR_NOT_FOUND;
+	uint32_t crc = 0;
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	FILE *file = fopen(cache_path, "rb");
+	if (file) {
+		if (	fread(&cache, sizeof cache, 1, file) == 1 &&
+				fread(&crc, sizeof crc, 1, file) == 1 &&
+				cache.magic == WIFI_CACHE_MAGIC &&
+				crc == crc32_le(0, (const uint8_t *)&cache, sizeof cache)) {
+			ret = ESP_OK;
+		}
+		fclose(file);
+	}
+	if (ret != ESP_OK) {
+		memset(&cache, 0, sizeof cache);
+		cache.magic = WIFI_CACHE_MAGIC;
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return ret;
+}
+
+/* Find the association parameters of an access point */
+esp_err_t app_wifi_cache_find(const char *ssid, const char *pass, app_wifi_cache_rec_t *rec) {
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	app_wifi_cache_rec_t *found = _find(ssid);
+	if (found) {
+		memcpy(rec, found, sizeof *rec);
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	if (!found) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (rec->pass_crc != _pass_crc(pass)) {
+		rec->is_pmk = false;
+	}
+	return ESP_OK;
+}
+
+/* Store the parameters of the current association */
+esp_err_t app_wifi_cache_update(const char *ssid, const char *pass) {
+	wifi_ap_record_t ap;
+	if (	esp_wifi_sta_get_ap_info(&ap) != ESP_OK ||
+			strncmp((const char *)ap.ssid, ssid, SPIFFS_WIFI_SSID_LENGTH)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	uint32_t pass_crc = _pass_crc(pass);
+	app_wifi_cache_rec_t rec;
+	bool is_pmk = app_wifi_cache_find(ssid, pass, &rec) == ESP_OK && rec.is_pmk;
+	uint8_t pmk[WIFI_CACHE_PMK_LEN] = { 0 };
+	/* An open network has no PMK, a 64 digits password is the PMK already */
+	size_t pass_len = strlen(pass);
+	if (!is_pmk && pass_len >= 8 && pass_len < 64) {
+		is_pmk = _derive_pmk(ssid, pass, pmk) == ESP_OK;
+	} else if (is_pmk) {
+		memcpy(pmk, rec.pmk, sizeof pmk);
+	}
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	app_wifi_cache_rec_t *dst = _find(ssid);
+	if (!dst) {
+		dst = _alloc(ssid);
+	}
+	_count(dst, true);
+	memcpy(dst->bssid, ap.bssid, sizeof dst->bssid);
+	dst->channel = ap.primary;
+	dst->is_pmk = is_pmk;
+	memcpy(dst->pmk, pmk, sizeof dst->pmk);
+	dst->pass_crc = pass_crc;
+	dst->seq = ++cache.seq;
+	esp_err_t ret = _save();
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	ESP_LOGD(	tag,
+				"Saved "MACSTR" on channel %d for SSID %s%s",
+				MAC2STR(ap.bssid),
+				ap.primary,
+				ssid,
+				is_pmk ? " with PMK" : "");
+	return ret;
+}
+
+/* Count a failed connect to an access point */
+void app_wifi_cache_note_failure(const char *ssid) {
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	app_wifi_cache_rec_t *rec = _find(ssid);
+	if (!rec) {
+		rec = _alloc(ssid);
+	}
+	_count(rec, false);
+	_save();
+	app_semaphore_give(app_instance.spi_flash_mtx);
+}
+
+/* Find the access point of the most recent association among the saved ones */
+int app_wifi_cache_last_used(int ap_num, const app_spiffs_ap_record_t *ap_records) {
+	int idx = -1;
+	uint32_t seq = 0;
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	for (int i = 0; i < ap_num; ++i) {
+		char ssid[SPIFFS_WIFI_SSID_LENGTH + 1];
+		memcpy(ssid, ap_records[i].ssid, SPIFFS_WIFI_SSID_LENGTH);
+		ssid[SPIFFS_WIFI_SSID_LENGTH] = '\0';
+		app_wifi_cache_rec_t *rec = _find(ssid);
+		if (rec && rec->channel && rec->seq > seq) {
+			seq = rec->seq;
+			idx = i;
+		}
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return idx;
+}
+
+/* Success rate of the connects to an access point */
+int app_wifi_cache_success_rate(const char *ssid) {
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	app_wifi_cache_rec_t *rec = _find(ssid);
+	/* One success in two attempts is assumed ahead of the history */
+	int rate = rec ? (rec->success_cnt + 1) * 100 / (rec->attempt_cnt + 2) : 50;
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return rate;
+}
+
+/* Forget the BSSID and the channel of an access point */
+esp_err_t app_wifi_cache_forget_bssid(const char *ssid) {
+	esp_err_t ret = ESP_ERR_NOT_FOUND;
+	app_semaphore_take(app_instance.spi_flash_mtx, portMAX_DELAY);
+	app_wifi_cache_rec_t *rec = _find(ssid);
+	if (rec && rec->channel) {
+		memset(rec->bssid, 0, sizeof rec->bssid);
+		rec->channel = 0;
+		_save();
+		ret = ESP_OK;
+	}
+	app_semaphore_give(app_instance.spi_flash_mtx);
+	return ret;
+}
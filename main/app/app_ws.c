@@ -0,0 +1,159 @@
+/**
+ * *****************************************************************************
+ * @file		app_ws.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Persistent WebSocket session to the work server, used for pushed
+ * 				profile updates, track acknowledgements and the microphone stream
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <string.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_websocket_client.h>
+
+/* User files */
+#include "app_ws.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+static const char *tag = "app_ws";
+
+#define WS_OPCODE_TEXT	0x01
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Handle the events of the WebSocket client */
+static void _ws_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+	app_ws_session_t *ws = (app_ws_session_t *)arg;
+	esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+	switch (event_id) {
+	case WEBSOCKET_EVENT_CONNECTED:
+		++ws->handshakes;
+		ESP_LOGI(tag, "Session established (handshake #%u)", ws->handshakes);
+		break;
+	case WEBSOCKET_EVENT_DISCONNECTED:
+		ESP_LOGW(tag, "Session lost");
+		ws->rx_len = 0;
+		break;
+	case WEBSOCKET_EVENT_DATA:
+		/* Only text messages are expected from the server, a message larger than the
+		 * client buffer arrives in several events */
+		if (data->op_code != WS_OPCODE_TEXT) {
+			break;
+		}
+		if (data->payload_offset == 0) {
+			ws->rx_len = 0;
+		}
+		if (data->payload_len >= APP_WS_RX_BUF_SIZE) {
+			ESP_LOGW(tag, "Message of %d bytes dropped", data->payload_len);
+			break;
+		}
+		memcpy(ws->rx_buf + data->payload_offset, data->data_ptr, data->data_len);
+		ws->rx_len = data->payload_offset + data->data_len;
+		if (ws->rx_len == (size_t)data->payload_len) {
+			ws->rx_buf[ws->rx_len] = '\0';
+			if (ws->on_text) {
+				ws->on_text(ws->cb_arg, ws->rx_buf, ws->rx_len);
+			}
+			ws->rx_len = 0;
+		}
+		break;
+	case WEBSOCKET_EVENT_ERROR:
+		ESP_LOGW(tag, "Transport error");
+		break;
+	default:
+		break;
+	}
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+/* Start the WebSocket session */
+esp_err_t app_ws_start(	app_ws_session_t *ws,
+						const char *url,
+						const char *user,
+						const char *passwd,
+						app_ws_text_cb_t on_text,
+						void *arg) {
+	memset(ws, 0, sizeof *ws);
+	ws->rx_buf = heap_caps_malloc(APP_WS_RX_BUF_SIZE, MALLOC_CAP_8BIT);
+	if (!ws->rx_buf) {
+		return ESP_ERR_NO_MEM;
+	}
+	ws->on_text = on_text;
+	ws->cb_arg = arg;
+	esp_websocket_client_config_t ws_cfg = {
+#ifdef APP_WS_LOCAL_URL
+			.uri = APP_WS_LOCAL_URL,
+#else
+			.uri = url,
+#endif	/* APP_WS_LOCAL_URL */
+			.username = user,
+			.password = passwd,
+	};
+	ws->hdl = esp_websocket_client_init(&ws_cfg);
+	if (!ws->hdl) {
+		app_ws_stop(ws);
+		return ESP_FAIL;
+	}
+	esp_websocket_register_events(ws->hdl, WEBSOCKET_EVENT_ANY, _ws_event_handler, ws);
+	if (esp_websocket_client_start(ws->hdl) != ESP_OK) {
+		app_ws_stop(ws);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(tag, "Session started: %s", ws_cfg.uri);
+	return ESP_OK;
+}
+
+/* Stop the WebSocket session and release its resources */
+void app_ws_stop(app_ws_session_t *ws) {
+	if (ws->hdl) {
+		esp_websocket_client_stop(ws->hdl);
+		esp_websocket_client_destroy(ws->hdl);
+		ws->hdl = NULL;
+	}
+	heap_caps_free(ws->rx_buf);
+	ws->rx_buf = NULL;
+	ws->rx_len = 0;
+}
+
+/* Check whether the session is established */
+BaseType_t app_ws_is_connected(const app_ws_session_t *ws) {
+	return ws->hdl && esp_websocket_client_is_connected(ws->hdl) ? pdTRUE : pdFALSE;
+}
+
+/* Send a text message */
+esp_err_t app_ws_send_text(app_ws_session_t *ws, const char *text) {
+	if (!app_ws_is_connected(ws)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	int len = strlen(text);
+	if (esp_websocket_client_send_text(ws->hdl, text, len, pdMS_TO_TICKS(APP_WS_SEND_TIMEOUT_MS)) != len) {
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/* Send a binary message */
+esp_err_t app_ws_send_bin(app_ws_session_t *ws, const void *data, size_t len) {
+	if (!app_ws_is_connected(ws)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (esp_websocket_client_send_bin(	ws->hdl,
+										(const char *)data,
+										(int)len,
+										pdMS_TO_TICKS(APP_WS_SEND_TIMEOUT_MS)) != (int)len) {
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
@@ -42,6 +42,29 @@
 
 #define FIRMWARE_VERSION_PREFIX		"Racoon.D1."
 
+/**
+ * @brief	Content negotiation of the work server responses
+ * *****************************************************************************
+ * @note	When enabled, the profile and firmware version requests ask for CBOR first
+ * 			(Accept: application/cbor), a much smaller document that is decoded without
+ * 			any text parsing. The encoding is chosen by the Content-Type of each response,
+ * 			so a server that does not support CBOR keeps working with JSON.
+ * *****************************************************************************
+ */
+#define APP_API_CBOR			(0)
+#if APP_API_CBOR
+#define APP_API_ACCEPT			"application/cbor, application/json;q=0.5"
+#else
+#define APP_API_ACCEPT			"application/json"
+#endif	/* APP_API_CBOR */
+
+/**
+ * @brief	Offer the gzip content encoding (Accept-Encoding: gzip) in the login, profile and
+ * 			firmware version requests. The responses are inflated by app_http_reader, an
+ * 			uncompressed response is read as before
+ */
+#define APP_API_GZIP			(0)
+
 //#define DEVELOP_VERSION
 
 /* Export typedef ------------------------------------------------------------*/
@@ -54,6 +77,7 @@ typedef struct {
 	char player[DEFAULT_HTTP_BUF_SIZE];
 	char profile[DEFAULT_HTTP_BUF_SIZE];
 	char sampler[DEFAULT_HTTP_BUF_SIZE];
+	char ws[DEFAULT_HTTP_BUF_SIZE];
 } app_uri_set_t;
 
 /** @brief	Main application structure */
@@ -0,0 +1,113 @@
+/**
+ * *****************************************************************************
+ * @file		app_arbiter.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Bandwidth arbiter between the track download and the radio upload
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_ARBITER_H__
+#define APP_ARBITER_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define ARBITER_WINDOW_MS			1000	/*!< Link capacity measurement window */
+#define ARBITER_BURST_MS			250		/*!< Bucket depth in time of the granted rate */
+#define ARBITER_MAX_WAIT_MS			200		/*!< Longest pause of a single transfer */
+#define ARBITER_MIN_CAPACITY		(16 * 1024)		/*!< Floor of the capacity estimate, bytes per second */
+#define ARBITER_INIT_CAPACITY		(128 * 1024)	/*!< Capacity assumed before the first measurement */
+#define ARBITER_MAX_NEED			100		/*!< Urgency of a flow that is about to underrun or overflow */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/** @brief	Flows sharing the Wi-Fi link */
+typedef enum {
+	ARBITER_DOWNLINK = 0,	/*!< Track download of the player */
+	ARBITER_UPLINK,			/*!< Radio upload of the sampler */
+	ARBITER_FLOW_COUNT,
+} app_arbiter_flow_e;
+
+/** @brief	Token bucket of a flow */
+typedef struct {
+	BaseType_t is_active;	/*!< The flow is transferring */
+	uint32_t need;			/*!< Urgency from 0 to ARBITER_MAX_NEED */
+	uint32_t min_rate;		/*!< Rate the flow needs in real time, bytes per second */
+	uint32_t rate;			/*!< Granted rate, bytes per second */
+	int32_t tokens;			/*!< Bytes that may be transferred without a pause, negative when in debt */
+	int64_t refill_us;		/*!< esp_timer time of the last refill */
+	BaseType_t is_starved;	/*!< The flow had to wait during the current window */
+} app_arbiter_bucket_t;
+
+/**
+ * @brief	Bandwidth arbiter related structure
+ * *****************************************************************************
+ * @note	The link capacity is estimated from the bytes both flows moved per window, counting
+ * 			only the windows in which no flow was held back by its bucket. While both flows are
+ * 			active, the capacity is split in proportion to their urgency: the download gets more
+ * 			when the player queue runs low, the upload when the recorder backlog grows. A flow
+ * 			never gets less than its real-time rate while the link has it. A flow that is alone
+ * 			on the link is not limited.
+ * *****************************************************************************
+ */
+typedef struct {
+	portMUX_TYPE lock;									/*!< Lock of the arbiter state */
+	app_arbiter_bucket_t bucket[ARBITER_FLOW_COUNT];	/*!< Buckets of the flows */
+	uint32_t capacity;									/*!< Estimated link capacity, bytes per second */
+	int64_t window_start;								/*!< esp_timer time the current window started at */
+	uint32_t window_bytes;								/*!< Bytes moved by both flows in the current window */
+} app_arbiter_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Initialize the arbiter
+ * @param[out]	arbiter	A pointer to the arbiter instance
+ * @return
+ * 				- None
+ */
+void app_arbiter_init(app_arbiter_t *arbiter);
+
+/**
+ * @brief		Report the urgency of a flow, marks the flow active
+ * @param[in]	arbiter		A pointer to the arbiter instance
+ * @param[in]	flow		Flow
+ * @param[in]	need		Urgency from 0 to ARBITER_MAX_NEED
+ * @param[in]	min_rate	Rate the flow needs in real time, bytes per second, 0 - none
+ * @return
+ * 				- None
+ */
+void app_arbiter_set_need(app_arbiter_t *arbiter, app_arbiter_flow_e flow, uint32_t need, uint32_t min_rate);
+
+/**
+ * @brief		Mark a flow inactive, the other one gets the whole link
+ * @param[in]	arbiter	A pointer to the arbiter instance
+ * @param[in]	flow	Flow
+ * @return
+ * 				- None
+ */
+void app_arbiter_release(app_arbiter_t *arbiter, app_arbiter_flow_e flow);
+
+/**
+ * @brief		Take the tokens for a transfer, waiting for up to ARBITER_MAX_WAIT_MS
+ * 				when the flow is over its share
+ * @param[in]	arbiter	A pointer to the arbiter instance
+ * @param[in]	flow	Flow
+ * @param[in]	bytes	Size of the transfer
+ * @return
+ * 				- None
+ */
+void app_arbiter_acquire(app_arbiter_t *arbiter, app_arbiter_flow_e flow, size_t bytes);
+
+#endif	/* APP_ARBITER_H__ */
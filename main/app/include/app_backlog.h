@@ -0,0 +1,148 @@
+/**
+ * *****************************************************************************
+ * @file		app_backlog.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Store-and-forward buffer for the audio record captured while the
+ * 				uplink is not available
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_BACKLOG_H__
+#define APP_BACKLOG_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "sound_recorder.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+extern const char *backlog_spill_path;	/*!< Name of the file the oldest blocks are moved to when
+										 * the RAM part of the backlog is full */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Bounded FIFO of timestamped audio blocks
+ * *****************************************************************************
+ * @note	Blocks are kept in PSRAM first. The RAM ring stores each block packed, its
+ * 			header followed by its samples only, so its capacity is set in bytes and holds
+ * 			the same duration of audio whatever the block size of the capture profile.
+ * 			When the RAM ring reaches its limit, the oldest block is moved to the spill
+ * 			file on SPIFFS (if a flash quota is given), otherwise it is dropped. Blocks are
+ * 			always returned oldest first, so the spill file is read before the RAM ring.
+ * 			The backlog is not thread safe: it is owned by the sound sender task.
+ * *****************************************************************************
+ */
+typedef struct {
+	uint8_t *ring;					/*!< RAM part of the backlog */
+	size_t ram_cap;					/*!< Capacity of the RAM part in bytes */
+	size_t ram_limit;				/*!< Bytes of the RAM part in use at most, up to ram_cap */
+	size_t head;					/*!< Offset of the oldest block of the RAM part */
+	size_t tail;					/*!< Offset of the next block of the RAM part */
+	size_t used;					/*!< Bytes of the RAM part in use, the end of the ring skipped included */
+	size_t ram_cnt;					/*!< Number of blocks in the RAM part */
+	sound_recorder_block_t *spill;	/*!< Block moved to the spill file */
+	size_t flash_cap;				/*!< Capacity of the spill file in blocks (0 - no spill) */
+	uint32_t flash_rd;				/*!< Index of the oldest unread block of the spill file */
+	uint32_t flash_wr;				/*!< Number of blocks written to the spill file */
+	uint32_t dropped;				/*!< Number of blocks lost because the backlog was full */
+} app_backlog_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Allocate the backlog
+ * @param[out]	backlog		A pointer to the backlog instance
+ * @param[in]	ram_bytes	Capacity of the RAM part in bytes
+ * @param[in]	flash_blocks	Capacity of the spill file in blocks, 0 disables the spill
+ * @return
+ * 				- ESP_ERR_NO_MEM: Memory allocation failure
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_backlog_init(app_backlog_t *backlog, size_t ram_bytes, size_t flash_blocks);
+
+/**
+ * @brief		Get the RAM the blocks of a given size take in the backlog
+ * @param[in]	blocks		Number of blocks
+ * @param[in]	block_size	Size of the samples of a block in bytes
+ * @return
+ * 				- Size in bytes
+ */
+size_t app_backlog_ram_size(size_t blocks, size_t block_size);
+
+/**
+ * @brief		Limit the RAM part of the backlog, the blocks over the limit leave it with
+ * 				the next push
+ * @param[in]	backlog		A pointer to the backlog instance
+ * @param[in]	ram_bytes	Bytes of the RAM part to use at most, capped at its capacity
+ * @return
+ * 				- None
+ */
+void app_backlog_set_limit(app_backlog_t *backlog, size_t ram_bytes);
+
+/**
+ * @brief		Append a block to the backlog. If the backlog is full, the oldest block is lost
+ * @param[in]	backlog	A pointer to the backlog instance
+ * @param[in]	blk		A pointer to the block to be stored
+ * @return
+ * 				- ESP_ERR_NO_MEM: The backlog has no storage at all
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_backlog_push(app_backlog_t *backlog, const sound_recorder_block_t *blk);
+
+/**
+ * @brief		Copy the oldest block of the backlog without removing it
+ * @param[in]	backlog	A pointer to the backlog instance
+ * @param[out]	blk		A pointer to the buffer to fill
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: The backlog is empty
+ * 				- ESP_FAIL: The spill file could not be read
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_backlog_peek(app_backlog_t *backlog, sound_recorder_block_t *blk);
+
+/**
+ * @brief		Remove the oldest block of the backlog
+ * @param[in]	backlog	A pointer to the backlog instance
+ * @return
+ * 				- None
+ */
+void app_backlog_pop(app_backlog_t *backlog);
+
+/**
+ * @brief		Get the number of blocks kept in the backlog
+ * @param[in]	backlog	A pointer to the backlog instance
+ * @return
+ * 				- Number of blocks
+ */
+size_t app_backlog_count(const app_backlog_t *backlog);
+
+/**
+ * @brief		Drop the oldest blocks so that no more than max_blocks are kept
+ * @param[in]	backlog		A pointer to the backlog instance
+ * @param[in]	max_blocks	Number of the newest blocks to keep
+ * @return
+ * 				- None
+ */
+void app_backlog_trim(app_backlog_t *backlog, size_t max_blocks);
+
+/**
+ * @brief		Drop all blocks of the backlog
+ * @param[in]	backlog	A pointer to the backlog instance
+ * @return
+ * 				- None
+ */
+void app_backlog_clear(app_backlog_t *backlog);
+
+#endif	/* APP_BACKLOG_H__ */
@@ -0,0 +1,92 @@
+/**
+ * *****************************************************************************
+ * @file		app_boot.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Boot stages, their dependencies and timing
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_BOOT_H__
+#define APP_BOOT_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Boot stages
+ * *****************************************************************************
+ * @note	The board, the storage and the radio stages run concurrently: the codec
+ * 			reset delays take place in their own task while the file system is mounted
+ * 			and the WiFi driver is started. A stage that depends on another one waits
+ * 			for it with app_boot_wait.
+ * *****************************************************************************
+ */
+typedef enum {
+	BOOT_STAGE_NVS = 0,		/*!< Non-volatile storage and MAC address */
+	BOOT_STAGE_BOARD,		/*!< Codec, microphone, button and LED */
+	BOOT_STAGE_RADIO,		/*!< Network interface and WiFi driver */
+	BOOT_STAGE_STORAGE,		/*!< File system and device descriptor */
+	BOOT_STAGE_APP,			/*!< Application objects, the URIs and the timers */
+	BOOT_STAGE_RESUME,		/*!< Output settings of the profile saved before the restart */
+	BOOT_STAGE_JOIN,		/*!< Association with a saved access point */
+	BOOT_STAGE_LOGIN,		/*!< Login request */
+	BOOT_STAGE_PROFILE,		/*!< First profile received from the server */
+	BOOT_STAGE_COUNT,
+} app_boot_stage_e;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Create the stage signals, called first thing in app_main
+ * @return
+ * 				- None
+ */
+void app_boot_init(void);
+
+/**
+ * @brief		Note the start of a stage
+ * @param[in]	stage	Boot stage
+ * @return
+ * 				- None
+ */
+void app_boot_begin(app_boot_stage_e stage);
+
+/**
+ * @brief		Note the end of a stage and release the stages waiting for it. Only the
+ * 				first call for a stage is taken into account
+ * @param[in]	stage	Boot stage
+ * @return
+ * 				- None
+ * @note		The end of BOOT_STAGE_PROFILE logs the timing of all the stages.
+ */
+void app_boot_done(app_boot_stage_e stage);
+
+/**
+ * @brief		Wait for the end of a stage
+ * @param[in]	stage	Boot stage
+ * @return
+ * 				- None
+ */
+void app_boot_wait(app_boot_stage_e stage);
+
+/**
+ * @brief		Wait for the end of a stage for a limited time
+ * @param[in]	stage		Boot stage
+ * @param[in]	timeout_ms	Longest wait
+ * @return
+ * 				- ESP_ERR_TIMEOUT: The stage has not ended in time
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_boot_wait_ms(app_boot_stage_e stage, uint32_t timeout_ms);
+
+#endif	/* APP_BOOT_H__ */
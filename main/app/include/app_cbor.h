@@ -0,0 +1,127 @@
+/**
+ * *****************************************************************************
+ * @file		app_cbor.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Minimal CBOR (RFC 8949) reader for the work server responses
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_CBOR_H__
+#define APP_CBOR_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define APP_CBOR_CONTENT_TYPE	"application/cbor"
+#define APP_CBOR_MAX_DEPTH		8	/*!< Deepest nesting of the skipped items */
+
+/* Simple values */
+#define APP_CBOR_FALSE			20
+#define APP_CBOR_TRUE			21
+#define APP_CBOR_NULL			22
+#define APP_CBOR_UNDEFINED		23
+
+/* Export typedef ------------------------------------------------------------*/
+
+/** @brief	CBOR major types */
+typedef enum {
+	APP_CBOR_UINT = 0,
+	APP_CBOR_NEGINT,
+	APP_CBOR_BYTES,
+	APP_CBOR_TEXT,
+	APP_CBOR_ARRAY,
+	APP_CBOR_MAP,
+	APP_CBOR_TAG,
+	APP_CBOR_SIMPLE,
+} app_cbor_major_e;
+
+/**
+ * @brief	Head of a CBOR data item
+ * *****************************************************************************
+ * @note	arg holds the value of an integer, the length of a string, the number of
+ * 			elements of an array or of pairs of a map, the tag number, the simple value
+ * 			or the raw bits of a float (info 25, 26 or 27). Indefinite lengths are not
+ * 			supported, the server has no reason to stream these small documents.
+ * *****************************************************************************
+ */
+typedef struct {
+	app_cbor_major_e major;		/*!< Major type */
+	uint8_t info;				/*!< Additional information of the initial byte */
+	uint64_t arg;				/*!< Argument of the item */
+} app_cbor_item_t;
+
+/** @brief	CBOR reader over a complete document held in memory */
+typedef struct {
+	const uint8_t *pos;			/*!< Next byte to read */
+	const uint8_t *end;			/*!< End of the document */
+} app_cbor_reader_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Start reading a document
+ * @param[out]	reader	A pointer to the reader instance
+ * @param[in]	data	Pointer to the document
+ * @param[in]	len		Document length in bytes
+ * @return
+ * 				- None
+ */
+void app_cbor_init(app_cbor_reader_t *reader, const void *data, size_t len);
+
+/**
+ * @brief		Read the head of the next data item
+ * @param[in]	reader	A pointer to the reader instance
+ * @param[out]	item	A pointer to the item head to fill
+ * @return
+ * 				- ESP_ERR_NOT_SUPPORTED: Indefinite length or reserved encoding
+ * 				- ESP_FAIL: The document is truncated
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_cbor_read_head(app_cbor_reader_t *reader, app_cbor_item_t *item);
+
+/**
+ * @brief		Take the content of a byte or text string whose head has just been read
+ * @param[in]	reader	A pointer to the reader instance
+ * @param[in]	item	A pointer to the string head
+ * @param[out]	str		Pointer to the string content inside the document, not null-terminated
+ * @return
+ * 				- ESP_ERR_INVALID_ARG: The item is not a string
+ * 				- ESP_FAIL: The document is truncated
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_cbor_read_string(app_cbor_reader_t *reader, const app_cbor_item_t *item, const char **str);
+
+/**
+ * @brief		Skip the content of an item whose head has just been read, nested items included
+ * @param[in]	reader	A pointer to the reader instance
+ * @param[in]	item	A pointer to the item head
+ * @return
+ * 				- ESP_ERR_NOT_SUPPORTED: Unsupported encoding or too deep nesting
+ * 				- ESP_FAIL: The document is truncated
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_cbor_skip(app_cbor_reader_t *reader, const app_cbor_item_t *item);
+
+/**
+ * @brief		Get the numeric value of an integer or a float item
+ * @param[in]	item	A pointer to the item head
+ * @param[out]	value	Value of the item
+ * @return
+ * 				- false: The item is not a number
+ * 				- true: Success
+ */
+bool app_cbor_get_number(const app_cbor_item_t *item, double *value);
+
+#endif	/* APP_CBOR_H__ */
@@ -0,0 +1,133 @@
+/**
+ * *****************************************************************************
+ * @file		app_chunked.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		HTTP/1.1 chunked transfer encoding writer used by streaming uploads
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_CHUNKED_H__
+#define APP_CHUNKED_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+#include <esp_http_client.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define CHUNKED_HEAD_ROOM	10	/*!< Room reserved in front of the payload for the chunk size line ("ffffffff\r\n") */
+#define CHUNKED_TAIL_ROOM	7	/*!< Room reserved after the payload for the CRLF and the last-chunk ("\r\n0\r\n\r\n") */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Chunked transfer encoding writer
+ * *****************************************************************************
+ * @note	The chunk size line, the payload and the trailing CRLF are assembled in one
+ * 			contiguous buffer, so every chunk leaves the device with a single
+ * 			esp_http_client_write call. Several small blocks may be aggregated into one
+ * 			chunk, but none of them waits longer than the configured latency.
+ * *****************************************************************************
+ */
+typedef struct {
+	esp_http_client_handle_t http;	/*!< HTTP connection the chunks are written to */
+	char *buf;						/*!< Chunk buffer: head room, payload and tail room */
+	size_t cap;						/*!< Payload capacity of a single chunk in bytes */
+	size_t len;						/*!< Number of payload bytes currently aggregated */
+	int64_t latency;				/*!< Maximum aggregation time in microseconds (0 - no aggregation) */
+	int64_t deadline;				/*!< esp_timer time by which the aggregated payload must be sent */
+} app_chunked_writer_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Allocate the chunk buffer of the writer
+ * @param[out]	writer		A pointer to the writer instance
+ * @param[in]	cap			Payload capacity of a single chunk in bytes
+ * @param[in]	latency_ms	Maximum time the first aggregated byte may wait before it is sent.
+ * 							Pass 0 to send every block as a chunk of its own
+ * @return
+ * 				- ESP_ERR_INVALID_ARG: Parameter error
+ * 				- ESP_ERR_NO_MEM: Memory allocation failure
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_chunked_init(app_chunked_writer_t *writer, size_t cap, uint32_t latency_ms);
+
+/**
+ * @brief		Release the chunk buffer of the writer
+ * @param[in]	writer	A pointer to the writer instance
+ * @return
+ * 				- None
+ */
+void app_chunked_deinit(app_chunked_writer_t *writer);
+
+/**
+ * @brief		Bind the writer to an opened HTTP connection and drop any aggregated data
+ * @param[in]	writer	A pointer to the writer instance
+ * @param[in]	http	esp_http_client handle opened with write_len = -1
+ * @return
+ * 				- None
+ */
+void app_chunked_attach(app_chunked_writer_t *writer, esp_http_client_handle_t http);
+
+/**
+ * @brief		Append data to the current chunk. The chunk is sent when it is full or
+ * 				when the aggregation latency has expired
+ * @param[in]	writer	A pointer to the writer instance
+ * @param[in]	data	Pointer to the data to be sent
+ * @param[in]	len		Data length in bytes
+ * @return
+ * 				- ESP_FAIL: Network error
+ * 				- Number of bytes accepted
+ */
+int app_chunked_write(app_chunked_writer_t *writer, const void *data, size_t len);
+
+/**
+ * @brief		Send the aggregated data if the aggregation latency has expired
+ * @param[in]	writer	A pointer to the writer instance
+ * @return
+ * 				- ESP_FAIL: Network error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_chunked_poll(app_chunked_writer_t *writer);
+
+/**
+ * @brief		Send the aggregated data as a chunk right away
+ * @param[in]	writer	A pointer to the writer instance
+ * @return
+ * 				- ESP_FAIL: Network error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_chunked_flush(app_chunked_writer_t *writer);
+
+/**
+ * @brief		Send the aggregated data together with the last-chunk, which ends the body
+ * @param[in]	writer	A pointer to the writer instance
+ * @return
+ * 				- ESP_FAIL: Network error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_chunked_finish(app_chunked_writer_t *writer);
+
+/**
+ * @brief		Get the time it is possible to wait for new data without violating the
+ * 				aggregation latency
+ * @param[in]	writer		A pointer to the writer instance
+ * @param[in]	max_ticks	Upper limit of the result
+ * @return
+ * 				- Number of RTOS ticks, rounded up and at least 1 while the deadline is ahead,
+ * 				  0 once it has passed
+ */
+TickType_t app_chunked_wait_ticks(app_chunked_writer_t *writer, TickType_t max_ticks);
+
+#endif	/* APP_CHUNKED_H__ */
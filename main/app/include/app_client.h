@@ -14,6 +14,9 @@
 
 /* Includes ------------------------------------------------------------------*/
 
+/* STDLIB */
+#include <stdint.h>
+
 /* Framework */
 #include <freertos/FreeRTOS.h>
 #include <freertos/ringbuf.h>
@@ -23,6 +26,12 @@
 
 /* User files */
 #include "app_device_desc.h"
+#include "app_arbiter.h"
+#include "app_http_reader.h"
+#include "app_http_conn.h"
+#include "app_link_model.h"
+#include "app_profile.h"
+#include "app_ws.h"
 #include "sound_recorder.h"
 #include "uuid.h"
 
@@ -38,10 +47,154 @@
  */
 #define QUEUE_MESSAGES_WAITING_THRESHOLD	(RECORDER_QUEUE_SIZE / 4)
 
+/**
+ * @brief	Aggregation of the recorder blocks into HTTP chunks
+ * *****************************************************************************
+ * @note	Up to SAMPLER_CHUNK_BLOCKS blocks are sent as one chunk, but no block waits
+ * 			longer than SAMPLER_CHUNK_LATENCY_MS. Set SAMPLER_CHUNK_BLOCKS to 1 to send
+ * 			every block as soon as it is sampled.
+ * *****************************************************************************
+ */
+#define SAMPLER_CHUNK_BLOCKS		4
+#define SAMPLER_CHUNK_LATENCY_MS	100
+
+/**
+ * @brief	Store-and-forward of the audio record while the uplink is down
+ * *****************************************************************************
+ * @note	Up to SAMPLER_BACKLOG_SECONDS of audio are kept in PSRAM and uploaded faster
+ * 			than real time once the connection is restored. The duration is counted in the
+ * 			sample rate and block size of the capture profile in use. SAMPLER_BACKLOG_RAM_SIZE
+ * 			fits it at RECORDER_SAMPLE_RATE with the block headers, a faster profile gets
+ * 			proportionally less time. With SAMPLER_BACKLOG_FLASH_SPILL
+ * 			enabled, the oldest blocks are moved to SPIFFS instead of being dropped.
+ * 			The connection is retried with a backoff from SAMPLER_RETRY_PERIOD_MS up to
+ * 			SAMPLER_RETRY_MAX_MS, and no sooner than SAMPLER_RETRY_POOR_MS while the link
+ * 			is poor. Nothing is attempted while the station is disconnected.
+ * *****************************************************************************
+ */
+#define SAMPLER_BACKLOG_SECONDS			30
+#define SAMPLER_BACKLOG_RAM_SIZE		(SAMPLER_BACKLOG_SECONDS * RECORDER_BYTES_PER_SEC * 9 / 8)
+#define SAMPLER_BACKLOG_FLASH_SPILL		(0)
+#define SAMPLER_BACKLOG_FLASH_BLOCKS	(SAMPLER_BACKLOG_FLASH_SPILL ? 256 : 0)
+#define SAMPLER_RETRY_PERIOD_MS			1000
+#define SAMPLER_RETRY_MAX_MS			30000
+#define SAMPLER_RETRY_POOR_MS			4000
+
+/**
+ * @brief	Pre-trigger history of the audio record
+ * *****************************************************************************
+ * @note	While the radio is off, the microphone keeps sampling and the last
+ * 			SAMPLER_PRE_TRIGGER_SECONDS of audio are kept in the backlog. When the radio
+ * 			is switched on, this history is sent first, which hides the profile polling
+ * 			and connection setup latency. The microphone then stays on all the time, so
+ * 			the history is disabled by default (0): the microphone samples only while the
+ * 			radio is on. Set SAMPLER_PRE_TRIGGER_SECONDS to 2, for example, to enable it.
+ * *****************************************************************************
+ */
+#define SAMPLER_PRE_TRIGGER_SECONDS		0
+
+/**
+ * @brief	Framed format of the audio upload
+ * *****************************************************************************
+ * @note	When enabled, the audio is sent as a sequence of sampler_frame_hdr_t headers,
+ * 			each followed by the samples of one recorder block, instead of a WAV stream.
+ * 			Gaps in the sequence numbers reveal lost blocks and the capture timestamps,
+ * 			together with the X-Device-Time-Us request header, give the end-to-end latency.
+ * *****************************************************************************
+ */
+#define SAMPLER_FRAMED_UPLOAD			(0)
+#define SAMPLER_FRAMED_CONTENT_TYPE		"application/x-audio-frames"
+
+/**
+ * @brief	WebSocket transport of the client module
+ * *****************************************************************************
+ * @note	When enabled, a persistent WebSocket session to the work server carries the
+ * 			profile updates pushed by the server (text messages in the format of the profile
+ * 			request), the track acknowledgements ({"type":"trackDone","id":"..."}) and the
+ * 			microphone stream (binary messages, each one a sampler_frame_hdr_t followed by the
+ * 			samples, announced with {"type":"radio","rate":...}). While the session is down,
+ * 			the HTTP polling and uploads are used as before. See APP_WS_LOCAL_URL and
+ * 			tools/ws_standin.py for testing against a local server.
+ * *****************************************************************************
+ */
+#define CLIENT_WS_TRANSPORT				(0)
+
+/**
+ * @brief	Long-poll mode of the profile requests
+ * *****************************************************************************
+ * @note	When enabled, the profile is requested with "?wait=" and "Prefer: wait=" (RFC 7240),
+ * 			and the server holds the request for up to CLIENT_LONG_POLL_WAIT_S, answering as soon
+ * 			as the profile changes (200) or with 204 when the wait expires. A server that does
+ * 			not confirm the mode with "Preference-Applied: wait=..." gets the 1 s polling, and
+ * 			the long-poll mode is probed again every CLIENT_LONG_POLL_PROBE_PERIOD_MS.
+ * *****************************************************************************
+ */
+#define CLIENT_PROFILE_LONG_POLL			(0)
+#define CLIENT_LONG_POLL_WAIT_S				30
+#define CLIENT_LONG_POLL_PROBE_PERIOD_MS	(10 * 60 * 1000)
+#define CLIENT_LONG_POLL_MIN_GAP_MS			100	/*!< Minimum time between two long-poll requests */
+
+/**
+ * @brief	Adaptive schedule of the periodic profile requests
+ * *****************************************************************************
+ * @note	When enabled, the profile is requested every CLIENT_POLL_FAST_MS while a media task
+ * 			is active and for CLIENT_POLL_HOLD_MS after the profile has changed. Then the period
+ * 			doubles with every unchanged profile up to CLIENT_POLL_IDLE_MAX_MS, which is also
+ * 			the longest delay of a play or stop command given while idle. Every period gets a
+ * 			random jitter of up to CLIENT_POLL_JITTER_PCT. The modem sleep is kept on while the
+ * 			media tasks are idle and turned off while the audio is streamed. While the link is
+ * 			poor, the requests made during the streaming are at least CLIENT_POLL_POOR_MS apart.
+ * 			When disabled, the profile is requested every second.
+ * *****************************************************************************
+ */
+#define CLIENT_POLL_ADAPTIVE			(0)
+#define CLIENT_POLL_FAST_MS				1000
+#define CLIENT_POLL_IDLE_MAX_MS			5000
+#define CLIENT_POLL_HOLD_MS				30000
+#define CLIENT_POLL_JITTER_PCT			10
+#define CLIENT_POLL_POOR_MS				3000
+
+/**
+ * @brief	Bandwidth arbiter between the track download and the radio upload
+ * *****************************************************************************
+ * @note	When enabled, both tasks take the tokens of every transfer from app_arbiter. While
+ * 			both are active, the upload keeps the rate of the capture profile, the download is
+ * 			favoured when the player queue runs low and the upload when the recorder backlog
+ * 			reaches SAMPLER_ARBITER_BACKLOG_SECONDS.
+ * *****************************************************************************
+ */
+#define CLIENT_BANDWIDTH_ARBITER		(0)
+#define SAMPLER_ARBITER_BACKLOG_SECONDS	(SAMPLER_BACKLOG_SECONDS / 4)
+
+/**
+ * @brief	Backoff of the failed requests
+ * *****************************************************************************
+ * @note	A failed profile request is repeated after CLIENT_PROFILE_RETRY_BASE_MS, the
+ * 			delay doubles with every failure up to CLIENT_PROFILE_RETRY_MAX_MS. The
+ * 			end-of-reproduction request is given up after CLIENT_DELETE_RETRY_DEADLINE_MS.
+ * 			A disconnect ends the retries at once.
+ * *****************************************************************************
+ */
+#define CLIENT_PROFILE_RETRY_BASE_MS		500
+#define CLIENT_PROFILE_RETRY_MAX_MS			30000
+#define CLIENT_DELETE_RETRY_BASE_MS			200
+#define CLIENT_DELETE_RETRY_MAX_MS			5000
+#define CLIENT_DELETE_RETRY_DEADLINE_MS		15000
+
+/**
+ * @brief	Number of profile requests the statistics of the profile loop are logged after
+ */
+#define CLIENT_PROFILE_STATS_PERIOD		60
+
+/** @brief	The profile has not changed since the last request (304, or the same content) */
+#define APP_CLIENT_ERR_NOT_MODIFIED		(ESP_ERR_HTTP_BASE + 0x80)
+
 /* Some commonly used status codes */
 #define HTTP_200	200	/*!< OK */
 #define HTTP_204	204	/*!< No Content */
+#define HTTP_206	206	/*!< Partial Content */
 #define HTTP_207	207	/*!< Multi-Status */
+#define HTTP_304	304	/*!< Not Modified */
 #define HTTP_400	400	/*!< Bad Request */
 #define HTTP_401	401	/*!< Unauthorized */
 #define HTTP_404	404	/*!< Not Found */
@@ -51,24 +204,51 @@
 
 /* Export typedef ------------------------------------------------------------*/
 
-/** @brief	Structure used to describe the device profile */
+/** @brief	Header preceding every block of the framed audio upload, little endian */
+typedef struct __attribute__((packed)) {
+	uint32_t seq;			/*!< Sequence number of the block, a gap means lost blocks */
+	int64_t capture_us;		/*!< esp_timer time at which the block was sampled */
+	uint16_t samples;		/*!< Number of 16-bit mono samples following the header */
+} sampler_frame_hdr_t;
+
+/** @brief	State of the profile requests */
 typedef struct {
-	BaseType_t is_muted;					/*!< Audio output has been disabled flag */
-	BaseType_t is_player;					/*!< Sound player active flag */
-	BaseType_t is_recorder;					/*!< Sound recorder active flag */
-	char id[DEVICE_CLIENT_ID_STR_SIZE + 1];	/*!< String for storing device ID */
-	char name[33];							/*!< String for storing device name */
-	double vol;								/*!< Current sound level value from 0 to 100 */
-	double track_cnt;						/*!< The current number of tracks in the queue */
-	uuid_t track_id;						/*!< Unique identifier of the track being played */
-} app_client_profile_t;
+	app_http_conn_t long_conn;					/*!< Connection of the long-poll requests */
+	app_http_conn_t *conn;						/*!< Connection of the request being received */
+	BaseType_t is_long;							/*!< The long-poll mode is in use */
+	BaseType_t is_applied;						/*!< The last response confirmed the long-poll mode */
+	int64_t probe_time;							/*!< esp_timer time of the next attempt to use the long-poll mode */
+	char url[DEFAULT_HTTP_BUF_SIZE + 16];		/*!< Profile URL with the wait query */
+	char etag[72];								/*!< ETag of the last applied profile */
+	char etag_rx[72];							/*!< ETag of the response being received */
+	uint32_t hash;								/*!< Content hash of the last applied profile */
+	uint32_t req_cnt;							/*!< Number of requests since the statistics were logged */
+	uint32_t unchanged_cnt;						/*!< Number of them that found the profile unchanged */
+	int64_t busy_us;							/*!< Time spent on them, waits excluded */
+	app_http_reader_t reader;					/*!< Reader of the response bodies */
+	BaseType_t is_cbor;							/*!< The response being received is encoded in CBOR */
+	uint32_t parsed_cnt;						/*!< Number of profiles parsed since the statistics were logged */
+	uint32_t cbor_cnt;							/*!< Number of them encoded in CBOR */
+	uint32_t rx_bytes;							/*!< Size of their bodies on the wire */
+	int64_t decode_us;							/*!< Time spent on decoding them */
+	uint32_t period_ms;							/*!< Current period of the adaptive schedule */
+	int64_t fast_until;							/*!< esp_timer time the fast requests are kept until */
+	BaseType_t is_ps_set;						/*!< The modem sleep mode has been set */
+	BaseType_t is_ps_on;						/*!< The modem sleep is on */
+} app_client_poll_t;
 
 /** @brief	Application web client node related structure */
 typedef struct {
 	BaseType_t led_tracker;					/*!< Flag used to store the state of the user LED */
 	sound_player_t player;					/*!< An instance of the application sound player structure*/
 	sound_recorder_t sampler;				/*!< An instance of the application sound recorder structure*/
-	esp_http_client_handle_t http_client;	/*!< The esp_http_client handle used to make profile requests */
+	app_http_conn_t conn;					/*!< Connection of the profile requests */
+	app_ws_session_t ws;					/*!< WebSocket session to the work server */
+	app_client_poll_t poll;					/*!< State of the profile requests */
+	app_arbiter_t arbiter;					/*!< Bandwidth arbiter of the media tasks */
+	app_client_profile_t resume_prof;		/*!< Profile saved before the restart, stands in until the server answers */
+	BaseType_t is_resumed;					/*!< The saved profile has been loaded */
+	app_link_level_e link_level;			/*!< Level of the link quality, set by app_link */
 	SemaphoreHandle_t semphr;				/*!< Binary semaphore used to lock resources associated with profile requests */
 	TaskHandle_t hdl;						/*!< Reference of the main task of the application's client module */
 } app_client_func_t;
@@ -141,16 +321,33 @@ void sound_recorder_task(void *arg);
  */
 
 /**
- * @brief		Get JSON string that contains current device profile keys values
- * @param[in]	cli_hdl	esp_http_client_handle_t context
+ * @brief		Get JSON (or CBOR) document that contains current device profile keys values. The
+ * 				request is conditional on the ETag (or the content hash) of the last applied profile
+ * @param[in]	conn	Connection of the request, its handle's event handler must be given
+ * 						the poll structure as the user data. It is kept open after a response
+ * 						that has been read to the end
+ * @param[in]	poll	A pointer to the state of the profile requests
  * @param[out]	profile	A pointer to app_device_profile_t structure to fill
  * @return
+ * 				- APP_CLIENT_ERR_NOT_MODIFIED: The profile has not changed, nothing was parsed
  * 				- ESP_ERR_NOT_FOUND: Critical parameter was not found
+ * 				- ESP_ERR_TIMEOUT: The profile has not changed (204, long-poll mode)
  * 				- ESP_ERR_INVALID_STATE: Device is not authorized
  * 				- ESP_FAIL: Unexpected error
  * 				- ESP_OK: Success
  */
-esp_err_t app_client_get_device_profile(esp_http_client_handle_t cli_hdl, app_client_profile_t *profile);
+esp_err_t app_client_get_device_profile(	app_http_conn_t *conn,
+											app_client_poll_t *poll,
+											app_client_profile_t *profile);
+
+/**
+ * @brief		HTTP client event handler of the profile requests, picks up the ETag,
+ * 				Preference-Applied, Content-Type, Content-Encoding and Connection response headers
+ * @param[in]	evt	HTTP client event, the user data is a pointer to app_client_poll_t
+ * @return
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_client_profile_event_handler(esp_http_client_event_t *evt);
 
 /**
  * @brief		Parse JSON string that contains current device profile keys values
@@ -172,6 +369,19 @@ esp_err_t app_client_parse_profile(app_client_profile_t *profile, const char * c
  */
 void app_client_set_player_state(sound_player_t *player, app_client_profile_t *profile);
 
+/**
+ * @brief		Apply the output settings of the profile saved before the restart, and
+ * 				make the player resume its track from the saved position
+ * @param[out]	player	A pointer to the application player structure instance
+ * @param[out]	profile	Saved profile, the recorder is left off until the server asks for it
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: Nothing has been saved
+ * 				- ESP_OK: Success
+ * @note		Called once the codec has started. The track itself is started by the profile
+ * 				task when the station is online, and is replaced if the server has moved on.
+ */
+esp_err_t app_client_resume(sound_player_t *player, app_client_profile_t *profile);
+
 /**
  * @brief		Change the state of the recorder in accordance with the current
  * 				values ​​of the profile keys
@@ -181,6 +391,14 @@ void app_client_set_player_state(sound_player_t *player, app_client_profile_t *p
  */
 void app_client_set_sampler_state(sound_recorder_t *sampler, app_client_profile_t *profile);
 
+/**
+ * @brief		Suspend the sound player only, the recorder keeps capturing
+ * @param[in]	arg		Application web client context
+ * @return
+ * 				- None
+ */
+void app_client_halt_player(void *arg);
+
 /**
  * @brief		Suspend execution of all current media tasks
  * @param[in]	arg		Application web client context
@@ -0,0 +1,127 @@
+/**
+ * *****************************************************************************
+ * @file		app_dns.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Resolution of the work and upgrade server names ahead of the requests
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_DNS_H__
+#define APP_DNS_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <lwip/ip_addr.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define APP_DNS_CACHE_SIZE		4					/*!< Number of server names tracked */
+#define APP_DNS_HOST_SIZE		64					/*!< Size of the server name buffer */
+#define APP_DNS_REFRESH_MS		(30 * 1000)			/*!< Period of the background lookups */
+#define APP_DNS_WAIT_MS			1500				/*!< Wait for a lookup before the last known address is used */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Server name related structure
+ * *****************************************************************************
+ * @note	The addresses themselves are cached by lwIP for the TTL of the answer. The
+ * 			names are looked up again in the background, so a request finds the address
+ * 			in the lwIP table instead of waiting for the DNS server. The last address
+ * 			that has been resolved is kept past its TTL and is used in place of the name
+ * 			if the DNS server does not answer.
+ * *****************************************************************************
+ */
+typedef struct {
+	char host[APP_DNS_HOST_SIZE];	/*!< Server name */
+	ip_addr_t addr;					/*!< Last address the name has been resolved to */
+	bool is_valid;					/*!< The name has been resolved at least once */
+	bool is_pending;				/*!< A lookup is in progress */
+	bool is_failed;					/*!< The last lookup has failed */
+} app_dns_entry_t;
+
+/** @brief	Change of the server address of a long-lived HTTP client */
+typedef enum {
+	APP_DNS_UNCHANGED = 0,	/*!< The client may go on as it is */
+	APP_DNS_MOVED,			/*!< The name resolves to another address, an open connection leads to the old one */
+	APP_DNS_REBUILD,		/*!< The client has to be created again: the name resolves again while the last
+							 * known address stands in for it, or the other way round */
+} app_dns_change_e;
+
+/**
+ * @brief	Server name of a long-lived HTTP client
+ * *****************************************************************************
+ * @note	A client created once and used for many requests keeps the address it has been
+ * 			created or connected with. app_dns_client_check compares it with the background
+ * 			lookups before every request.
+ * *****************************************************************************
+ */
+typedef struct {
+	app_dns_entry_t *entry;	/*!< Entry of the server name, NULL if the URL has none */
+	ip_addr_t addr;			/*!< Address the client has been following, any until the first answer */
+	bool is_http;			/*!< Plain HTTP URL, the address may stand in for the name */
+	bool is_addr_url;		/*!< The last known address stands in for the name in the URL */
+} app_dns_client_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Start the background lookups
+ * @return
+ * 				- None
+ */
+void app_dns_init(void);
+
+/**
+ * @brief		Start resolving the server name of the URL without waiting for the answer,
+ * 				the name is then kept resolved in the background
+ * @param[in]	url	URL of the server
+ * @return
+ * 				- None
+ */
+void app_dns_prefetch(const char *url);
+
+/**
+ * @brief		Create an HTTP client, in place of esp_http_client_init. The server name is
+ * 				kept resolved in the background. If the server name of a plain HTTP URL
+ * 				cannot be resolved in APP_DNS_WAIT_MS, the last known address is put into the
+ * 				URL and the name is sent in the Host header
+ * @param[in]	cfg	HTTP client configuration
+ * @return
+ * 				- esp_http_client handle, NULL on error
+ */
+esp_http_client_handle_t app_dns_client_init(const esp_http_client_config_t *cfg);
+
+/**
+ * @brief		Create a long-lived HTTP client, as app_dns_client_init
+ * @param[out]	client	A pointer to the server name of the client, for app_dns_client_check
+ * @param[in]	cfg		HTTP client configuration
+ * @return
+ * 				- esp_http_client handle, NULL on error
+ */
+esp_http_client_handle_t app_dns_client_init_kept(app_dns_client_t *client, const esp_http_client_config_t *cfg);
+
+/**
+ * @brief		Compare the address of a long-lived client with the background lookups,
+ * 				called before every request
+ * @param[in]	client			A pointer to the server name of the client
+ * @param[in]	is_connected	The client has a connection open, the last known address does not
+ * 								need to stand in for a name that fails to resolve
+ * @return
+ * 				- APP_DNS_REBUILD: The client has to be created again with app_dns_client_init_kept
+ * 				- APP_DNS_MOVED: The open connection has to be closed
+ * 				- APP_DNS_UNCHANGED: Nothing to do
+ */
+app_dns_change_e app_dns_client_check(app_dns_client_t *client, bool is_connected);
+
+#endif	/* APP_DNS_H__ */
@@ -0,0 +1,140 @@
+/**
+ * *****************************************************************************
+ * @file		app_http_conn.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Persistent connections of the repeated work server requests
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_HTTP_CONN_H__
+#define APP_HTTP_CONN_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+#include <esp_http_client.h>
+
+/* User files */
+#include "app_dns.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+#define APP_HTTP_CONN_HEADERS	2	/*!< Request headers kept for a handle created again */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Persistent connection related structure
+ * *****************************************************************************
+ * @note	The connection, and its TLS session with it, is left open after a response
+ * 			whose body has been read to the end, and the next request of the same handle
+ * 			is sent over it without a new handshake. A kept connection the server has
+ * 			closed meanwhile is detected by the failed request, which is then repeated
+ * 			once over a new connection, so only idempotent requests may use it.
+ * 			The connection follows the server address: it is closed when the name resolves
+ * 			to another address, and the handle is created again from its configuration when
+ * 			the last known address has to stand in for the name or the name resolves again.
+ * *****************************************************************************
+ */
+typedef struct {
+	esp_http_client_handle_t hdl;						/*!< esp_http_client handle of the requests */
+	esp_http_client_config_t cfg;						/*!< Configuration of the handle, the strings
+														 * it points to must stay valid */
+	const char *headers[APP_HTTP_CONN_HEADERS][2];		/*!< Request headers of every request, key and value */
+	app_dns_client_t dns;								/*!< Server name of the handle */
+	bool is_kept;										/*!< The connection is open after the previous response */
+	bool is_closing;									/*!< The server has asked to close the connection */
+} app_http_conn_t;
+
+/**
+ * @brief	Connection statistics shared by all persistent connections
+ * *****************************************************************************
+ * @note	The counters measure the reuse of the open connections. A new HTTPS connection
+ * 			always makes a full TLS handshake, as the TLS sessions are not cached.
+ * *****************************************************************************
+ */
+typedef struct {
+	uint32_t reused_cnt;	/*!< Number of requests sent over a kept connection */
+	uint32_t new_cnt;		/*!< Number of requests that opened a new connection */
+	uint32_t stale_cnt;		/*!< Number of kept connections found closed by the server */
+	int64_t connect_us;		/*!< Time spent on opening the new connections */
+} app_http_conn_stats_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Create the handle of the connection
+ * @param[out]	conn	A pointer to the connection instance
+ * @param[in]	cfg		HTTP client configuration, the strings it points to must stay valid
+ * @return
+ * 				- ESP_ERR_NO_MEM: The handle has not been created
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_http_conn_init(app_http_conn_t *conn, const esp_http_client_config_t *cfg);
+
+/**
+ * @brief		Set a header of every request, kept for the handle created again
+ * @param[in]	conn	A pointer to the connection instance
+ * @param[in]	key		Header name, must stay valid
+ * @param[in]	value	Header value, must stay valid
+ * @return
+ * 				- ESP_ERR_NO_MEM: No room for the header
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_http_conn_set_header(app_http_conn_t *conn, const char *key, const char *value);
+
+/**
+ * @brief		Follow a change of the server address before the next request. The handle
+ * 				may be created again, so the headers of a single request are set after it
+ * @param[in]	conn	A pointer to the connection instance
+ * @return
+ * 				- None
+ */
+void app_http_conn_follow(app_http_conn_t *conn);
+
+/**
+ * @brief		Send a request without a body and receive the response headers, over the
+ * 				kept connection if there is one
+ * @param[in]	conn	A pointer to the connection instance
+ * @return
+ * 				- Content length returned by esp_http_client_fetch_headers
+ * 				- ESP_FAIL: The request has failed, the connection is closed
+ */
+int32_t app_http_conn_request(app_http_conn_t *conn);
+
+/**
+ * @brief		Pick up the Connection header of the response, called from the HTTP client
+ * 				event handler of the request
+ * @param[in]	conn	A pointer to the connection instance
+ * @param[in]	evt		HTTP client event
+ * @return
+ * 				- None
+ */
+void app_http_conn_on_header(app_http_conn_t *conn, const esp_http_client_event_t *evt);
+
+/**
+ * @brief		Finish the response, keeps the connection if it may carry the next request
+ * @param[in]	conn		A pointer to the connection instance
+ * @param[in]	is_drained	The body of the response has been read to the end
+ * @return
+ * 				- None
+ */
+void app_http_conn_done(app_http_conn_t *conn, bool is_drained);
+
+/**
+ * @brief		Take the statistics gathered since the previous call
+ * @param[out]	stats	A pointer to the structure to fill
+ * @return
+ * 				- None
+ */
+void app_http_conn_take_stats(app_http_conn_stats_t *stats);
+
+#endif	/* APP_HTTP_CONN_H__ */
@@ -0,0 +1,127 @@
+/**
+ * *****************************************************************************
+ * @file		app_http_reader.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Reader of the work server response bodies, transparently inflates
+ * 				the gzip content encoding
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_HTTP_READER_H__
+#define APP_HTTP_READER_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <esp32/rom/miniz.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define APP_HTTP_READER_IN_SIZE		256	/*!< Size of the buffer of the compressed input */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Response reader related structure
+ * *****************************************************************************
+ * @note	The inflater state and its 32 KB window are allocated, in PSRAM if available,
+ * 			on the first gzip response and kept until app_http_reader_deinit, so a reader
+ * 			used by a polling loop does not allocate on every request. Responses without
+ * 			Content-Encoding are passed through as they are. A chunked body, the usual
+ * 			form of a body compressed on the fly, is read up to its last chunk.
+ * *****************************************************************************
+ */
+typedef struct {
+	esp_http_client_handle_t hdl;		/*!< esp_http_client handle of the request */
+	bool is_gzip;						/*!< The response is gzip encoded */
+	bool is_done;						/*!< The compressed stream is complete */
+	bool is_chunked;					/*!< The body is sent in chunks, its length is unknown */
+	bool is_eof;						/*!< The last chunk has been received */
+	int32_t remaining;					/*!< Number of body bytes not received yet, 0 if chunked */
+	uint32_t wire_bytes;				/*!< Number of body bytes received */
+	tinfl_decompressor *inflater;		/*!< Inflater state */
+	uint8_t *window;					/*!< Circular window the inflater writes to */
+	size_t win_pos;						/*!< Next write position in the window */
+	size_t out_pos;						/*!< Position of the inflated data not yet returned */
+	size_t out_len;						/*!< Length of the inflated data not yet returned */
+	uint32_t crc;						/*!< CRC-32 of the inflated data */
+	uint32_t size;						/*!< Length of the inflated data */
+	size_t in_pos;						/*!< Next byte of the input buffer */
+	size_t in_len;						/*!< Number of bytes in the input buffer */
+	uint8_t in_buf[APP_HTTP_READER_IN_SIZE];	/*!< Compressed input */
+} app_http_reader_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Prepare the reader for a new request, called before esp_http_client_open.
+ * 				Offers the gzip encoding if APP_API_GZIP is enabled
+ * @param[in]	reader	A pointer to the reader instance, zeroed before the first use
+ * @param[in]	hdl		esp_http_client handle of the request
+ * @return
+ * 				- None
+ */
+void app_http_reader_prepare(app_http_reader_t *reader, esp_http_client_handle_t hdl);
+
+/**
+ * @brief		Pick up the Content-Encoding of the response, called from the HTTP client
+ * 				event handler of the request
+ * @param[in]	reader	A pointer to the reader instance
+ * @param[in]	evt		HTTP client event
+ * @return
+ * 				- None
+ */
+void app_http_reader_on_header(app_http_reader_t *reader, const esp_http_client_event_t *evt);
+
+/**
+ * @brief		Start reading the body, called after esp_http_client_fetch_headers
+ * @param[in]	reader		A pointer to the reader instance
+ * @param[in]	content_len	Body length returned by esp_http_client_fetch_headers, ignored for
+ * 							a chunked response
+ * @return
+ * 				- ESP_ERR_NO_MEM: The inflater could not be allocated
+ * 				- ESP_FAIL: Malformed gzip header
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_http_reader_start(app_http_reader_t *reader, int32_t content_len);
+
+/**
+ * @brief		Read the next piece of the body
+ * @param[in]	reader	A pointer to the reader instance
+ * @param[out]	buf		Buffer to fill
+ * @param[in]	len		Buffer size in bytes
+ * @return
+ * 				- Number of bytes read, 0 at the end of the body, -1 on a network error,
+ * 				  a corrupted stream or a CRC mismatch
+ */
+int32_t app_http_reader_read(app_http_reader_t *reader, char *buf, size_t len);
+
+/**
+ * @brief		Tell whether the body has been received to its end, so the connection may
+ * 				carry the next request
+ * @param[in]	reader	A pointer to the reader instance
+ * @return
+ * 				- false: Part of the body has not been received
+ * 				- true: The body has been received to its end
+ */
+bool app_http_reader_is_complete(const app_http_reader_t *reader);
+
+/**
+ * @brief		Release the inflater of the reader
+ * @param[in]	reader	A pointer to the reader instance
+ * @return
+ * 				- None
+ */
+void app_http_reader_deinit(app_http_reader_t *reader);
+
+#endif	/* APP_HTTP_READER_H__ */
@@ -0,0 +1,81 @@
+/**
+ * *****************************************************************************
+ * @file		app_lease.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		DHCP leases of the access points, reused on reconnect
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_LEASE_H__
+#define APP_LEASE_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_wifi.h>
+#include <tcpip_adapter.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define LEASE_CACHE_SIZE		8		/*!< Number of BSSIDs whose leases are kept */
+#define LEASE_DEFAULT_S			3600	/*!< Lease time assumed when the server has not given one */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	DHCP lease of an access point
+ * *****************************************************************************
+ * @note	The address is taken before the association when the lease has not reached
+ * 			its renewal time (T1, half of the lease). The station then gets its address
+ * 			as soon as it is associated, and the DHCP client confirms the lease in the
+ * 			background: the same address is bound again without dropping the
+ * 			connections, a refused one is replaced. The leases are counted with the
+ * 			esp_timer clock, so they are kept from one connect to another, not across
+ * 			restarts; a restart asks DHCP for the last address with INIT-REBOOT
+ * 			(CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+ * *****************************************************************************
+ */
+typedef struct {
+	uint8_t bssid[6];					/*!< BSSID of the access point */
+	tcpip_adapter_ip_info_t ip_info;	/*!< Address, netmask and gateway */
+	tcpip_adapter_dns_info_t dns[2];	/*!< Main and backup DNS servers */
+	uint32_t lease_s;					/*!< Lease time given by the server */
+	int64_t bound_us;					/*!< esp_timer time the lease has been bound at, 0 if the entry is free */
+} app_lease_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Set up the address of the station before it connects: the cached lease of
+ * 				the BSSID if it is fresh, DHCP otherwise. Called before every esp_wifi_connect
+ * @param[in]	sta		Station configuration of the connect
+ * @return
+ * 				- None
+ */
+void app_lease_prepare(const wifi_sta_config_t *sta);
+
+/**
+ * @brief		Store the lease of the current association, or start its confirmation if
+ * 				it has been taken from the cache. Called on SYSTEM_EVENT_STA_GOT_IP
+ * @return
+ * 				- None
+ */
+void app_lease_on_got_ip(void);
+
+/**
+ * @brief		Let another access point of the network reuse the lease of the current one,
+ * 				called before roaming to it
+ * @param[in]	bssid	BSSID of the other access point
+ * @return
+ * 				- None
+ */
+void app_lease_carry(const uint8_t *bssid);
+
+#endif	/* APP_LEASE_H__ */
@@ -0,0 +1,113 @@
+/**
+ * *****************************************************************************
+ * @file		app_link.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		WiFi link quality service
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_LINK_H__
+#define APP_LINK_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "app_link_model.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+/**
+ * @brief	Link quality service
+ * *****************************************************************************
+ * @note	The link is sampled every LINK_SAMPLE_MS and the health is passed to the
+ * 			subscribers after every sample. With LINK_TRACE enabled, every sample is logged
+ * 			as a trace line of app_link_trace_format: tools/link_replay feeds the lines of
+ * 			a console log to the model on the host, and the device replays them with
+ * 			app_link_feed after app_link_stop.
+ * *****************************************************************************
+ */
+#define LINK_SAMPLE_MS			1000
+#define LINK_MAX_SUBSCRIBERS	4
+#define LINK_TRACE				(0)
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief		Health callback, called from the esp_timer task: it must not block
+ * @param[in]	health	A pointer to the health of the link
+ * @param[in]	arg		Argument given to app_link_subscribe
+ */
+typedef void (*app_link_cb_t)(const app_link_health_t *health, void *arg);
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Start sampling the link
+ * @return
+ * 				- ESP_ERR_NO_MEM: The sampling timer has not been created
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_link_init(void);
+
+/**
+ * @brief		Stop sampling the link, the health is then changed by app_link_feed only
+ * @return
+ * 				- None
+ */
+void app_link_stop(void);
+
+/**
+ * @brief		Take a sample into account and pass the health to the subscribers
+ * @param[in]	sample	A pointer to the sample
+ * @return
+ * 				- None
+ */
+void app_link_feed(const app_link_sample_t *sample);
+
+/**
+ * @brief		Get the health of the link
+ * @param[out]	health	A pointer to the health
+ * @return
+ * 				- None
+ */
+void app_link_get(app_link_health_t *health);
+
+/**
+ * @brief		Subscribe to the health of the link. Subscribing twice with the same callback
+ * 				and argument has no effect
+ * @param[in]	cb		Health callback
+ * @param[in]	arg		Argument of the callback
+ * @return
+ * 				- ESP_ERR_NO_MEM: LINK_MAX_SUBSCRIBERS are already subscribed
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_link_subscribe(app_link_cb_t cb, void *arg);
+
+/**
+ * @brief		Account the bytes of a transfer
+ * @param[in]	len			Number of bytes moved
+ * @param[in]	is_waiting	The flow was waiting for the network, not for its source or sink
+ * @return
+ * 				- None
+ */
+void app_link_note_bytes(size_t len, bool is_waiting);
+
+/**
+ * @brief		Account a failed transfer
+ * @return
+ * 				- None
+ */
+void app_link_note_failure(void);
+
+#endif	/* APP_LINK_H__ */
@@ -0,0 +1,123 @@
+/**
+ * *****************************************************************************
+ * @file		app_link_model.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Health model of the WiFi link and its trace format
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_LINK_MODEL_H__
+#define APP_LINK_MODEL_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define LINK_RSSI_FLOOR			(-90)		/*!< RSSI scored 0 */
+#define LINK_RSSI_CEIL			(-55)		/*!< RSSI scored 100 */
+#define LINK_GOODPUT_GOOD		(64 * 1024)	/*!< Goodput scored 100, bytes per second */
+#define LINK_FAIL_MAX			10			/*!< Failures of a sample taken into account */
+#define LINK_SCORE_POOR			40			/*!< Score below which the link is poor */
+#define LINK_SCORE_GOOD			70			/*!< Score from which the link is good */
+#define LINK_TRACE_LINE_SIZE	48			/*!< Longest trace line with its terminator */
+
+/* PHY modes of the association */
+#define LINK_PHY_11B			(1U << 0)
+#define LINK_PHY_11G			(1U << 1)
+#define LINK_PHY_11N			(1U << 2)
+#define LINK_PHY_HT40			(1U << 3)
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Sample of the link
+ * *****************************************************************************
+ * @note	The WiFi driver tells neither the rate nor the retries of the frames, so the
+ * 			PHY modes of the association stand in for the rate and the transfers that
+ * 			failed for the retries. The bytes are the ones moved while a media flow was
+ * 			waiting for the network, the only ones that tell the capacity of the link.
+ * *****************************************************************************
+ */
+typedef struct {
+	int64_t time_ms;		/*!< Time of the sample */
+	int8_t rssi;			/*!< RSSI of the association, 0 if the station is not associated */
+	uint8_t phy;			/*!< LINK_PHY_* modes of the association */
+	uint32_t bytes;			/*!< Bytes moved since the previous sample */
+	uint16_t fail_cnt;		/*!< Transfers failed since the previous sample */
+} app_link_sample_t;
+
+/** @brief	Link quality levels */
+typedef enum {
+	LINK_DOWN = 0,
+	LINK_POOR,
+	LINK_FAIR,
+	LINK_GOOD,
+} app_link_level_e;
+
+/** @brief	Health of the link */
+typedef struct {
+	bool is_up;				/*!< The station is associated */
+	int8_t rssi;			/*!< Smoothed RSSI */
+	uint8_t phy;			/*!< LINK_PHY_* modes of the association */
+	uint8_t score;			/*!< Health score from 0 (down) to 100 */
+	app_link_level_e level;	/*!< Level of the score */
+	uint32_t goodput;		/*!< Goodput estimate in bytes per second, 0 until measured */
+	uint16_t fail_avg;		/*!< Smoothed failures per sample, in hundredths */
+} app_link_health_t;
+
+/** @brief	Health model state */
+typedef struct {
+	app_link_health_t health;	/*!< Health after the last sample */
+	int64_t last_ms;			/*!< Time of the last sample, 0 before the first one */
+} app_link_model_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Reset the model
+ * @param[out]	model	A pointer to the model
+ * @return
+ * 				- None
+ */
+void app_link_model_init(app_link_model_t *model);
+
+/**
+ * @brief		Take a sample into account
+ * @param[in]	model	A pointer to the model
+ * @param[in]	sample	A pointer to the sample
+ * @return
+ * 				- None
+ * @note		The model uses no framework functions, the same samples give the same
+ * 				health on the device and on a host replaying a trace.
+ */
+void app_link_model_feed(app_link_model_t *model, const app_link_sample_t *sample);
+
+/**
+ * @brief		Format a sample as a trace line "L,<time_ms>,<rssi>,<phy>,<bytes>,<fail_cnt>"
+ * @param[in]	sample	A pointer to the sample
+ * @param[out]	buf		Line buffer
+ * @param[in]	size	Size of the buffer, LINK_TRACE_LINE_SIZE is enough
+ * @return
+ * 				- Length of the line
+ */
+int app_link_trace_format(const app_link_sample_t *sample, char *buf, size_t size);
+
+/**
+ * @brief		Parse a trace line. The line may be preceded by a log prefix
+ * @param[in]	line	Trace line
+ * @param[out]	sample	A pointer to the sample
+ * @return
+ * 				- false: The line holds no sample
+ * 				- true: Success
+ */
+bool app_link_trace_parse(const char *line, app_link_sample_t *sample);
+
+#endif	/* APP_LINK_MODEL_H__ */
@@ -0,0 +1,101 @@
+/**
+ * *****************************************************************************
+ * @file		app_outbox.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Reports to the server kept while the station is offline
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_OUTBOX_H__
+#define APP_OUTBOX_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "uuid.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+#define OUTBOX_SIZE		8	/*!< Number of reports kept, the oldest one is dropped first */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/** @brief	Types of the reports */
+typedef enum {
+	OUTBOX_TRACK_DONE = 1,	/*!< End of reproduction of the track of the key */
+} app_outbox_type_e;
+
+/**
+ * @brief	Report waiting to be sent
+ * *****************************************************************************
+ * @note	The reports are idempotent and coalesced: the outbox holds one report per
+ * 			type and key, and putting it again changes nothing. The outbox is written to
+ * 			the file system with every change, so the reports survive a restart, and is
+ * 			flushed in one pass once a profile request has succeeded.
+ * *****************************************************************************
+ */
+typedef struct {
+	uint8_t type;	/*!< Type of the report, app_outbox_type_e */
+	uuid_t key;		/*!< Object of the report */
+} app_outbox_entry_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Load the reports kept before the restart
+ * @return
+ * 				- ESP_ERR_NO_MEM: The lock has not been created
+ * 				- ESP_OK: Success, the outbox may be empty
+ */
+esp_err_t app_outbox_init(void);
+
+/**
+ * @brief		Keep a report until it is sent
+ * @param[in]	type	Type of the report
+ * @param[in]	key		Object of the report
+ * @return
+ * 				- ESP_FAIL: The outbox is not available or has not been saved
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_outbox_put(app_outbox_type_e type, const uuid_t *key);
+
+/**
+ * @brief		Check for a report
+ * @param[in]	type	Type of the report
+ * @param[in]	key		Object of the report
+ * @return
+ * 				- true: The report is waiting to be sent
+ * 				- false: Otherwise
+ */
+bool app_outbox_has(app_outbox_type_e type, const uuid_t *key);
+
+/**
+ * @brief		Copy the reports waiting to be sent, the oldest first
+ * @param[out]	entries	Reports
+ * @param[in]	max		Size of the array, OUTBOX_SIZE is enough
+ * @return
+ * 				- Number of the reports copied
+ */
+size_t app_outbox_peek(app_outbox_entry_t *entries, size_t max);
+
+/**
+ * @brief		Remove the reports sent, the outbox is saved once
+ * @param[in]	entries	Reports
+ * @param[in]	count	Number of the reports
+ * @return
+ * 				- None
+ */
+void app_outbox_remove(const app_outbox_entry_t *entries, size_t count);
+
+#endif	/* APP_OUTBOX_H__ */
@@ -0,0 +1,40 @@
+/**
+ * *****************************************************************************
+ * @file		app_profile.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Device profile received from the work server
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_PROFILE_H__
+#define APP_PROFILE_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+
+/* User files */
+#include "app_device_desc.h"
+#include "sound_recorder.h"
+#include "uuid.h"
+
+/* Export typedef ------------------------------------------------------------*/
+
+/** @brief	Structure used to describe the device profile */
+typedef struct {
+	BaseType_t is_muted;					/*!< Audio output has been disabled flag */
+	BaseType_t is_player;					/*!< Sound player active flag */
+	BaseType_t is_recorder;					/*!< Sound recorder active flag */
+	char id[DEVICE_CLIENT_ID_STR_SIZE + 1];	/*!< String for storing device ID */
+	char name[33];							/*!< String for storing device name */
+	double vol;								/*!< Current sound level value from 0 to 100 */
+	double track_cnt;						/*!< The current number of tracks in the queue */
+	uuid_t track_id;						/*!< Unique identifier of the track being played */
+	sound_recorder_profile_t rec_cfg;		/*!< Requested settings of the capture pipeline */
+} app_client_profile_t;
+
+#endif	/* APP_PROFILE_H__ */
@@ -0,0 +1,123 @@
+/**
+ * *****************************************************************************
+ * @file		app_profile_parser.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Streaming parser of the device profile JSON, with a CBOR variant
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_PROFILE_PARSER_H__
+#define APP_PROFILE_PARSER_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "app_profile.h"
+#include "sound_recorder.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+#define PROFILE_PARSER_TOKEN_SIZE	48	/*!< Longest key, string value or number literal kept, longer
+										 * strings are truncated and longer literals are rejected */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/** @brief	Profile parser state space enumeration */
+typedef enum {
+	PROFILE_PARSER_START = 0,	/*!< Waiting for the opening brace */
+	PROFILE_PARSER_OBJECT,		/*!< Waiting for the first key or the closing brace */
+	PROFILE_PARSER_ARRAY,		/*!< Waiting for the first value or the closing bracket */
+	PROFILE_PARSER_KEY_START,	/*!< Waiting for the next key */
+	PROFILE_PARSER_KEY,			/*!< Reading a key */
+	PROFILE_PARSER_COLON,		/*!< Waiting for the colon after a key */
+	PROFILE_PARSER_VALUE,		/*!< Waiting for a value */
+	PROFILE_PARSER_STRING,		/*!< Reading a string value */
+	PROFILE_PARSER_LITERAL,		/*!< Reading a number, true, false or null */
+	PROFILE_PARSER_NEXT,		/*!< Waiting for a comma or the closing brace or bracket */
+	PROFILE_PARSER_DONE,		/*!< The profile object is complete */
+	PROFILE_PARSER_ERROR,		/*!< Malformed input */
+} app_profile_parser_state_e;
+
+/**
+ * @brief	Profile parser instance
+ * *****************************************************************************
+ * @note	The parser walks the top-level object byte by byte and stores the values of the
+ * 			known keys straight into app_client_profile_t, so the response can be fed in the
+ * 			pieces returned by esp_http_client_read and no heap memory is used. Unknown keys
+ * 			are skipped together with their nested objects and arrays, which are checked for
+ * 			the JSON syntax all the same. Only the first occurrence of a key counts.
+ * *****************************************************************************
+ */
+typedef struct {
+	app_client_profile_t *profile;						/*!< Profile being filled */
+	app_profile_parser_state_e state;					/*!< Current parser state */
+	uint8_t field;										/*!< Known field the current value belongs to */
+	uint8_t depth;										/*!< Nesting depth, 1 in the profile object */
+	uint8_t esc;										/*!< Escape sequence progress: 0 - none, 1 - after
+														 * the backslash, 2..5 - \u hex digits */
+	uint32_t arrays;									/*!< Bit mask of the nesting levels that are arrays */
+	uint16_t code;										/*!< UTF-16 code unit of the \u escape */
+	uint16_t high;										/*!< High surrogate waiting for its pair */
+	char tok[PROFILE_PARSER_TOKEN_SIZE];				/*!< Current key, string or literal */
+	size_t tok_len;										/*!< Length of the current token */
+	uint32_t seen;										/*!< Bit mask of the fields found */
+	const sound_recorder_profile_t *rec_base;			/*!< Capture profile chosen by name */
+	uint32_t rec_over[4];								/*!< Capture profile field overrides, 0 - none */
+} app_profile_parser_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Prepare the parser for a new profile
+ * @param[out]	parser	A pointer to the parser instance
+ * @param[out]	profile	A pointer to the profile to fill, it is cleared
+ * @return
+ * 				- None
+ */
+void app_profile_parser_init(app_profile_parser_t *parser, app_client_profile_t *profile);
+
+/**
+ * @brief		Feed the next piece of the profile JSON to the parser
+ * @param[in]	parser	A pointer to the parser instance
+ * @param[in]	data	Pointer to the data
+ * @param[in]	len		Data length in bytes
+ * @return
+ * 				- ESP_FAIL: Malformed input, the rest of the data is ignored
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_profile_parser_feed(app_profile_parser_t *parser, const char *data, size_t len);
+
+/**
+ * @brief		Complete parsing of the profile
+ * @param[in]	parser	A pointer to the parser instance
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: Critical parameter was not found
+ * 				- ESP_FAIL: Malformed or incomplete input
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_profile_parser_finish(app_profile_parser_t *parser);
+
+/**
+ * @brief		Parse a profile encoded in CBOR, a map with the same keys as the JSON object.
+ * 				The result is checked with app_profile_parser_finish as for JSON
+ * @param[in]	parser	A pointer to the parser instance, nothing must have been fed to it
+ * @param[in]	data	Pointer to the complete document
+ * @param[in]	len		Document length in bytes
+ * @return
+ * 				- ESP_FAIL: Malformed input
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_profile_parser_cbor(app_profile_parser_t *parser, const void *data, size_t len);
+
+#endif	/* APP_PROFILE_PARSER_H__ */
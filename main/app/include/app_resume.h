@@ -0,0 +1,69 @@
+/**
+ * *****************************************************************************
+ * @file		app_resume.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Last applied profile and player position, kept across restarts
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_RESUME_H__
+#define APP_RESUME_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "sound_player.h"
+#include "app_client.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+#define RESUME_FLASH_PERIOD_MS		(5 * 60 * 1000)	/*!< Shortest interval between the flash writes caused
+														 * by the player position alone */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	State the device resumes from
+ * *****************************************************************************
+ * @note	A copy is kept in the RTC memory, which survives a software reset, a panic
+ * 			and a watchdog reset, and is refreshed with every profile request. Another
+ * 			copy is kept in the file system for a cold boot; it is written when the
+ * 			profile changes, the position alone is written at most every
+ * 			RESUME_FLASH_PERIOD_MS.
+ * *****************************************************************************
+ */
+typedef struct {
+	app_client_profile_t profile;	/*!< Last profile received from the server */
+	uint32_t play_pos;				/*!< Bytes of the track of the profile played so far */
+} app_resume_state_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Load the state saved before the restart, the RTC copy is preferred
+ * @param[out]	state	State to fill
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: Nothing has been saved, or the copies are damaged
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_resume_load(app_resume_state_t *state);
+
+/**
+ * @brief		Save the last applied profile and the player position
+ * @param[in]	profile		Last profile received from the server
+ * @param[in]	play_pos	Bytes of the current track played so far, 0 if nothing is played
+ * @return
+ * 				- None
+ */
+void app_resume_save(const app_client_profile_t *profile, uint32_t play_pos);
+
+#endif	/* APP_RESUME_H__ */
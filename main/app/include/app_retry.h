@@ -0,0 +1,100 @@
+/**
+ * *****************************************************************************
+ * @file		app_retry.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Retries of the network operations with an exponential backoff
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_RETRY_H__
+#define APP_RETRY_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_err.h>
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Retry policy
+ * *****************************************************************************
+ * @note	The delay before the n-th retry is drawn from the upper half of
+ * 			base_ms * 2^(n - 1), capped at max_ms. The random half keeps the devices that
+ * 			have lost the same server from retrying in step. The retries stop after
+ * 			max_attempts attempts or once deadline_ms has passed since app_retry_init,
+ * 			and at once when one of cancel_bits is set in the application event group.
+ * *****************************************************************************
+ */
+typedef struct {
+	uint32_t base_ms;			/*!< Delay before the first retry */
+	uint32_t max_ms;			/*!< Longest delay */
+	uint32_t deadline_ms;		/*!< Time the attempts may take, 0 for no limit */
+	uint16_t max_attempts;		/*!< Number of attempts, the first one included, 0 for no limit */
+	EventBits_t cancel_bits;	/*!< Bits of the application event group that cancel the retries */
+} app_retry_policy_t;
+
+/** @brief	Retry state of an operation */
+typedef struct {
+	const app_retry_policy_t *policy;	/*!< Policy of the retries */
+	uint16_t attempt;					/*!< Attempts made so far */
+	int64_t deadline;					/*!< esp_timer time the retries stop at, 0 for none */
+} app_retry_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Start counting the attempts of an operation
+ * @param[out]	retry	A pointer to the retry state
+ * @param[in]	policy	A pointer to the policy, kept by the state
+ * @return
+ * 				- None
+ */
+void app_retry_init(app_retry_t *retry, const app_retry_policy_t *policy);
+
+/**
+ * @brief		Note a successful attempt, the next failure starts from the base delay
+ * @param[in]	retry	A pointer to the retry state
+ * @return
+ * 				- None
+ */
+void app_retry_reset(app_retry_t *retry);
+
+/**
+ * @brief		Note a failed attempt and wait for the next one
+ * @param[in]	retry	A pointer to the retry state
+ * @return
+ * 				- ESP_ERR_INVALID_STATE: A cancel bit is set, before or during the wait
+ * 				- ESP_ERR_TIMEOUT: No attempts or time left
+ * 				- ESP_OK: The operation may be attempted again
+ */
+esp_err_t app_retry_wait(app_retry_t *retry);
+
+/**
+ * @brief		Note a failed attempt and get the time of the next one, for the tasks that
+ * 				keep working meanwhile. The attempts and the deadline are not limited
+ * @param[in]	retry	A pointer to the retry state
+ * @return
+ * 				- esp_timer time of the next attempt
+ */
+int64_t app_retry_schedule(app_retry_t *retry);
+
+/**
+ * @brief		Check the cancel bits of the policy
+ * @param[in]	retry	A pointer to the retry state
+ * @return
+ * 				- true: The retries are cancelled
+ * 				- false: Otherwise
+ */
+bool app_retry_is_cancelled(const app_retry_t *retry);
+
+#endif	/* APP_RETRY_H__ */
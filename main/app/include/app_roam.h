@@ -0,0 +1,43 @@
+/**
+ * *****************************************************************************
+ * @file		app_roam.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Roaming between the access points of the current network
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_ROAM_H__
+#define APP_ROAM_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdint.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define ROAM_CHECK_MS			2000	/*!< Period of the link checks */
+#define ROAM_RSSI_WEAK			(-70)	/*!< Smoothed RSSI below which better access points are looked for */
+#define ROAM_HYSTERESIS_DB		8		/*!< Margin by which another access point has to be stronger */
+#define ROAM_SCAN_GAP_MS		20000	/*!< Shortest interval between the roaming scans */
+#define ROAM_SCAN_DWELL_MS		40		/*!< Active scan time per channel, keeps the off-channel gaps short */
+#define ROAM_MIN_QUEUED			60		/*!< Player queue blocks that cover the roaming gap */
+#define ROAM_CANDIDATE_MS		10000	/*!< Time a candidate waits for the player queue to fill */
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Roaming task, watches the smoothed RSSI of the link (app_link) and moves
+ * 				the station to a stronger BSSID of the same SSID
+ * @param[in]	arg	A pointer to the main application structure
+ * @return
+ * 				- None
+ * @note		Roaming waits until the player queue holds ROAM_MIN_QUEUED blocks, or the
+ * 				player is idle, so that the audio covers the reassociation.
+ */
+void app_roam_task(void *arg);
+
+#endif	/* APP_ROAM_H__ */
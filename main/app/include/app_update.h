@@ -26,4 +26,13 @@
  */
 void app_update_get_and_check_version();
 
+/**
+ * @brief	Check the firmware version in a task of its own, after the first profile has
+ * 			been applied and the first track has had time to buffer
+ * @param	None
+ * @return
+ * 			- None
+ */
+void app_update_check_deferred(void);
+
 #endif	/* APP_UPDATE_H__ */
@@ -33,6 +33,11 @@ extern const char *wifi_ap_recs_path;	/*!< Name of the file containing the data
 #define DEFAULT_WIFI_PASSWORD_LEN	64	/*!< The amount of memory allocated for AP password in bytes */
 #define DEFAULT_SCAN_LIST_SIZE		4	/*!< The amount of memory allocated for access point data when scanning.
 										 * Multiple of wifi_ap_record_t structure size */
+#define WIFI_RANK_SCAN_SIZE			16	/*!< Number of access points the boot scan ranks the saved ones among */
+#define WIFI_LOGIN_TIMEOUT_MS		5000	/*!< Network timeout of the login request */
+#define WIFI_LOGIN_DEADLINE_MS		20000	/*!< Time the login request is retried for */
+#define WIFI_LOGIN_RETRY_BASE_MS	250		/*!< First delay between the login attempts */
+#define WIFI_LOGIN_RETRY_MAX_MS		4000	/*!< Longest delay between the login attempts */
 
 /**
  * @defgroup	wifi_event_bits WiFi event group related bits
@@ -46,6 +51,7 @@ extern const char *wifi_ap_recs_path;	/*!< Name of the file containing the data
 #define BIT_NEW_WIFI_CONF			BIT5
 #define BIT_RECONNECT				BIT6
 #define BIT_CONN_CORRUPTED			BIT7
+#define BIT_ROAMING					BIT8
 
 /** @}*/
 
@@ -99,6 +105,15 @@ void app_wifi_wait_conn_attempt(EventGroupHandle_t event_group);
  * @{
  */
 
+/**
+ * @brief		Start the network interface and the WiFi driver in station mode, runs
+ * 				before the device descriptor is read
+ * @param[in]	ctx	User context
+ * @return
+ * 				- None
+ */
+void app_wifi_radio_start(void *ctx);
+
 /**
  * @brief		Initialize the application WiFi node
  * @param[in]	ctx	User context
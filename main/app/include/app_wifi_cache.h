@@ -0,0 +1,128 @@
+/**
+ * *****************************************************************************
+ * @file		app_wifi_cache.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Association parameters of the saved access points, kept to shorten
+ * 				the next connect
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_WIFI_CACHE_H__
+#define APP_WIFI_CACHE_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Framework */
+#include <esp_err.h>
+
+/* User files */
+#include "app_spiffs.h"
+
+/* Export constants ----------------------------------------------------------*/
+
+#define WIFI_CACHE_SIZE			8	/*!< Number of access points kept, the least recently used is replaced */
+#define WIFI_CACHE_PMK_LEN		32	/*!< Length of the WPA2 pairwise master key */
+#define WIFI_CACHE_HISTORY		32	/*!< Number of connects after which the success counters are halved */
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief	Association parameters of an access point
+ * *****************************************************************************
+ * @note	The BSSID and the channel let the station connect without scanning all the
+ * 			channels. The PMK is what the station would derive from the password with
+ * 			4096 rounds of PBKDF2 on every connect; it is given to the driver as the
+ * 			64 hexadecimal digits password. It is only used while the CRC of the saved
+ * 			password matches the one it has been derived from. The connect counters
+ * 			give the success rate used to rank the access points found by a scan.
+ * *****************************************************************************
+ */
+typedef struct {
+	char ssid[SPIFFS_WIFI_SSID_LENGTH + 1];	/*!< SSID of the access point */
+	uint8_t bssid[6];						/*!< BSSID of the last association */
+	uint8_t channel;						/*!< Primary channel of the last association, 0 if not known */
+	bool is_pmk;							/*!< The PMK is valid */
+	uint8_t pmk[WIFI_CACHE_PMK_LEN];		/*!< PMK derived from the password */
+	uint32_t pass_crc;						/*!< CRC-32 of the password the PMK has been derived from */
+	uint32_t seq;							/*!< Order of the last use */
+	uint16_t attempt_cnt;					/*!< Number of recent connects */
+	uint16_t success_cnt;					/*!< Number of them that have succeeded */
+} app_wifi_cache_rec_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Load the records from the file system, called once before the first join
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: There is no valid file, the cache starts empty
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_wifi_cache_load(void);
+
+/**
+ * @brief		Find the association parameters of an access point
+ * @param[in]	ssid	SSID of the access point
+ * @param[in]	pass	Saved password of the access point
+ * @param[out]	rec		Record to fill, its PMK is cleared if the password has changed
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: The access point is not known
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_wifi_cache_find(const char *ssid, const char *pass, app_wifi_cache_rec_t *rec);
+
+/**
+ * @brief		Store the parameters of the current association, derives the PMK if it is
+ * 				missing. Blocks for about a second when the PMK has to be derived
+ * @param[in]	ssid	SSID of the access point
+ * @param[in]	pass	Saved password of the access point
+ * @return
+ * 				- ESP_ERR_INVALID_STATE: The station is not associated
+ * 				- ESP_FAIL: The file could not be written
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_wifi_cache_update(const char *ssid, const char *pass);
+
+/**
+ * @brief		Count a failed connect to an access point
+ * @param[in]	ssid	SSID of the access point
+ * @return
+ * 				- None
+ */
+void app_wifi_cache_note_failure(const char *ssid);
+
+/**
+ * @brief		Find the access point of the most recent association among the saved ones
+ * @param[in]	ap_num		Number of the saved access points
+ * @param[in]	ap_records	Saved access points
+ * @return
+ * 				- Index of the access point, -1 if none of them has a known BSSID
+ */
+int app_wifi_cache_last_used(int ap_num, const app_spiffs_ap_record_t *ap_records);
+
+/**
+ * @brief		Success rate of the connects to an access point, an access point without
+ * 				history is given an even chance
+ * @param[in]	ssid	SSID of the access point
+ * @return
+ * 				- Success rate in percent
+ */
+int app_wifi_cache_success_rate(const char *ssid);
+
+/**
+ * @brief		Forget the BSSID and the channel of an access point after a directed
+ * 				connect has failed, the PMK is kept
+ * @param[in]	ssid	SSID of the access point
+ * @return
+ * 				- ESP_ERR_NOT_FOUND: No BSSID was known for the access point
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_wifi_cache_forget_bssid(const char *ssid);
+
+#endif	/* APP_WIFI_CACHE_H__ */
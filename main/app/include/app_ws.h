@@ -0,0 +1,127 @@
+/**
+ * *****************************************************************************
+ * @file		app_ws.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Persistent WebSocket session to the work server, used for pushed
+ * 				profile updates, track acknowledgements and the microphone stream
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef APP_WS_H__
+#define APP_WS_H__
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Framework */
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+#include <esp_websocket_client.h>
+
+/* Export constants ----------------------------------------------------------*/
+
+#define APP_WS_RX_BUF_SIZE		2048	/*!< Maximum size of a text message received from the server */
+#define APP_WS_SEND_TIMEOUT_MS	1000	/*!< Time a send operation may wait for the transport */
+
+/**
+ * @brief	URL of a local stand-in server used instead of the work server for testing.
+ * 			Uncomment to enable and run tools/ws_standin.py on the host of the URL
+ */
+//#define APP_WS_LOCAL_URL		"ws://192.168.1.57:8070/device/ws"
+
+/* Export typedef ------------------------------------------------------------*/
+
+/**
+ * @brief		Callback invoked with every complete text message received from the server
+ * @param[in]	arg		User argument given to app_ws_start
+ * @param[in]	text	Null-terminated message
+ * @param[in]	len		Message length in bytes
+ */
+typedef void (*app_ws_text_cb_t)(void *arg, const char *text, size_t len);
+
+/**
+ * @brief	WebSocket session related structure
+ * *****************************************************************************
+ * @note	The underlying client reconnects by itself, so the session is started once and
+ * 			the users only check app_ws_is_connected before choosing the transport.
+ * 			The send functions may be called from several tasks at once.
+ * *****************************************************************************
+ */
+typedef struct {
+	esp_websocket_client_handle_t hdl;	/*!< esp_websocket_client handle */
+	app_ws_text_cb_t on_text;			/*!< Text message handler */
+	void *cb_arg;						/*!< Argument of the text message handler */
+	char *rx_buf;						/*!< Buffer used to reassemble fragmented text messages */
+	size_t rx_len;						/*!< Number of bytes currently in the reassembly buffer */
+	uint32_t handshakes;				/*!< Number of handshakes performed since the start */
+} app_ws_session_t;
+
+/* Export functions ----------------------------------------------------------*/
+
+/**
+ * @brief		Start the WebSocket session
+ * @param[out]	ws		A pointer to the session instance
+ * @param[in]	url		ws:// or wss:// URL of the server
+ * @param[in]	user	Device login
+ * @param[in]	passwd	Device password
+ * @param[in]	on_text	Text message handler
+ * @param[in]	arg		Argument of the text message handler
+ * @return
+ * 				- ESP_ERR_NO_MEM: Memory allocation failure
+ * 				- ESP_FAIL: Unexpected error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_ws_start(	app_ws_session_t *ws,
+						const char *url,
+						const char *user,
+						const char *passwd,
+						app_ws_text_cb_t on_text,
+						void *arg);
+
+/**
+ * @brief		Stop the WebSocket session and release its resources
+ * @param[in]	ws	A pointer to the session instance
+ * @return
+ * 				- None
+ */
+void app_ws_stop(app_ws_session_t *ws);
+
+/**
+ * @brief		Check whether the session is established
+ * @param[in]	ws	A pointer to the session instance
+ * @return
+ * 				- pdFALSE: The session is not started or is reconnecting
+ * 				- pdTRUE: The session is established
+ */
+BaseType_t app_ws_is_connected(const app_ws_session_t *ws);
+
+/**
+ * @brief		Send a text message
+ * @param[in]	ws		A pointer to the session instance
+ * @param[in]	text	Null-terminated message
+ * @return
+ * 				- ESP_ERR_INVALID_STATE: The session is not established
+ * 				- ESP_FAIL: Network error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_ws_send_text(app_ws_session_t *ws, const char *text);
+
+/**
+ * @brief		Send a binary message
+ * @param[in]	ws		A pointer to the session instance
+ * @param[in]	data	Pointer to the data to be sent
+ * @param[in]	len		Data length in bytes
+ * @return
+ * 				- ESP_ERR_INVALID_STATE: The session is not established
+ * 				- ESP_FAIL: Network error
+ * 				- ESP_OK: Success
+ */
+esp_err_t app_ws_send_bin(app_ws_session_t *ws, const void *data, size_t len);
+
+#endif	/* APP_WS_H__ */
@@ -28,6 +28,7 @@
 #include "sound_player.h"
 #include "sound_recorder.h"
 #include "app.h"
+#include "app_boot.h"
 #include "board.h"
 #include "mp45dt02.h"
 #include "vs1053b.h"
@@ -72,6 +73,16 @@ void cert_task(void *arg) {
 	vTaskDelete(NULL);
 }
 
+#else
+
+/* Codec and microphone start-up, runs alongside the storage and WiFi bring-up */
+static void board_init_task(void *arg) {
+	app_boot_begin(BOOT_STAGE_BOARD);
+	board_init();
+	app_boot_done(BOOT_STAGE_BOARD);
+	vTaskDelete(NULL);
+}
+
 #endif	/* CERTIFICATION_TASK */
 
 /**
@@ -82,6 +93,8 @@ void cert_task(void *arg) {
  */
 void app_main(void) {
 	esp_err_t ret;
+	app_boot_init();
+	app_boot_begin(BOOT_STAGE_NVS);
 	/* Initialize non-volatile storage */
 	ret = nvs_flash_init();
 	if (	ret == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -95,16 +108,25 @@ void app_main(void) {
 	ESP_ERROR_CHECK( esp_efuse_mac_get_default(mac_buf) );
 	ESP_ERROR_CHECK( esp_base_mac_addr_set(mac_buf) );
 	free(mac_buf);
+	app_boot_done(BOOT_STAGE_NVS);
 	/* Check external SPI RAM size */
 	app_himem_get_size_info();
 	/* Initialize the flash device */
 	spi_flash_init();
 	size_t size = spi_flash_get_chip_size();
 	ESP_LOGI(tag, "Flash chip size = %d", size);
-	board_init();
 #ifndef CERTIFICATION_TASK
+	/* The codec reset delays do not hold the rest of the boot up */
+	xTaskCreatePinnedToCore(&board_init_task,
+							"board_init",
+							4096,
+							NULL,
+							4,
+							NULL,
+							1);
 	app_init(&app_instance);
 #else
+	board_init();
 	xTaskCreatePinnedToCore(&cert_task,
 							"cert_task",
 							32768,
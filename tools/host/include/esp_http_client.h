@@ -0,0 +1,17 @@
+/**
+ * *****************************************************************************
+ * @file		esp_http_client.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the ESP-IDF HTTP client, the handle type only
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_ESP_HTTP_CLIENT_H__
+#define HOST_ESP_HTTP_CLIENT_H__
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+#endif	/* HOST_ESP_HTTP_CLIENT_H__ */
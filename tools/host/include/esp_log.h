@@ -0,0 +1,23 @@
+/**
+ * *****************************************************************************
+ * @file		esp_log.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the ESP-IDF log, the errors and warnings go to stderr
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_ESP_LOG_H__
+#define HOST_ESP_LOG_H__
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...)	fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)	fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)	((void)(tag))
+#define ESP_LOGD(tag, fmt, ...)	((void)(tag))
+#define ESP_LOGV(tag, fmt, ...)	((void)(tag))
+
+#endif	/* HOST_ESP_LOG_H__ */
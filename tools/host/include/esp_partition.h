@@ -0,0 +1,19 @@
+/**
+ * *****************************************************************************
+ * @file		esp_partition.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the ESP-IDF partition types
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_ESP_PARTITION_H__
+#define HOST_ESP_PARTITION_H__
+
+typedef struct esp_partition esp_partition_t;
+typedef int esp_partition_type_t;
+typedef int esp_partition_subtype_t;
+
+#endif	/* HOST_ESP_PARTITION_H__ */
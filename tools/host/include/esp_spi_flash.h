@@ -0,0 +1,15 @@
+/**
+ * *****************************************************************************
+ * @file		esp_spi_flash.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the ESP-IDF SPI flash header, nothing of it is used on the host
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_ESP_SPI_FLASH_H__
+#define HOST_ESP_SPI_FLASH_H__
+
+#endif	/* HOST_ESP_SPI_FLASH_H__ */
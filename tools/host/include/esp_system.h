@@ -0,0 +1,29 @@
+/**
+ * *****************************************************************************
+ * @file		esp_system.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the ESP-IDF random number generator
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_ESP_SYSTEM_H__
+#define HOST_ESP_SYSTEM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t esp_random(void) {
+	return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+static inline void esp_fill_random(void *buf, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		((uint8_t *)buf)[i] = (uint8_t)rand();
+	}
+}
+
+#endif	/* HOST_ESP_SYSTEM_H__ */
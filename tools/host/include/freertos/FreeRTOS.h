@@ -0,0 +1,37 @@
+/**
+ * *****************************************************************************
+ * @file		FreeRTOS.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the FreeRTOS types used by the modules built on the host
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_FREERTOS_H__
+#define HOST_FREERTOS_H__
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE				1
+#define pdFALSE				0
+#define pdPASS				pdTRUE
+#define portMAX_DELAY		((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))
+
+/* The host programs are single threaded, the critical sections do nothing */
+typedef struct {
+	uint32_t owner;
+	uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED	{ 0, 0 }
+#define portENTER_CRITICAL(mux)			((void)(mux))
+#define portEXIT_CRITICAL(mux)			((void)(mux))
+
+#endif	/* HOST_FREERTOS_H__ */
@@ -0,0 +1,22 @@
+/**
+ * *****************************************************************************
+ * @file		queue.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the FreeRTOS queues, creation only
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_QUEUE_H__
+#define HOST_QUEUE_H__
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+#define xQueueCreate(len, size)	((QueueHandle_t)calloc((len), (size)))
+
+#endif	/* HOST_QUEUE_H__ */
@@ -0,0 +1,33 @@
+/**
+ * *****************************************************************************
+ * @file		semphr.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the FreeRTOS semaphores, the host programs are single threaded
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_SEMPHR_H__
+#define HOST_SEMPHR_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()	((SemaphoreHandle_t)1)
+#define xSemaphoreCreateMutex()		((SemaphoreHandle_t)1)
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semphr, TickType_t ticks) {
+	(void)semphr;
+	(void)ticks;
+	return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semphr) {
+	(void)semphr;
+	return pdTRUE;
+}
+
+#endif	/* HOST_SEMPHR_H__ */
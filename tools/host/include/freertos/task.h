@@ -0,0 +1,21 @@
+/**
+ * *****************************************************************************
+ * @file		task.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host stand-in of the FreeRTOS tasks
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_TASK_H__
+#define HOST_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+#define vTaskDelay(ticks)	((void)(ticks))
+
+#endif	/* HOST_TASK_H__ */
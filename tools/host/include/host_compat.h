@@ -0,0 +1,32 @@
+/**
+ * *****************************************************************************
+ * @file		host_compat.h
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Functions of newlib missing from the C library of the host, included
+ * 				ahead of every source file built on the host (-include host_compat.h)
+ *
+ * *****************************************************************************
+ */
+
+/* Define to prevent recursive inclusion */
+#ifndef HOST_COMPAT_H__
+#define HOST_COMPAT_H__
+
+#include <stddef.h>
+#include <string.h>
+
+/* glibc has strlcpy only since 2.38, the host copy is used whatever the version */
+#define strlcpy	host_strlcpy
+
+static inline size_t host_strlcpy(char *dst, const char *src, size_t size) {
+	size_t len = strlen(src);
+	if (size) {
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+#endif	/* HOST_COMPAT_H__ */
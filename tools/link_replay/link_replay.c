@@ -0,0 +1,168 @@
+/**
+ * *****************************************************************************
+ * @file		link_replay.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host replay of the link traces through the health model of the WiFi link
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* User files */
+#include "app_link_model.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+#define LINE_SIZE		256		/* Longest line of a trace file, log prefix included */
+
+/* Private variables ---------------------------------------------------------*/
+
+static const char *level_names[] = {
+		[LINK_DOWN] = "DOWN",
+		[LINK_POOR] = "POOR",
+		[LINK_FAIR] = "FAIR",
+		[LINK_GOOD] = "GOOD",
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Level of its name, -1 if unknown */
+static int _level_of(const char *name) {
+	for (int i = 0; i < (int)(sizeof level_names / sizeof level_names[0]); ++i) {
+		if (!strcmp(name, level_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Check an expectation line of a trace against the health after the previous sample:
+ *   # expect <LEVEL>			level of the link
+ *   # expect-score <lo> <hi>	score within the bounds
+ *   # max-changes <n>			level changes so far, the first sample aside
+ * Other comment lines are ignored. Return the number of failures */
+static int _expect(const char *path, int line_num, const char *line, const app_link_model_t *model,
+				   int sample_cnt, int change_cnt) {
+	const app_link_health_t *health = &model->health;
+	char name[16];
+	int lo, hi;
+	/* "# expect" is a prefix of "# expect-score", so the longer one is tried first */
+	if (sscanf(line, "# expect-score %d %d", &lo, &hi) == 2) {
+		if (health->score < lo || health->score > hi) {
+			printf("%s:%d: score %u, expected %d..%d\n", path, line_num, health->score, lo, hi);
+			return 1;
+		}
+	} else if (sscanf(line, "# expect %15s", name) == 1) {
+		int level = _level_of(name);
+		if (level < 0 || !sample_cnt) {
+			printf("%s:%d: bad expectation\n", path, line_num);
+			return 1;
+		}
+		if (health->level != (app_link_level_e)level) {
+			printf("%s:%d: level %s, expected %s (score %u)\n",
+				   path, line_num, level_names[health->level], name, health->score);
+			return 1;
+		}
+	} else if (sscanf(line, "# max-changes %d", &hi) == 1) {
+		if (change_cnt > hi) {
+			printf("%s:%d: %d level changes, expected at most %d\n", path, line_num, change_cnt, hi);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Replay a trace file, print the health after every sample if verbose. Return the number
+ * of failed expectations, -1 if the file cannot be read */
+static int _replay(const char *path, bool is_verbose) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		printf("%s: cannot open\n", path);
+		return -1;
+	}
+	app_link_model_t model;
+	app_link_model_init(&model);
+	char line[LINE_SIZE];
+	int line_num = 0, sample_cnt = 0, change_cnt = 0, fail_cnt = 0, skip_cnt = 0;
+	app_link_level_e level = LINK_DOWN;
+	while (fgets(line, sizeof line, f)) {
+		++line_num;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#') {
+			fail_cnt += _expect(path, line_num, line, &model, sample_cnt, change_cnt);
+			continue;
+		}
+		app_link_sample_t sample;
+		if (!app_link_trace_parse(line, &sample)) {
+			/* The other lines of the log the trace was cut from */
+			skip_cnt += line[0] != '\0';
+			continue;
+		}
+		app_link_model_feed(&model, &sample);
+		const app_link_health_t *health = &model.health;
+		if (sample_cnt++ && health->level != level) {
+			++change_cnt;
+			if (!is_verbose) {
+				printf("%s: %lld ms: %s -> %s\n",
+					   path, (long long)sample.time_ms, level_names[level], level_names[health->level]);
+			}
+		}
+		level = health->level;
+		if (is_verbose) {
+			printf("%8lld ms  rssi %4d  phy %x  bytes %6u  fail %2u  |  rssi %4d  goodput %6u  fail %3u  score %3u  %s\n",
+				   (long long)sample.time_ms,
+				   sample.rssi,
+				   (unsigned int)sample.phy,
+				   (unsigned int)sample.bytes,
+				   (unsigned int)sample.fail_cnt,
+				   health->rssi,
+				   (unsigned int)health->goodput,
+				   (unsigned int)health->fail_avg,
+				   health->score,
+				   level_names[health->level]);
+		}
+	}
+	fclose(f);
+	if (!sample_cnt) {
+		printf("%s: no samples\n", path);
+		return 1;
+	}
+	printf("%s: %d samples, %d other lines, %d level changes, %s\n",
+		   path, sample_cnt, skip_cnt, change_cnt, fail_cnt ? "FAILED" : "ok");
+	return fail_cnt;
+}
+
+/* Print the usage */
+static void _usage(const char *prog) {
+	printf("Usage:\n"
+		   "  %s show <trace>          health after every sample\n"
+		   "  %s check <trace>...      level changes and expectations of the traces\n",
+		   prog, prog);
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+int main(int argc, char **argv) {
+	if (argc == 3 && !strcmp(argv[1], "show")) {
+		return _replay(argv[2], true) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	if (argc >= 3 && !strcmp(argv[1], "check")) {
+		int failed = 0;
+		for (int i = 2; i < argc; ++i) {
+			failed += _replay(argv[i], false) != 0;
+		}
+		printf("%d of %d traces failed\n", failed, argc - 2);
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	_usage(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,505 @@
+/**
+ * *****************************************************************************
+ * @file		profile_parser_test.c
+ * @author		S. Naumov
+ * *****************************************************************************
+ * @brief		Host differential test, fuzzer and benchmark of the streaming profile
+ * 				parser against cJSON
+ *
+ * *****************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+/* STDLIB */
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+/* Framework */
+#include <cJSON.h>
+
+/* User files */
+#include "app_profile_parser.h"
+#include "sound_recorder.h"
+#include "uuid.h"
+
+/* Private constants ---------------------------------------------------------*/
+
+#define MAX_DOC_SIZE		(64 * 1024)	/* Largest corpus file */
+#define HTTP_PIECE_SIZE		128			/* Piece size of the profile reader of the device */
+#define CHUNK_SPLITS		16			/* Random splits tried for every document */
+#define NUM_TOLERANCE		1e-12		/* Relative difference allowed between the numbers */
+
+/* Expected outcome of a corpus file, given by its directory */
+typedef enum {
+	EXPECT_ANY = 0,		/* Fuzzed input: the parser must not accept what cJSON rejects */
+	EXPECT_VALID,		/* Both accept and agree */
+	EXPECT_INVALID,		/* Both reject */
+	EXPECT_STRICT,		/* cJSON tolerates it, the parser rejects it by design */
+} expect_e;
+
+/* Private variables ---------------------------------------------------------*/
+
+static size_t alloc_cnt;
+static size_t alloc_bytes;
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Counting allocator of cJSON */
+static void *_count_malloc(size_t size) {
+	++alloc_cnt;
+	alloc_bytes += size;
+	return malloc(size);
+}
+
+/* Monotonic time in nanoseconds */
+static int64_t _now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Read a file into a NUL-terminated buffer */
+static char *_read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return NULL;
+	}
+	char *buf = malloc(MAX_DOC_SIZE + 1);
+	*len = fread(buf, 1, MAX_DOC_SIZE, f);
+	fclose(f);
+	buf[*len] = '\0';
+	/* The device hands the parser a C string */
+	*len = strlen(buf);
+	return buf;
+}
+
+/* Expected outcome of a corpus file */
+static expect_e _expect_of(const char *path) {
+	if (strstr(path, "/valid/")) return EXPECT_VALID;
+	if (strstr(path, "/invalid/")) return EXPECT_INVALID;
+	if (strstr(path, "/strict/")) return EXPECT_STRICT;
+	return EXPECT_ANY;
+}
+
+/* Parse with the streaming parser, fed in pieces of the given sizes (0 - one piece) */
+static esp_err_t _parse(const char *text, size_t len, size_t piece, unsigned int seed, app_client_profile_t *profile) {
+	app_profile_parser_t parser;
+	app_profile_parser_init(&parser, profile);
+	for (size_t pos = 0; pos < len;) {
+		size_t n = len - pos;
+		if (piece) {
+			n = piece;
+		} else if (seed) {
+			n = 1 + rand_r(&seed) % 64;
+		}
+		n = n < len - pos ? n : len - pos;
+		if (app_profile_parser_feed(&parser, text + pos, n) != ESP_OK) {
+			return ESP_FAIL;
+		}
+		pos += n;
+	}
+	return app_profile_parser_finish(&parser) == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+/* Flag value of a bool or a number, as valueint of cJSON */
+static bool _ref_flag(const cJSON *item, BaseType_t *flag) {
+	if (cJSON_IsBool(item)) {
+		*flag = cJSON_IsTrue(item) ? 1 : 0;
+		return true;
+	}
+	if (cJSON_IsNumber(item)) {
+		*flag = item->valueint;
+		return true;
+	}
+	return false;
+}
+
+/* Capture profile override, unusable values are ignored */
+static void _ref_override(const cJSON *root, const char *key, uint32_t *value) {
+	const cJSON *item = cJSON_GetObjectItemCaseSensitive(root, key);
+	if (cJSON_IsNumber(item) && item->valuedouble >= 1 && item->valuedouble <= UINT32_MAX) {
+		*value = (uint32_t)item->valuedouble;
+	}
+}
+
+/**
+ * Profile decoded with cJSON under the contract of the streaming parser: the first
+ * occurrence of a key counts, the keys are case sensitive, a known key never holds an
+ * object or an array, and the required keys have their types
+ */
+static esp_err_t _ref_parse(const char *text, app_client_profile_t *profile) {
+	static const char * const known[] = {
+			"id", "name", "currentVoiceCommandId", "mute", "playerActive", "radioActive",
+			"soundCnt", "volume", "radioProfile", "radioSampleRate", "radioDmaBufCount",
+			"radioDmaBufLen", "radioBlockSize",
+	};
+	esp_err_t ret = ESP_FAIL;
+	memset(profile, 0, sizeof *profile);
+	cJSON *root = cJSON_ParseWithOpts(text, NULL, 1);
+	if (!cJSON_IsObject(root)) {
+		goto out;
+	}
+	for (size_t i = 0; i < sizeof known / sizeof known[0]; ++i) {
+		const cJSON *item = cJSON_GetObjectItemCaseSensitive(root, known[i]);
+		if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+			goto out;
+		}
+	}
+	const cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id");
+	const cJSON *name = cJSON_GetObjectItemCaseSensitive(root, "name");
+	const cJSON *cnt = cJSON_GetObjectItemCaseSensitive(root, "soundCnt");
+	const cJSON *vol = cJSON_GetObjectItemCaseSensitive(root, "volume");
+	if (	!cJSON_IsString(id) || !cJSON_IsString(name) ||
+			!cJSON_IsNumber(cnt) || !cJSON_IsNumber(vol) ||
+			!_ref_flag(cJSON_GetObjectItemCaseSensitive(root, "mute"), &profile->is_muted) ||
+			!_ref_flag(cJSON_GetObjectItemCaseSensitive(root, "playerActive"), &profile->is_player) ||
+			!_ref_flag(cJSON_GetObjectItemCaseSensitive(root, "radioActive"), &profile->is_recorder)) {
+		goto out;
+	}
+	strlcpy(profile->id, id->valuestring, sizeof profile->id);
+	strlcpy(profile->name, name->valuestring, sizeof profile->name);
+	profile->track_cnt = cnt->valuedouble;
+	profile->vol = vol->valuedouble;
+	const cJSON *track = cJSON_GetObjectItemCaseSensitive(root, "currentVoiceCommandId");
+	uuid_t track_id;
+	if (cJSON_IsString(track) && uuid_parse(track->valuestring, &track_id) == ESP_OK) {
+		profile->track_id = track_id;
+	}
+	const cJSON *rec = cJSON_GetObjectItemCaseSensitive(root, "radioProfile");
+	const sound_recorder_profile_t *base = cJSON_IsString(rec) ? sound_recorder_find_profile(rec->valuestring) : NULL;
+	profile->rec_cfg = base ? *base : recorder_profile_default;
+	_ref_override(root, "radioSampleRate", &profile->rec_cfg.sample_rate);
+	_ref_override(root, "radioDmaBufCount", &profile->rec_cfg.dma_buf_count);
+	_ref_override(root, "radioDmaBufLen", &profile->rec_cfg.dma_buf_len);
+	_ref_override(root, "radioBlockSize", &profile->rec_cfg.block_size);
+	ret = ESP_OK;
+out:
+	cJSON_Delete(root);
+	return ret;
+}
+
+/* Compare two numbers decoded by different routines */
+static bool _num_equal(double a, double b) {
+	if (a == b) {
+		return true;
+	}
+	return fabs(a - b) <= NUM_TOLERANCE * fmax(fabs(a), fabs(b));
+}
+
+/* Compare two decoded profiles, print the first difference */
+static bool _profile_equal(const app_client_profile_t *a, const app_client_profile_t *b, const char *what) {
+	const char *field = NULL;
+	if (strcmp(a->id, b->id)) field = "id";
+	else if (strcmp(a->name, b->name)) field = "name";
+	else if (a->is_muted != b->is_muted) field = "mute";
+	else if (a->is_player != b->is_player) field = "playerActive";
+	else if (a->is_recorder != b->is_recorder) field = "radioActive";
+	else if (!_num_equal(a->track_cnt, b->track_cnt)) field = "soundCnt";
+	else if (!_num_equal(a->vol, b->vol)) field = "volume";
+	else if (memcmp(&a->track_id, &b->track_id, sizeof a->track_id)) field = "currentVoiceCommandId";
+	else if (memcmp(&a->rec_cfg, &b->rec_cfg, sizeof a->rec_cfg)) field = "radio*";
+	if (field) {
+		printf("  %s: %s differs\n", what, field);
+		return false;
+	}
+	return true;
+}
+
+/* Outcome counters of a run */
+typedef struct {
+	size_t docs;
+	size_t accepted;
+	size_t rejected;
+	size_t stricter;
+	size_t failures;
+} stats_t;
+
+/* Check a document against cJSON and its own chunked feeding, false on a failure */
+static bool _check_doc(const char *name, const char *text, size_t len, expect_e expect, stats_t *stats) {
+	app_client_profile_t ref, whole, chunked;
+	esp_err_t ref_ret = _ref_parse(text, &ref);
+	esp_err_t ret = _parse(text, len, 0, 0, &whole);
+	bool is_ok = true;
+	++stats->docs;
+	/* The result must not depend on how the response is split by the HTTP reader */
+	for (unsigned int split = 0; split <= CHUNK_SPLITS; ++split) {
+		size_t piece = split == 0 ? 1 : split == 1 ? HTTP_PIECE_SIZE : 0;
+		if (_parse(text, len, piece, split + 1, &chunked) != ret) {
+			printf("%s: split %u changes the result\n", name, split);
+			is_ok = false;
+			break;
+		}
+		if (ret == ESP_OK && !_profile_equal(&whole, &chunked, "split")) {
+			printf("%s: split %u changes the profile\n", name, split);
+			is_ok = false;
+			break;
+		}
+	}
+	if (ret == ESP_OK && ref_ret != ESP_OK) {
+		/* Accepting what cJSON rejects is never allowed */
+		printf("%s: accepted by the parser, rejected by cJSON\n", name);
+		is_ok = false;
+	} else if (ret == ESP_OK && !_profile_equal(&whole, &ref, "cJSON")) {
+		printf("%s: decoded differently from cJSON\n", name);
+		is_ok = false;
+	} else if (ret != ESP_OK && ref_ret == ESP_OK) {
+		++stats->stricter;
+		if (expect == EXPECT_VALID || expect == EXPECT_INVALID) {
+			printf("%s: rejected by the parser, accepted by cJSON\n", name);
+			is_ok = false;
+		}
+	}
+	if (expect == EXPECT_VALID && ret != ESP_OK) {
+		printf("%s: expected to be valid\n", name);
+		is_ok = false;
+	} else if (expect == EXPECT_INVALID && (ret == ESP_OK || ref_ret == ESP_OK)) {
+		printf("%s: expected to be invalid\n", name);
+		is_ok = false;
+	} else if (expect == EXPECT_STRICT && (ret == ESP_OK || ref_ret != ESP_OK)) {
+		printf("%s: expected to be tolerated by cJSON only\n", name);
+		is_ok = false;
+	}
+	if (ret == ESP_OK) {
+		++stats->accepted;
+	} else {
+		++stats->rejected;
+	}
+	if (!is_ok) {
+		++stats->failures;
+	}
+	return is_ok;
+}
+
+/* Every proper prefix of a valid document is a truncated response */
+static void _check_prefixes(const char *name, const char *text, size_t len, stats_t *stats) {
+	app_client_profile_t profile;
+	size_t end = len;
+	while (end && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r' || text[end - 1] == '\n')) {
+		--end;
+	}
+	for (size_t cut = 0; cut < end; ++cut) {
+		++stats->docs;
+		++stats->rejected;
+		if (_parse(text, cut, 0, 0, &profile) == ESP_OK) {
+			printf("%s: truncated at %zu bytes and accepted\n", name, cut);
+			++stats->failures;
+			--stats->rejected;
+			++stats->accepted;
+		}
+	}
+}
+
+/* Derive a malformed document from a seed */
+static size_t _mutate(char *dst, const char *src, size_t len, unsigned int *seed) {
+	static const char tokens[][8] = {
+			"{", "}", "[", "]", ",", ":", "\"", "\\", "\\u", "\\uD800", "\\uDC00", "true",
+			"null", "-", "1e999", "0", ".", "e", " ", "\t", "\x01", "\xff", "{\"a\":",
+	};
+	size_t n = len;
+	memcpy(dst, src, len);
+	for (int edits = 1 + rand_r(seed) % 4; edits; --edits) {
+		size_t pos = n ? rand_r(seed) % (n + 1) : 0;
+		switch (rand_r(seed) % 7) {
+		case 0:	/* Truncation */
+			n = pos;
+			break;
+		case 1:	/* Deleted span */
+			if (pos < n) {
+				size_t del = 1 + rand_r(seed) % MIN(n - pos, (size_t)16);
+				memmove(dst + pos, dst + pos + del, n - pos - del);
+				n -= del;
+			}
+			break;
+		case 2:	/* Flipped byte */
+			if (pos < n) {
+				dst[pos] ^= 1 << (rand_r(seed) % 8);
+			}
+			break;
+		case 3: {	/* Inserted token */
+			const char *tok = tokens[rand_r(seed) % (sizeof tokens / sizeof tokens[0])];
+			size_t tlen = strlen(tok);
+			if (n + tlen < MAX_DOC_SIZE) {
+				memmove(dst + pos + tlen, dst + pos, n - pos);
+				memcpy(dst + pos, tok, tlen);
+				n += tlen;
+			}
+			break;
+		}
+		case 4: {	/* Duplicated span */
+			char span[32];
+			size_t from = n ? rand_r(seed) % n : 0;
+			size_t dup = n ? 1 + rand_r(seed) % MIN(n - from, sizeof span) : 0;
+			if (n + dup < MAX_DOC_SIZE) {
+				memcpy(span, dst + from, dup);
+				memmove(dst + pos + dup, dst + pos, n - pos);
+				memcpy(dst + pos, span, dup);
+				n += dup;
+			}
+			break;
+		}
+		case 5: {	/* Nesting around a value of an unknown key */
+			size_t depth = 1 + rand_r(seed) % 24;
+			const char *key = "\"nest\":";
+			size_t klen = strlen(key);
+			size_t need = klen + 2 * depth + 2;
+			char *brace = n ? memchr(dst, '{', n) : NULL;
+			if (brace && n + need < MAX_DOC_SIZE) {
+				size_t at = brace - dst + 1;
+				memmove(dst + at + need, dst + at, n - at);
+				memcpy(dst + at, key, klen);
+				for (size_t i = 0; i < depth; ++i) {
+					dst[at + klen + i] = i % 2 ? '{' : '[';
+					dst[at + klen + 2 * depth - 1 - i] = i % 2 ? '}' : ']';
+				}
+				/* An object needs a key, so the innermost level is always an array */
+				if (depth % 2 == 0) {
+					dst[at + klen + depth - 1] = '[';
+					dst[at + klen + depth] = ']';
+				}
+				dst[at + klen + 2 * depth] = ',';
+				dst[at + klen + 2 * depth + 1] = ' ';
+				n += need;
+			}
+			break;
+		}
+		default:	/* Random byte */
+			if (pos < n) {
+				dst[pos] = (char)rand_r(seed);
+			}
+			break;
+		}
+	}
+	dst[n] = '\0';
+	return strlen(dst);
+}
+
+/* Print the summary of a run */
+static int _report(const char *what, const stats_t *stats) {
+	printf(	"%s: %zu documents, %zu accepted, %zu rejected (%zu tolerated by cJSON), %zu failures\n",
+			what,
+			stats->docs,
+			stats->accepted,
+			stats->rejected,
+			stats->stricter,
+			stats->failures);
+	return stats->failures ? 1 : 0;
+}
+
+/* Differential check of the corpus files and of their truncations */
+static int _run_diff(int argc, char **argv) {
+	stats_t stats = { 0 };
+	for (int i = 0; i < argc; ++i) {
+		size_t len;
+		char *text = _read_file(argv[i], &len);
+		if (!text) {
+			printf("%s: cannot be read\n", argv[i]);
+			return 1;
+		}
+		expect_e expect = _expect_of(argv[i]);
+		_check_doc(argv[i], text, len, expect, &stats);
+		if (expect == EXPECT_VALID) {
+			_check_prefixes(argv[i], text, len, &stats);
+		}
+		free(text);
+	}
+	return _report("diff", &stats);
+}
+
+/* Differential check of the documents derived from the corpus files */
+static int _run_fuzz(long iterations, unsigned int seed, int argc, char **argv) {
+	stats_t stats = { 0 };
+	char **docs = calloc(argc, sizeof *docs);
+	size_t *lens = calloc(argc, sizeof *lens);
+	char *mutant = malloc(MAX_DOC_SIZE + 1);
+	char name[64];
+	for (int i = 0; i < argc; ++i) {
+		if (!(docs[i] = _read_file(argv[i], &lens[i]))) {
+			printf("%s: cannot be read\n", argv[i]);
+			return 1;
+		}
+	}
+	for (long it = 0; it < iterations; ++it) {
+		int src = rand_r(&seed) % argc;
+		size_t len = _mutate(mutant, docs[src], lens[src], &seed);
+		snprintf(name, sizeof name, "mutant %ld of %d", it, src);
+		if (!_check_doc(name, mutant, len, EXPECT_ANY, &stats)) {
+			printf("  source %s, input: %s\n", argv[src], mutant);
+			if (stats.failures >= 10) {
+				break;
+			}
+		}
+	}
+	for (int i = 0; i < argc; ++i) {
+		free(docs[i]);
+	}
+	free(docs);
+	free(lens);
+	free(mutant);
+	return _report("fuzz", &stats);
+}
+
+/* Time and allocations of both parsers on the corpus files */
+static int _run_bench(long iterations, int argc, char **argv) {
+	cJSON_Hooks hooks = { .malloc_fn = _count_malloc, .free_fn = free };
+	app_client_profile_t profile;
+	cJSON_InitHooks(&hooks);
+	printf("Parser state: %zu bytes on the stack, no heap\n", sizeof(app_profile_parser_t));
+	printf("%-40s %7s %12s %12s %10s %12s\n", "file", "bytes", "parser ns", "cJSON ns", "cJSON allocs", "cJSON bytes");
+	for (int i = 0; i < argc; ++i) {
+		size_t len;
+		char *text = _read_file(argv[i], &len);
+		if (!text) {
+			printf("%s: cannot be read\n", argv[i]);
+			return 1;
+		}
+		int64_t start = _now_ns();
+		for (long it = 0; it < iterations; ++it) {
+			_parse(text, len, HTTP_PIECE_SIZE, 0, &profile);
+		}
+		int64_t parser_ns = (_now_ns() - start) / iterations;
+		alloc_cnt = 0;
+		alloc_bytes = 0;
+		start = _now_ns();
+		for (long it = 0; it < iterations; ++it) {
+			_ref_parse(text, &profile);
+		}
+		int64_t cjson_ns = (_now_ns() - start) / iterations;
+		const char *base = strrchr(argv[i], '/');
+		printf(	"%-40s %7zu %12lld %12lld %10zu %12zu\n",
+				base ? base + 1 : argv[i],
+				len,
+				(long long)parser_ns,
+				(long long)cjson_ns,
+				alloc_cnt / iterations,
+				alloc_bytes / iterations);
+		free(text);
+	}
+	return 0;
+}
+
+/* Export functions ----------------------------------------------------------*/
+
+int main(int argc, char **argv) {
+	if (argc >= 3 && !strcmp(argv[1], "diff")) {
+		return _run_diff(argc - 2, argv + 2);
+	}
+	if (argc >= 5 && !strcmp(argv[1], "fuzz")) {
+		return _run_fuzz(atol(argv[2]), (unsigned int)atol(argv[3]), argc - 4, argv + 4);
+	}
+	if (argc >= 4 && !strcmp(argv[1], "bench")) {
+		return _run_bench(atol(argv[2]), argc - 3, argv + 3);
+	}
+	fprintf(stderr,	"usage: %s diff <file>...\n"
+					"       %s fuzz <iterations> <seed> <file>...\n"
+					"       %s bench <iterations> <file>...\n",
+					argv[0], argv[0], argv[0]);
+	return 2;
+}
@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+"""Local stand-in for the WebSocket endpoint of the work server.
+
+Serves the session opened by the device when CLIENT_WS_TRANSPORT is enabled and
+APP_WS_LOCAL_URL points at this host. Only the Python standard library is used.
+
+The stand-in
+  - pushes profile updates typed on the console (see HELP below),
+  - logs the track acknowledgements ({"type":"trackDone","id":"..."}),
+  - receives the microphone stream ({"type":"radio",...} followed by binary
+    messages of sampler_frame_hdr_t and samples), reports lost blocks and the
+    capture latency, and writes every radio session to a WAV file.
+
+Usage:
+  tools/ws_standin.py [--host 0.0.0.0] [--port 8070] [--path /device/ws]
+                      [--out ws_records] [--profile profile.json]
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import os
+import struct
+import sys
+import time
+import uuid
+import wave
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+OP_CONT = 0x0
+OP_TEXT = 0x1
+OP_BIN = 0x2
+OP_CLOSE = 0x8
+OP_PING = 0x9
+OP_PONG = 0xA
+
+# sampler_frame_hdr_t: uint32_t seq, int64_t capture_us, uint16_t samples, packed
+FRAME_HDR = struct.Struct("<IqH")
+
+HELP = """Console commands:
+  play <uuid> [volume]   push a profile that plays the track
+  stop                   push a profile that stops the player
+  radio on|off           push a profile that switches the microphone stream
+  volume <0..100>        push a profile with the new volume
+  show                   print the profile pushed next
+  {...}                  push the JSON text as it is
+  help                   print this text
+"""
+
+
+def _default_profile():
+    return {
+        "id": str(uuid.UUID(int=1)),
+        "name": "ws-standin",
+        "currentVoiceCommandId": str(uuid.UUID(int=0)),
+        "mute": False,
+        "playerActive": False,
+        "radioActive": False,
+        "soundCnt": 0,
+        "volume": 50,
+    }
+
+
+class RadioSession:
+    """One microphone stream, from {"type":"radio"} to {"type":"radioEnd"}"""
+
+    def __init__(self, out_dir, rate, device_time_us):
+        self.rate = rate
+        self.device_time_us = device_time_us
+        self.host_time = time.monotonic()
+        self.next_seq = None
+        self.frames = 0
+        self.lost = 0
+        self.latency_ms = []
+        name = time.strftime("radio_%Y%m%d_%H%M%S") + "_%u.wav" % rate
+        self.path = os.path.join(out_dir, name)
+        self.wav = wave.open(self.path, "wb")
+        self.wav.setnchannels(1)
+        self.wav.setsampwidth(2)
+        self.wav.setframerate(rate)
+
+    def feed(self, payload):
+        if len(payload) < FRAME_HDR.size:
+            print("[radio] short frame of %u bytes" % len(payload))
+            return
+        seq, capture_us, samples = FRAME_HDR.unpack_from(payload)
+        data = payload[FRAME_HDR.size:FRAME_HDR.size + samples * 2]
+        if len(data) != samples * 2:
+            print("[radio] frame %u: %u samples announced, %u received" % (seq, samples, len(data) // 2))
+        if self.next_seq is not None and seq != self.next_seq:
+            gap = (seq - self.next_seq) & 0xFFFFFFFF
+            self.lost += gap
+            print("[radio] %u blocks lost before %u" % (gap, seq))
+        self.next_seq = (seq + 1) & 0xFFFFFFFF
+        self.frames += 1
+        self.wav.writeframes(data)
+        if self.device_time_us is not None:
+            # Device time now, estimated from the reference given with the radio message
+            now_us = self.device_time_us + (time.monotonic() - self.host_time) * 1e6
+            self.latency_ms.append((now_us - capture_us) / 1000)
+
+    def close(self):
+        self.wav.close()
+        line = "[radio] %s: %u frames, %u lost" % (self.path, self.frames, self.lost)
+        if self.latency_ms:
+            lat = sorted(self.latency_ms)
+            line += ", latency median %.0f ms, max %.0f ms" % (lat[len(lat) // 2], lat[-1])
+        print(line)
+
+
+class Session:
+    """WebSocket session of one device"""
+
+    def __init__(self, reader, writer, args, profile):
+        self.reader = reader
+        self.writer = writer
+        self.args = args
+        self.profile = profile
+        self.radio = None
+
+    async def send(self, opcode, payload):
+        # Server frames are not masked
+        hdr = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            hdr += bytes([len(payload)])
+        elif len(payload) < 0x10000:
+            hdr += bytes([126]) + struct.pack(">H", len(payload))
+        else:
+            hdr += bytes([127]) + struct.pack(">Q", len(payload))
+        self.writer.write(hdr + payload)
+        await self.writer.drain()
+
+    async def send_text(self, text):
+        print("[push] %s" % text)
+        await self.send(OP_TEXT, text.encode())
+
+    async def recv(self):
+        """Return (opcode, payload) of the next message, fragments joined"""
+        opcode = None
+        message = b""
+        while True:
+            b0, b1 = await self.reader.readexactly(2)
+            fin = b0 & 0x80
+            op = b0 & 0x0F
+            length = b1 & 0x7F
+            if length == 126:
+                (length,) = struct.unpack(">H", await self.reader.readexactly(2))
+            elif length == 127:
+                (length,) = struct.unpack(">Q", await self.reader.readexactly(8))
+            mask = await self.reader.readexactly(4) if b1 & 0x80 else None
+            payload = await self.reader.readexactly(length)
+            if mask:
+                payload = bytes(c ^ mask[i % 4] for i, c in enumerate(payload))
+            if op >= OP_CLOSE:
+                # Control frames may come between the fragments of a message
+                return op, payload
+            if op != OP_CONT:
+                opcode = op
+            message += payload
+            if fin:
+                return opcode, message
+
+    def on_text(self, text):
+        try:
+            msg = json.loads(text)
+        except ValueError:
+            print("[recv] not JSON: %r" % text)
+            return
+        kind = msg.get("type")
+        if kind == "trackDone":
+            print("[recv] end of reproduction of %s" % msg.get("id"))
+        elif kind == "radio":
+            if self.radio:
+                self.radio.close()
+            self.radio = RadioSession(self.args.out, int(msg.get("rate", 16000)), msg.get("deviceTimeUs"))
+            print("[radio] stream at %u Hz" % self.radio.rate)
+        elif kind == "radioEnd":
+            if self.radio:
+                self.radio.close()
+                self.radio = None
+        else:
+            print("[recv] %s" % text)
+
+    async def run(self):
+        # The current profile is pushed at once, as the work server would do
+        await self.send_text(json.dumps(self.profile))
+        while True:
+            opcode, payload = await self.recv()
+            if opcode == OP_TEXT:
+                self.on_text(payload.decode(errors="replace"))
+            elif opcode == OP_BIN:
+                if self.radio:
+                    self.radio.feed(payload)
+                else:
+                    print("[recv] binary message of %u bytes outside a radio stream" % len(payload))
+            elif opcode == OP_PING:
+                await self.send(OP_PONG, payload)
+            elif opcode == OP_CLOSE:
+                await self.send(OP_CLOSE, payload[:2])
+                return
+
+    def close(self):
+        if self.radio:
+            self.radio.close()
+            self.radio = None
+        self.writer.close()
+
+
+class StandIn:
+    def __init__(self, args):
+        self.args = args
+        self.profile = _default_profile()
+        if args.profile:
+            with open(args.profile) as f:
+                self.profile.update(json.load(f))
+        self.session = None
+
+    async def handshake(self, reader, writer):
+        request = await reader.readuntil(b"\r\n\r\n")
+        lines = request.decode(errors="replace").split("\r\n")
+        method, path = lines[0].split(" ")[:2]
+        headers = {}
+        for line in lines[1:]:
+            if ":" in line:
+                key, value = line.split(":", 1)
+                headers[key.strip().lower()] = value.strip()
+        key = headers.get("sec-websocket-key")
+        if method != "GET" or path.split("?")[0] != self.args.path or not key:
+            writer.write(b"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n")
+            await writer.drain()
+            return False
+        auth = headers.get("authorization", "")
+        if auth.lower().startswith("basic "):
+            user = base64.b64decode(auth[6:]).decode(errors="replace").split(":")[0]
+            print("[conn] device %s" % user)
+        accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+        writer.write(("HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: %s\r\n\r\n" % accept).encode())
+        await writer.drain()
+        return True
+
+    async def on_connect(self, reader, writer):
+        peer = writer.get_extra_info("peername")
+        print("[conn] %s:%u connected" % peer[:2])
+        try:
+            if not await self.handshake(reader, writer):
+                writer.close()
+                return
+            self.session = Session(reader, writer, self.args, self.profile)
+            await self.session.run()
+        except (asyncio.IncompleteReadError, ConnectionError) as e:
+            print("[conn] %s:%u lost: %s" % (peer[:2] + (type(e).__name__,)))
+        finally:
+            if self.session and self.session.writer is writer:
+                self.session.close()
+                self.session = None
+            print("[conn] %s:%u closed" % peer[:2])
+
+    def command(self, line):
+        """Apply a console command to the profile, return the text to push or None"""
+        words = line.split()
+        if not words:
+            return None
+        if line.startswith("{"):
+            return line
+        cmd = words[0]
+        if cmd == "play" and len(words) >= 2:
+            self.profile["currentVoiceCommandId"] = str(uuid.UUID(words[1]))
+            self.profile["playerActive"] = True
+            self.profile["soundCnt"] = max(self.profile.get("soundCnt", 0), 1)
+            if len(words) >= 3:
+                self.profile["volume"] = int(words[2])
+        elif cmd == "stop":
+            self.profile["playerActive"] = False
+        elif cmd == "radio" and len(words) == 2 and words[1] in ("on", "off"):
+            self.profile["radioActive"] = words[1] == "on"
+        elif cmd == "volume" and len(words) == 2:
+            self.profile["volume"] = int(words[1])
+        elif cmd == "show":
+            print(json.dumps(self.profile, indent=2))
+            return None
+        else:
+            print(HELP)
+            return None
+        return json.dumps(self.profile)
+
+    async def console(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            line = await loop.run_in_executor(None, sys.stdin.readline)
+            if not line:
+                return
+            try:
+                text = self.command(line.strip())
+            except ValueError as e:
+                print("Bad command: %s" % e)
+                continue
+            if text is None:
+                continue
+            if not self.session:
+                print("No device connected, the profile is pushed on the next connection")
+                continue
+            await self.session.send_text(text)
+
+    async def run(self):
+        os.makedirs(self.args.out, exist_ok=True)
+        server = await asyncio.start_server(self.on_connect, self.args.host, self.args.port)
+        print("Listening on ws://%s:%u%s" % (self.args.host, self.args.port, self.args.path))
+        print(HELP)
+        async with server:
+            await self.console()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local stand-in for the WebSocket endpoint of the work server")
+    parser.add_argument("--host", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=8070, help="port to listen on")
+    parser.add_argument("--path", default="/device/ws", help="path of the WebSocket endpoint")
+    parser.add_argument("--out", default="ws_records", help="directory of the WAV files of the radio streams")
+    parser.add_argument("--profile", help="JSON file with the fields of the first profile pushed")
+    args = parser.parse_args()
+    try:
+        asyncio.run(StandIn(args).run())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()